@@ -97,6 +97,9 @@ constexpr auto kSharedMediaLimit = 100;
 //constexpr auto kFeedMessagesLimit = 50; // #feed
 constexpr auto kReadFeaturedSetsTimeout = crl::time(1000);
 constexpr auto kFileLoaderQueueStopTimeout = crl::time(5000);
+
+// Edited media doesn't add a message, so it doesn't wait for the sent ones.
+constexpr auto kEditMediaTaskPriority = 1;
 //constexpr auto kFeedReadTimeout = crl::time(1000); // #feed
 constexpr auto kStickersByEmojiInvalidateTimeout = crl::time(60 * 60 * 1000);
 constexpr auto kNotifySettingSaveTimeout = crl::time(1000);
@@ -823,7 +826,8 @@ void ApiWrap::requestMoreDialogs(Data::Folder *folder) {
 			: MTP_inputPeerEmpty()),
 		MTP_int(loadCount),
 		MTP_int(hash)
-	)).done([=](const MTPmessages_Dialogs &result) {
+	)).parseInBackground(
+	).done([=](const MTPmessages_Dialogs &result) {
 		const auto state = dialogsLoadState(folder);
 		const auto count = result.match([](
 				const MTPDmessages_dialogsNotModified &) {
@@ -4559,7 +4563,7 @@ void ApiWrap::editMedia(
 		to,
 		caption,
 		nullptr,
-		msgIdToEdit));
+		msgIdToEdit), kEditMediaTaskPriority);
 }
 
 void ApiWrap::sendFiles(
@@ -20,6 +20,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "core/local_url_handlers.h"
 #include "core/launcher.h"
 #include "core/ui_integration.h"
+#include "core/media_active_cache.h"
 #include "chat_helpers/emoji_keywords.h"
 #include "storage/localstorage.h"
 #include "platform/platform_specific.h"
@@ -168,6 +169,7 @@ void Application::run() {
 
 	startLocalStorage();
 	ValidateScale();
+	SetMediaCacheLimits(ComputeMediaCacheLimits());
 
 	if (Local::oldSettingsVersion() < AppVersion) {
 		psNewVersion();
@@ -282,6 +282,8 @@ void SignalHandler(int signum) {
 
 	dump() << "\n";
 
+	Logs::flushOnCrash();
+
 	ReportingThreadId = nullptr;
 }
 
@@ -0,0 +1,149 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "core/media_active_cache.h"
+
+#include "platform/platform_specific.h"
+
+namespace Core {
+namespace {
+
+// Encoded cache gets 1/64 of the memory, the default limits are for 8 GB.
+constexpr auto kEncodedMemoryShare = int64(64);
+constexpr auto kMinEncodedLimit = int64(64 * 1024 * 1024);
+constexpr auto kMaxEncodedLimit = int64(512 * 1024 * 1024);
+
+MediaCacheLimits Limits;
+std::vector<details::MediaActiveCacheBase*> Caches;
+
+[[nodiscard]] int64 LimitForTier(MediaCacheTier tier) {
+	switch (tier) {
+	case MediaCacheTier::Encoded: return Limits.encoded;
+	case MediaCacheTier::Decoded: return Limits.decoded;
+	case MediaCacheTier::Scaled: return Limits.scaled;
+	}
+	Unexpected("Tier in LimitForTier.");
+}
+
+[[nodiscard]] QString TierName(MediaCacheTier tier) {
+	switch (tier) {
+	case MediaCacheTier::Encoded: return "encoded";
+	case MediaCacheTier::Decoded: return "decoded";
+	case MediaCacheTier::Scaled: return "scaled";
+	}
+	Unexpected("Tier in TierName.");
+}
+
+} // namespace
+
+MediaCacheLimits ComputeMediaCacheLimits() {
+	auto result = MediaCacheLimits();
+	const auto memory = Platform::PhysicalMemorySize();
+	if (memory <= 0) {
+		return result;
+	}
+	const auto encoded = std::clamp(
+		memory / kEncodedMemoryShare,
+		kMinEncodedLimit,
+		kMaxEncodedLimit);
+	result.decoded = result.decoded * encoded / result.encoded;
+	result.scaled = result.scaled * encoded / result.encoded;
+	result.encoded = encoded;
+	return result;
+}
+
+void SetMediaCacheLimits(const MediaCacheLimits &limits) {
+	Limits = limits;
+	for (const auto cache : Caches) {
+		cache->setLimit(LimitForTier(cache->tier()));
+	}
+}
+
+const MediaCacheLimits &GetMediaCacheLimits() {
+	return Limits;
+}
+
+MediaCacheStats GetMediaCacheStats(MediaCacheTier tier) {
+	auto result = MediaCacheStats();
+	result.limit = LimitForTier(tier);
+	for (const auto cache : Caches) {
+		if (cache->tier() != tier) {
+			continue;
+		}
+		const auto stats = cache->stats();
+		result.usage += stats.usage;
+		result.hits += stats.hits;
+		result.misses += stats.misses;
+		result.evictions += stats.evictions;
+		result.evictedBytes += stats.evictedBytes;
+	}
+	return result;
+}
+
+void LogMediaCacheStats() {
+	const auto tiers = {
+		MediaCacheTier::Encoded,
+		MediaCacheTier::Decoded,
+		MediaCacheTier::Scaled,
+	};
+	for (const auto tier : tiers) {
+		const auto stats = GetMediaCacheStats(tier);
+		DEBUG_LOG(("Media Cache (%1): usage %2 / %3 KB, "
+			"hits %4, misses %5, evictions %6 (%7 KB)."
+			).arg(TierName(tier)
+			).arg(stats.usage / 1024
+			).arg(stats.limit / 1024
+			).arg(stats.hits
+			).arg(stats.misses
+			).arg(stats.evictions
+			).arg(stats.evictedBytes / 1024));
+	}
+}
+
+namespace details {
+
+MediaActiveCacheBase::MediaActiveCacheBase(MediaCacheTier tier)
+: _tier(tier) {
+	_stats.limit = LimitForTier(tier);
+	Caches.push_back(this);
+}
+
+MediaActiveCacheBase::~MediaActiveCacheBase() {
+	Caches.erase(ranges::remove(Caches, this), end(Caches));
+}
+
+MediaCacheTier MediaActiveCacheBase::tier() const {
+	return _tier;
+}
+
+MediaCacheStats MediaActiveCacheBase::stats() const {
+	return _stats;
+}
+
+void MediaActiveCacheBase::setLimit(int64 limit) {
+	_stats.limit = limit;
+	limitChanged();
+}
+
+void MediaActiveCacheBase::hit() {
+	++_stats.hits;
+}
+
+void MediaActiveCacheBase::miss() {
+	++_stats.misses;
+}
+
+void MediaActiveCacheBase::increment(int64 amount) {
+	_stats.usage += amount;
+}
+
+void MediaActiveCacheBase::decrement(int64 amount) {
+	_stats.usage -= amount;
+}
+
+} // namespace details
+} // namespace Core
@@ -11,69 +11,141 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 
 namespace Core {
 
+enum class MediaCacheTier {
+	Encoded, // File bytes and images that belong to documents.
+	Decoded, // Images decoded from their files.
+	Scaled, // Pixmaps prepared from decoded images for painting.
+};
+
+struct MediaCacheLimits {
+	int64 encoded = 128 * 1024 * 1024;
+	int64 decoded = 96 * 1024 * 1024;
+	int64 scaled = 32 * 1024 * 1024;
+};
+
+struct MediaCacheStats {
+	int64 usage = 0;
+	int64 limit = 0;
+	int64 hits = 0;
+	int64 misses = 0;
+	int64 evictions = 0;
+	int64 evictedBytes = 0;
+};
+
+// Default limits scaled by the physical memory size.
+[[nodiscard]] MediaCacheLimits ComputeMediaCacheLimits();
+
+// All media caches live in the main thread.
+void SetMediaCacheLimits(const MediaCacheLimits &limits);
+[[nodiscard]] const MediaCacheLimits &GetMediaCacheLimits();
+[[nodiscard]] MediaCacheStats GetMediaCacheStats(MediaCacheTier tier);
+void LogMediaCacheStats();
+
+namespace details {
+
+class MediaActiveCacheBase {
+public:
+	explicit MediaActiveCacheBase(MediaCacheTier tier);
+	MediaActiveCacheBase(const MediaActiveCacheBase &other) = delete;
+	MediaActiveCacheBase &operator=(
+		const MediaActiveCacheBase &other) = delete;
+	virtual ~MediaActiveCacheBase();
+
+	[[nodiscard]] MediaCacheTier tier() const;
+	[[nodiscard]] MediaCacheStats stats() const;
+	void setLimit(int64 limit);
+
+	// Lookups that found the entry ready or had to load it.
+	void hit();
+	void miss();
+
+	void increment(int64 amount);
+	void decrement(int64 amount);
+
+protected:
+	virtual void limitChanged() = 0;
+
+	MediaCacheTier _tier = MediaCacheTier();
+	MediaCacheStats _stats;
+
+};
+
+} // namespace details
+
 template <typename Type>
-class MediaActiveCache {
+class MediaActiveCache final : public details::MediaActiveCacheBase {
 public:
 	template <typename Unload>
-	MediaActiveCache(int64 limit, Unload &&unload);
+	MediaActiveCache(MediaCacheTier tier, Unload &&unload);
 
 	void up(Type *entry);
 	void remove(Type *entry);
 	void clear();
 
-	void increment(int64 amount);
-	void decrement(int64 amount);
-
 private:
+	void limitChanged() override;
+
 	template <typename Unload>
 	void check(Unload &&unload);
 
 	base::last_used_cache<Type*> _cache;
+	Type *_last = nullptr;
 	SingleQueuedInvokation _delayed;
-	int64 _usage = 0;
-	int64 _limit = 0;
 
 };
 
 template <typename Type>
 template <typename Unload>
-MediaActiveCache<Type>::MediaActiveCache(int64 limit, Unload &&unload)
-: _delayed([=] { check(unload); })
-, _limit(limit) {
+MediaActiveCache<Type>::MediaActiveCache(MediaCacheTier tier, Unload &&unload)
+: MediaActiveCacheBase(tier)
+, _delayed([=] { check(unload); }) {
 }
 
 template <typename Type>
 void MediaActiveCache<Type>::up(Type *entry) {
-	_cache.up(entry);
-	_delayed.call();
+	if (_last != entry) {
+		// Repeated paints of the same entry don't change the order.
+		_last = entry;
+		_cache.up(entry);
+	}
+	if (_stats.usage > _stats.limit) {
+		_delayed.call();
+	}
 }
 
 template <typename Type>
 void MediaActiveCache<Type>::remove(Type *entry) {
+	if (_last == entry) {
+		_last = nullptr;
+	}
 	_cache.remove(entry);
 }
 
 template <typename Type>
 void MediaActiveCache<Type>::clear() {
+	_last = nullptr;
 	_cache.clear();
 }
 
 template <typename Type>
-void MediaActiveCache<Type>::increment(int64 amount) {
-	_usage += amount;
-}
-
-template <typename Type>
-void MediaActiveCache<Type>::decrement(int64 amount) {
-	_usage -= amount;
+void MediaActiveCache<Type>::limitChanged() {
+	if (_stats.usage > _stats.limit) {
+		_delayed.call();
+	}
 }
 
 template <typename Type>
 template <typename Unload>
 void MediaActiveCache<Type>::check(Unload &&unload) {
-	while (_usage > _limit) {
+	while (_stats.usage > _stats.limit) {
 		if (const auto entry = _cache.take_lowest()) {
+			if (_last == entry) {
+				_last = nullptr;
+			}
+			const auto was = _stats.usage;
 			unload(entry);
+			++_stats.evictions;
+			_stats.evictedBytes += (was - _stats.usage);
 		} else {
 			break;
 		}
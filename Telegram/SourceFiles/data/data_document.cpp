@@ -42,15 +42,13 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 
 namespace {
 
-// Updated Mar 3, 2020: Increase the size of the memory cache for media, to prevent items still being displayed from being unloaded.
-constexpr auto kMemoryForCache = 128 * 1024 * 1024; // was 32, updated to 128
 const auto kAnimatedStickerDimensions = QSize(512, 512);
 
 using FilePathResolve = DocumentData::FilePathResolve;
 
 Core::MediaActiveCache<DocumentData> &ActiveCache() {
 	static auto Instance = Core::MediaActiveCache<DocumentData>(
-		kMemoryForCache,
+		Core::MediaCacheTier::Encoded,
 		[](DocumentData *document) { document->unload(); });
 	return Instance;
 }
@@ -642,6 +640,10 @@ Storage::Cache::Key DocumentData::goodThumbnailCacheKey() const {
 	return Data::DocumentThumbCacheKey(_dc, id);
 }
 
+Storage::Cache::Key DocumentData::waveformCacheKey() const {
+	return Data::DocumentWaveformCacheKey(_dc, id);
+}
+
 Image *DocumentData::goodThumbnail() const {
 	return _goodThumbnail.get();
 }
@@ -802,6 +804,7 @@ bool DocumentData::loaded(FilePathResolve resolve) const {
 			destroyLoader();
 
 			if (!that->_data.isEmpty() || that->getStickerLarge()) {
+				ActiveCache().miss();
 				ActiveCache().up(that);
 			}
 		}
@@ -1070,6 +1073,7 @@ QByteArray documentWaveformEncode5bit(const VoiceWaveform &waveform) {
 
 QByteArray DocumentData::data() const {
 	if (!_data.isEmpty()) {
+		ActiveCache().hit();
 		ActiveCache().up(const_cast<DocumentData*>(this));
 	}
 	return _data;
@@ -1209,6 +1213,7 @@ void DocumentData::checkStickerLarge() {
 		}
 		if (const auto usage = ComputeUsage(data)) {
 			ActiveCache().increment(usage);
+			ActiveCache().miss();
 			ActiveCache().up(this);
 		}
 	}
@@ -0,0 +1,96 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "data/data_history_cache.h"
+
+#include "data/data_session.h"
+#include "data/data_peer.h"
+#include "history/history.h"
+#include "storage/cache/storage_cache_database.h"
+
+namespace Data {
+namespace {
+
+constexpr auto kVersion = mtpPrime(1);
+
+[[nodiscard]] QByteArray Serialize(const MTPmessages_Messages &slice) {
+	auto buffer = mtpBuffer();
+	buffer.push_back(kVersion);
+	slice.write(buffer);
+	return QByteArray(
+		reinterpret_cast<const char*>(buffer.constData()),
+		buffer.size() * sizeof(mtpPrime));
+}
+
+[[nodiscard]] std::optional<MTPmessages_Messages> Deserialize(
+		const QByteArray &value) {
+	if (value.isEmpty() || (value.size() % sizeof(mtpPrime))) {
+		return std::nullopt;
+	}
+	auto from = reinterpret_cast<const mtpPrime*>(value.constData());
+	const auto end = from + (value.size() / sizeof(mtpPrime));
+	if (*from++ != kVersion) {
+		return std::nullopt;
+	}
+	auto result = MTPmessages_Messages();
+	if (!result.read(from, end) || from != end) {
+		return std::nullopt;
+	}
+	return result;
+}
+
+} // namespace
+
+HistoryCache::HistoryCache(not_null<Session*> owner) : _owner(owner) {
+}
+
+void HistoryCache::save(
+		not_null<History*> history,
+		const MTPmessages_Messages &slice) {
+	if (slice.type() == mtpc_messages_messagesNotModified) {
+		return;
+	}
+	_owner->cache().put(
+		HistoryCacheKey(history->peer->id),
+		Storage::Cache::Database::TaggedValue(
+			Serialize(slice),
+			kHistoryCacheTag));
+}
+
+void HistoryCache::load(
+		not_null<History*> history,
+		FnMut<void(MTPmessages_Messages&&)> done) {
+	const auto peerId = history->peer->id;
+	auto callback = [
+		=,
+		weak = base::make_weak(this),
+		done = std::move(done)
+	](QByteArray &&value) mutable {
+		// Parse in the cache thread, the main thread only applies the data.
+		auto slice = Deserialize(value);
+		if (!slice) {
+			if (!value.isEmpty()) {
+				LOG(("History Cache Error: Bad slice for peer %1."
+					).arg(peerId));
+			}
+			return;
+		}
+		crl::on_main(weak, [
+			done = std::move(done),
+			slice = std::move(*slice)
+		]() mutable {
+			done(std::move(slice));
+		});
+	};
+	_owner->cache().get(HistoryCacheKey(peerId), std::move(callback));
+}
+
+void HistoryCache::remove(not_null<History*> history) {
+	_owner->cache().remove(HistoryCacheKey(history->peer->id));
+}
+
+} // namespace Data
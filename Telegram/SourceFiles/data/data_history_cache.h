@@ -0,0 +1,41 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+#include "base/weak_ptr.h"
+
+class History;
+
+namespace Data {
+
+class Session;
+
+// Keeps the newest slice of each opened history in the encrypted local
+// cache, so that it can be shown before the server answers after restart.
+class HistoryCache final : public base::has_weak_ptr {
+public:
+	explicit HistoryCache(not_null<Session*> owner);
+
+	// The slice must be the result of messages.getHistory from the end.
+	void save(
+		not_null<History*> history,
+		const MTPmessages_Messages &slice);
+
+	// Calls done in the main thread only if a valid slice was found.
+	void load(
+		not_null<History*> history,
+		FnMut<void(MTPmessages_Messages&&)> done);
+
+	void remove(not_null<History*> history);
+
+private:
+	const not_null<Session*> _owner;
+
+};
+
+} // namespace Data
@@ -9,6 +9,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 
 #include "mainwidget.h"
 #include "main/main_session.h"
+#include "data/data_session.h"
 #include "apiwrap.h"
 #include "app.h"
 
@@ -54,12 +55,14 @@ void PtsWaiter::applySkippedUpdates(ChannelData *channel) {
 	if (_queue.isEmpty()) return;
 
 	++_applySkippedLevel;
+	Auth().data().startUpdatesBatch();
 	for (auto i = _queue.cbegin(), e = _queue.cend(); i != e; ++i) {
 		switch (i.value()) {
 		case SkippedUpdate: Auth().api().applyUpdateNoPtsCheck(_updateQueue.value(i.key())); break;
 		case SkippedUpdates: Auth().api().applyUpdatesNoPtsCheck(_updatesQueue.value(i.key())); break;
 		}
 	}
+	Auth().data().finishUpdatesBatch();
 	--_applySkippedLevel;
 	clearSkippedUpdates();
 }
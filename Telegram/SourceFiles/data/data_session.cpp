@@ -52,6 +52,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "data/data_streaming.h"
 #include "data/data_media_rotation.h"
 #include "data/data_histories.h"
+#include "data/data_history_cache.h"
 #include "dh/dh_encryptionkey_exchanger.h"
 #include "base/platform/base_platform_info.h"
 #include "base/unixtime.h"
@@ -181,6 +182,15 @@ rpl::producer<int> PinnedDialogsCountMaxValue(
 	});
 }
 
+// Batched updates are collected with duplicates and deduplicated once.
+template <typename Type>
+[[nodiscard]] std::vector<Type> TakeUnique(std::vector<Type> &list) {
+	auto result = base::take(list);
+	ranges::sort(result);
+	result.erase(ranges::unique(result), end(result));
+	return result;
+}
+
 } // namespace
 
 Session::Session(not_null<Main::Session*> session)
@@ -204,7 +214,8 @@ Session::Session(not_null<Main::Session*> session)
 , _cloudThemes(std::make_unique<CloudThemes>(session))
 , _streaming(std::make_unique<Streaming>(this))
 , _mediaRotation(std::make_unique<MediaRotation>())
-, _histories(std::make_unique<Histories>(this)) {
+, _histories(std::make_unique<Histories>(this))
+, _historyCache(std::make_unique<HistoryCache>(this)) {
 	_cache->open(Local::cacheKey());
 	_bigFileCache->open(Local::cacheBigFileKey());
 
@@ -1130,6 +1141,10 @@ void Session::markMediaRead(not_null<const DocumentData*> document) {
 }
 
 void Session::notifyItemLayoutChange(not_null<const HistoryItem*> item) {
+	if (_updatesBatchLevel > 0) {
+		_batchedItemLayoutChanges.push_back(item);
+		return;
+	}
 	_itemLayoutChanges.fire_copy(item);
 	enumerateItemViews(item, [&](not_null<ViewElement*> view) {
 		notifyViewLayoutChange(view);
@@ -1141,6 +1156,10 @@ rpl::producer<not_null<const HistoryItem*>> Session::itemLayoutChanged() const {
 }
 
 void Session::notifyViewLayoutChange(not_null<const ViewElement*> view) {
+	if (_updatesBatchLevel > 0) {
+		_batchedViewLayoutChanges.push_back(view);
+		return;
+	}
 	_viewLayoutChanges.fire_copy(view);
 }
 
@@ -1190,6 +1209,10 @@ rpl::producer<Session::IdChange> Session::itemIdChanged() const {
 }
 
 void Session::requestItemRepaint(not_null<const HistoryItem*> item) {
+	if (_updatesBatchLevel > 0) {
+		_batchedItemRepaints.push_back(item);
+		return;
+	}
 	_itemRepaintRequest.fire_copy(item);
 	enumerateItemViews(item, [&](not_null<const ViewElement*> view) {
 		requestViewRepaint(view);
@@ -1201,6 +1224,10 @@ rpl::producer<not_null<const HistoryItem*>> Session::itemRepaintRequest() const
 }
 
 void Session::requestViewRepaint(not_null<const ViewElement*> view) {
+	if (_updatesBatchLevel > 0) {
+		_batchedViewRepaints.push_back(view);
+		return;
+	}
 	_viewRepaintRequest.fire_copy(view);
 }
 
@@ -1209,6 +1236,10 @@ rpl::producer<not_null<const ViewElement*>> Session::viewRepaintRequest() const
 }
 
 void Session::requestItemResize(not_null<const HistoryItem*> item) {
+	if (_updatesBatchLevel > 0) {
+		_batchedItemResizes.push_back(item);
+		return;
+	}
 	_itemResizeRequest.fire_copy(item);
 	enumerateItemViews(item, [&](not_null<ViewElement*> view) {
 		requestViewResize(view);
@@ -1221,6 +1252,10 @@ rpl::producer<not_null<const HistoryItem*>> Session::itemResizeRequest() const {
 
 void Session::requestViewResize(not_null<ViewElement*> view) {
 	view->setPendingResize();
+	if (_updatesBatchLevel > 0) {
+		_batchedViewResizes.push_back(view);
+		return;
+	}
 	_viewResizeRequest.fire_copy(view);
 	notifyViewLayoutChange(view);
 }
@@ -1305,11 +1340,71 @@ rpl::producer<not_null<History*>> Session::historyChanged() const {
 }
 
 void Session::sendHistoryChangeNotifications() {
+	if (_updatesBatchLevel > 0) {
+		return;
+	}
 	for (const auto history : base::take(_historiesChanged)) {
 		_historyChanged.fire_copy(history);
 	}
 }
 
+void Session::startUpdatesBatch() {
+	++_updatesBatchLevel;
+}
+
+void Session::finishUpdatesBatch() {
+	Expects(_updatesBatchLevel > 0);
+
+	if (--_updatesBatchLevel > 0) {
+		return;
+	}
+	for (const auto item : TakeUnique(_batchedItemResizes)) {
+		_itemResizeRequest.fire_copy(item);
+		enumerateItemViews(item, [&](not_null<ViewElement*> view) {
+			_batchedViewResizes.push_back(view);
+		});
+	}
+	for (const auto item : TakeUnique(_batchedItemRepaints)) {
+		_itemRepaintRequest.fire_copy(item);
+		enumerateItemViews(item, [&](not_null<const ViewElement*> view) {
+			_batchedViewRepaints.push_back(view);
+		});
+	}
+	for (const auto item : TakeUnique(_batchedItemLayoutChanges)) {
+		_itemLayoutChanges.fire_copy(item);
+		enumerateItemViews(item, [&](not_null<const ViewElement*> view) {
+			_batchedViewLayoutChanges.push_back(view);
+		});
+	}
+	const auto resized = TakeUnique(_batchedViewResizes);
+	for (const auto view : resized) {
+		view->setPendingResize();
+		if (view->data()->mainView() == view) {
+			// The history widget relayouts all pending items at once.
+			notifyHistoryChangeDelayed(view->data()->history());
+		} else {
+			_viewResizeRequest.fire_copy(view);
+		}
+		_batchedViewLayoutChanges.push_back(view);
+	}
+	const auto wasResized = [&](not_null<const ViewElement*> view) {
+		return ranges::binary_search(
+			resized,
+			view.get(),
+			std::less<>(),
+			[](not_null<ViewElement*> entry) { return entry.get(); });
+	};
+	for (const auto view : TakeUnique(_batchedViewRepaints)) {
+		if (!wasResized(view)) {
+			_viewRepaintRequest.fire_copy(view);
+		}
+	}
+	for (const auto view : TakeUnique(_batchedViewLayoutChanges)) {
+		_viewLayoutChanges.fire_copy(view);
+	}
+	sendHistoryChangeNotifications();
+}
+
 void Session::registerHeavyViewPart(not_null<ViewElement*> view) {
 	_heavyViewParts.emplace(view);
 }
@@ -1788,6 +1883,16 @@ void Session::removeDependencyMessage(not_null<HistoryItem*> item) {
 
 void Session::unregisterMessage(not_null<HistoryItem*> item) {
 	const auto peerId = item->history()->peer->id;
+	if (_updatesBatchLevel > 0) {
+		const auto removed = not_null<const HistoryItem*>(item);
+		for (const auto list : {
+			&_batchedItemRepaints,
+			&_batchedItemResizes,
+			&_batchedItemLayoutChanges,
+		}) {
+			list->erase(ranges::remove(*list, removed), end(*list));
+		}
+	}
 	_itemRemoved.fire_copy(item);
 	groups().unregisterMessage(item);
 	removeDependencyMessage(item);
@@ -3282,6 +3387,18 @@ void Session::registerItemView(not_null<ViewElement*> view) {
 }
 
 void Session::unregisterItemView(not_null<ViewElement*> view) {
+	if (_updatesBatchLevel > 0) {
+		const auto removed = not_null<const ViewElement*>(view);
+		for (const auto list : {
+			&_batchedViewRepaints,
+			&_batchedViewLayoutChanges,
+		}) {
+			list->erase(ranges::remove(*list, removed), end(*list));
+		}
+		_batchedViewResizes.erase(
+			ranges::remove(_batchedViewResizes, view),
+			end(_batchedViewResizes));
+	}
 	const auto i = _views.find(view->data());
 	if (i != end(_views)) {
 		auto &list = i->second;
@@ -62,6 +62,7 @@ class CloudThemes;
 class Streaming;
 class MediaRotation;
 class Histories;
+class HistoryCache;
 
 class Session final {
 public:
@@ -100,6 +101,9 @@ public:
 	[[nodiscard]] Histories &histories() const {
 		return *_histories;
 	}
+	[[nodiscard]] HistoryCache &historyCache() const {
+		return *_historyCache;
+	}
 	[[nodiscard]] MsgId nextNonHistoryEntryId() {
 		return ++_nonHistoryEntryId;
 	}
@@ -231,6 +235,12 @@ public:
 	[[nodiscard]] rpl::producer<not_null<History*>> historyChanged() const;
 	void sendHistoryChangeNotifications();
 
+	// While applying a large pack of updates (like getDifference) view
+	// repaint, resize and layout change requests are accumulated and
+	// sent once per item, main view resizes once per history.
+	void startUpdatesBatch();
+	void finishUpdatesBatch();
+
 	void registerHeavyViewPart(not_null<ViewElement*> view);
 	void unregisterHeavyViewPart(not_null<ViewElement*> view);
 	void unloadHeavyViewParts(
@@ -851,6 +861,13 @@ private:
 	rpl::event_stream<not_null<const History*>> _historyUnloaded;
 	rpl::event_stream<not_null<const History*>> _historyCleared;
 	base::flat_set<not_null<History*>> _historiesChanged;
+	int _updatesBatchLevel = 0;
+	std::vector<not_null<const HistoryItem*>> _batchedItemRepaints;
+	std::vector<not_null<const HistoryItem*>> _batchedItemResizes;
+	std::vector<not_null<const HistoryItem*>> _batchedItemLayoutChanges;
+	std::vector<not_null<const ViewElement*>> _batchedViewRepaints;
+	std::vector<not_null<ViewElement*>> _batchedViewResizes;
+	std::vector<not_null<const ViewElement*>> _batchedViewLayoutChanges;
 	rpl::event_stream<not_null<History*>> _historyChanged;
 	rpl::event_stream<MegagroupParticipant> _megagroupParticipantRemoved;
 	rpl::event_stream<MegagroupParticipant> _megagroupParticipantAdded;
@@ -983,6 +1000,7 @@ private:
 	std::unique_ptr<Streaming> _streaming;
 	std::unique_ptr<MediaRotation> _mediaRotation;
 	std::unique_ptr<Histories> _histories;
+	std::unique_ptr<HistoryCache> _historyCache;
 	MsgId _nonHistoryEntryId = ServerMaxMsgId;
 
 	rpl::lifetime _lifetime;
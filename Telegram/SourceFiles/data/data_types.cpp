@@ -23,6 +23,8 @@ constexpr auto kDocumentCacheTag = 0x0000000000000100ULL;
 constexpr auto kDocumentCacheMask = 0x00000000000000FFULL;
 constexpr auto kDocumentThumbCacheTag = 0x0000000000000200ULL;
 constexpr auto kDocumentThumbCacheMask = 0x00000000000000FFULL;
+constexpr auto kDocumentWaveformCacheTag = 0x0000000000000300ULL;
+constexpr auto kDocumentWaveformCacheMask = 0x00000000000000FFULL;
 constexpr auto kStorageCacheTag = 0x0000010000000000ULL;
 constexpr auto kStorageCacheMask = 0x000000FFFFFFFFFFULL;
 constexpr auto kWebDocumentCacheTag = 0x0000020000000000ULL;
@@ -31,6 +33,7 @@ constexpr auto kUrlCacheTag = 0x0000030000000000ULL;
 constexpr auto kUrlCacheMask = 0x000000FFFFFFFFFFULL;
 constexpr auto kGeoPointCacheTag = 0x0000040000000000ULL;
 constexpr auto kGeoPointCacheMask = 0x000000FFFFFFFFFFULL;
+constexpr auto kHistorySliceCacheTag = 0x0000050000000000ULL;
 
 } // namespace
 
@@ -63,6 +66,14 @@ Storage::Cache::Key DocumentThumbCacheKey(int32 dcId, uint64 id) {
 	};
 }
 
+Storage::Cache::Key DocumentWaveformCacheKey(int32 dcId, uint64 id) {
+	const auto part = (uint64(dcId) & Data::kDocumentWaveformCacheMask);
+	return Storage::Cache::Key{
+		Data::kDocumentWaveformCacheTag | part,
+		id
+	};
+}
+
 Storage::Cache::Key WebDocumentCacheKey(const WebFileLocation &location) {
 	const auto CacheDcId = cTestMode() ? 2 : 4;
 	const auto dcId = uint64(CacheDcId) & 0xFFULL;
@@ -109,6 +120,13 @@ Storage::Cache::Key GeoPointCacheKey(const GeoPointLocation &location) {
 	};
 }
 
+Storage::Cache::Key HistoryCacheKey(PeerId peerId) {
+	return Storage::Cache::Key{
+		Data::kHistorySliceCacheTag,
+		uint64(peerId)
+	};
+}
+
 ReplyPreview::ReplyPreview() = default;
 
 ReplyPreview::ReplyPreview(ReplyPreview &&other) = default;
@@ -44,6 +44,7 @@ struct UploadState {
 
 Storage::Cache::Key DocumentCacheKey(int32 dcId, uint64 id);
 Storage::Cache::Key DocumentThumbCacheKey(int32 dcId, uint64 id);
+Storage::Cache::Key DocumentWaveformCacheKey(int32 dcId, uint64 id);
 Storage::Cache::Key WebDocumentCacheKey(const WebFileLocation &location);
 Storage::Cache::Key UrlCacheKey(const QString &location);
 Storage::Cache::Key GeoPointCacheKey(const GeoPointLocation &location);
@@ -53,6 +54,7 @@ constexpr auto kStickerCacheTag = uint8(0x02);
 constexpr auto kVoiceMessageCacheTag = uint8(0x03);
 constexpr auto kVideoMessageCacheTag = uint8(0x04);
 constexpr auto kAnimationCacheTag = uint8(0x05);
+constexpr auto kHistoryCacheTag = uint8(0x06);
 
 struct FileOrigin;
 
@@ -200,6 +202,12 @@ inline MTPpeer peerToMTP(const PeerId &id) {
 	return MTP_peerUser(MTP_int(0));
 }
 
+namespace Data {
+
+Storage::Cache::Key HistoryCacheKey(PeerId peerId);
+
+} // namespace Data
+
 using MsgId = int32;
 constexpr auto StartClientMsgId = MsgId(-0x7FFFFFFF);
 constexpr auto EndClientMsgId = MsgId(-0x40000000);
@@ -23,6 +23,7 @@ RowsByLetter IndexedList::addToEnd(Key key) {
 	RowsByLetter result;
 	if (!_list.contains(key)) {
 		result.emplace(0, _list.addToEnd(key));
+		indexNameWords(key);
 		for (const auto ch : key.entry()->chatListFirstLetters()) {
 			auto j = _index.find(ch);
 			if (j == _index.cend()) {
@@ -40,6 +41,7 @@ Row *IndexedList::addByName(Key key) {
 	}
 
 	const auto result = _list.addByName(key);
+	indexNameWords(key);
 	for (const auto ch : key.entry()->chatListFirstLetters()) {
 		auto j = _index.find(ch);
 		if (j == _index.cend()) {
@@ -119,6 +121,9 @@ void IndexedList::adjustByName(
 	const auto mainRow = _list.adjustByName(key);
 	if (!mainRow) return;
 
+	unindexNameWords(key);
+	indexNameWords(key);
+
 	auto toRemove = oldLetters;
 	auto toAdd = base::flat_set<QChar>();
 	for (const auto ch : key.entry()->chatListFirstLetters()) {
@@ -156,6 +161,9 @@ void IndexedList::adjustNames(
 	auto mainRow = _list.getRow(key);
 	if (!mainRow) return;
 
+	unindexNameWords(key);
+	indexNameWords(key);
+
 	auto toRemove = oldLetters;
 	auto toAdd = base::flat_set<QChar>();
 	for (const auto ch : key.entry()->chatListFirstLetters()) {
@@ -188,6 +196,7 @@ void IndexedList::adjustNames(
 
 void IndexedList::del(Key key, Row *replacedBy) {
 	if (_list.del(key, replacedBy)) {
+		unindexNameWords(key);
 		for (const auto ch : key.entry()->chatListFirstLetters()) {
 			if (auto it = _index.find(ch); it != _index.cend()) {
 				it->second.del(key, replacedBy);
@@ -198,35 +207,77 @@ void IndexedList::del(Key key, Row *replacedBy) {
 
 void IndexedList::clear() {
 	_index.clear();
+	_keysByNameWord.clear();
+	_nameWordsByKey.clear();
+}
+
+void IndexedList::indexNameWords(Key key) {
+	const auto &words = key.entry()->chatListNameWords();
+	if (words.empty()) {
+		return;
+	}
+	_nameWordsByKey.emplace(key, words);
+	for (const auto &word : words) {
+		_keysByNameWord[word].emplace(key);
+	}
+}
+
+void IndexedList::unindexNameWords(Key key) {
+	const auto i = _nameWordsByKey.find(key);
+	if (i == end(_nameWordsByKey)) {
+		return;
+	}
+	for (const auto &word : i->second) {
+		const auto j = _keysByNameWord.find(word);
+		if (j != end(_keysByNameWord)) {
+			j->second.remove(key);
+			if (j->second.empty()) {
+				_keysByNameWord.erase(j);
+			}
+		}
+	}
+	_nameWordsByKey.erase(i);
 }
 
 std::vector<not_null<Row*>> IndexedList::filtered(
 		const QStringList &words) const {
-	const auto minimal = [&]() -> const Dialogs::List* {
-		if (empty()) {
-			return nullptr;
+	auto result = std::vector<not_null<Row*>>();
+	auto first = QString();
+	auto longest = QString();
+	for (const auto &word : words) {
+		if (word.isEmpty()) {
+			continue;
+		} else if (first.isEmpty()) {
+			first = word;
 		}
-		auto result = (const Dialogs::List*)nullptr;
-		for (const auto &word : words) {
-			if (word.isEmpty()) {
-				continue;
-			}
-			const auto found = filtered(word[0]);
-			if (!found || found->empty()) {
-				return nullptr;
-			} else if (!result || result->size() > found->size()) {
-				result = found;
-			}
+		if (word.size() > longest.size()) {
+			longest = word;
 		}
+	}
+	if (empty() || first.isEmpty()) {
 		return result;
-	}();
-	auto result = std::vector<not_null<Row*>>();
-	if (!minimal || minimal->empty()) {
+	}
+
+	// All the results have a name word starting with the first word, so
+	// they all are in its letter list, return rows in its order.
+	const auto letterList = filtered(first[0]);
+	if (!letterList || letterList->empty()) {
 		return result;
 	}
-	result.reserve(minimal->size());
-	for (const auto row : *minimal) {
-		const auto &nameWords = row->entry()->chatListNameWords();
+
+	// Take all the entries with a name word starting with the longest
+	// word and check the other words only for them.
+	auto candidates = std::vector<Key>();
+	for (auto i = _keysByNameWord.lower_bound(longest)
+		; i != end(_keysByNameWord) && i->first.startsWith(longest)
+		; ++i) {
+		candidates.insert(end(candidates), begin(i->second), end(i->second));
+	}
+	ranges::sort(candidates);
+	candidates.erase(ranges::unique(candidates), end(candidates));
+	result.reserve(candidates.size());
+	for (const auto key : candidates) {
+		const auto &nameWords = key.entry()->chatListNameWords();
 		const auto found = [&](const QString &word) {
 			for (const auto &name : nameWords) {
 				if (name.startsWith(word)) {
@@ -243,10 +294,15 @@ std::vector<not_null<Row*>> IndexedList::filtered(
 			}
 			return true;
 		}();
-		if (allFound) {
+		if (!allFound) {
+			continue;
+		} else if (const auto row = letterList->getRow(key)) {
 			result.push_back(row);
 		}
 	}
+	ranges::sort(result, ranges::less(), [](not_null<Row*> row) {
+		return row->pos();
+	});
 	return result;
 }
 
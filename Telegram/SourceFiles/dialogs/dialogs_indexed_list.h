@@ -82,10 +82,19 @@ private:
 		not_null<History*> history,
 		const base::flat_set<QChar> &oldChars);
 
+	void indexNameWords(Key key);
+	void unindexNameWords(Key key);
+
 	SortMode _sortMode = SortMode();
 	List _list, _empty;
 	base::flat_map<QChar, List> _index;
 
+	// Sorted name words of all entries, so that all the words starting
+	// with some prefix can be found by a binary search. Plain std::map
+	// is used, because the lists may contain tens of thousands of rows.
+	std::map<QString, base::flat_set<Key>> _keysByNameWord;
+	std::map<Key, base::flat_set<QString>> _nameWordsByKey;
+
 };
 
 } // namespace Dialogs
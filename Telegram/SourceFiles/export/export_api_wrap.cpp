@@ -7,6 +7,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 */
 #include "export/export_api_wrap.h"
 
+#include "export/export_checkpoint.h"
 #include "export/export_settings.h"
 #include "export/data/export_data_types.h"
 #include "export/output/export_output_result.h"
@@ -92,6 +93,22 @@ LocationKey ComputeLocationKey(const Data::FileLocation &value) {
 	return result;
 }
 
+Checkpoint::FileKey ComputeCheckpointKey(const Data::FileLocation &value) {
+	const auto key = ComputeLocationKey(value);
+	return { key.type, key.id };
+}
+
+std::optional<Checkpoint::LoadedFile> FindCheckpointFile(
+		const Checkpoint &checkpoint,
+		const Data::File &file) {
+	if (!file.location || !file.content.isEmpty()) {
+		return std::nullopt;
+	}
+	return checkpoint.findFile(
+		ComputeCheckpointKey(file.location),
+		file.size);
+}
+
 Settings::Type SettingsFromDialogsType(Data::DialogInfo::Type type) {
 	using DialogType = Data::DialogInfo::Type;
 	switch (type) {
@@ -174,6 +191,7 @@ struct ApiWrap::OtherDataProcess {
 struct ApiWrap::FileProcess {
 	FileProcess(const QString &path, Output::Stats *stats);
 
+	uint64 id = 0;
 	Output::File file;
 	QString relativePath;
 
@@ -193,6 +211,7 @@ struct ApiWrap::FileProcess {
 };
 
 struct ApiWrap::FileProgress {
+	QString path;
 	int ready = 0;
 	int total = 0;
 };
@@ -231,11 +250,17 @@ struct ApiWrap::ChatProcess {
 
 	int localSplitIndex = 0;
 	int32 largestIdPlusOne = 1;
+	mtpRequestId requestId = 0;
 
 	Data::ParseMediaContext context;
 	std::optional<Data::MessagesSlice> slice;
+	std::optional<Data::MessagesSlice> nextSlice;
+	int sliceSplitIndex = 0;
+	int nextSliceSplitIndex = 0;
 	bool lastSlice = false;
 	int fileIndex = 0;
+	bool thumbNext = false;
+	int filesLoading = 0;
 };
 
 
@@ -377,7 +402,10 @@ auto ApiWrap::splitRequest(int index, Request &&request) {
 		std::forward<Request>(request)));
 }
 
-auto ApiWrap::fileRequest(const Data::FileLocation &location, int offset) {
+auto ApiWrap::fileRequest(
+		uint64 processId,
+		const Data::FileLocation &location,
+		int offset) {
 	Expects(location.dcId != 0
 		|| location.data.type() == mtpc_inputTakeoutFileLocation);
 	Expects(_takeoutId.has_value());
@@ -393,6 +421,7 @@ auto ApiWrap::fileRequest(const Data::FileLocation &location, int offset) {
 		if (result.type() == qstr("TAKEOUT_FILE_EMPTY")
 			&& _otherDataProcess != nullptr) {
 			filePartDone(
+				processId,
 				0,
 				MTP_upload_file(
 					MTP_storage_filePartial(),
@@ -400,10 +429,10 @@ auto ApiWrap::fileRequest(const Data::FileLocation &location, int offset) {
 					MTP_bytes()));
 		} else if (result.type() == qstr("LOCATION_INVALID")
 			|| result.type() == qstr("VERSION_INVALID")) {
-			filePartUnavailable();
+			filePartUnavailable(processId);
 		} else if (result.code() == 400
 			&& result.type().startsWith(qstr("FILE_REFERENCE_"))) {
-			filePartRefreshReference(offset);
+			filePartRefreshReference(processId, offset);
 		} else {
 			error(std::move(result));
 		}
@@ -431,6 +460,7 @@ void ApiWrap::startExport(
 	Expects(_startProcess == nullptr);
 
 	_settings = std::make_unique<Settings>(settings);
+	_checkpoint = std::make_unique<Checkpoint>(settings);
 	_stats = stats;
 	_startProcess = std::make_unique<StartProcess>();
 	_startProcess->done = std::move(done);
@@ -823,7 +853,6 @@ void ApiWrap::finishUserpicsSlice() {
 }
 
 bool ApiWrap::loadUserpicProgress(FileProgress progress) {
-	Expects(_fileProcess != nullptr);
 	Expects(_userpicsProcess != nullptr);
 	Expects(_userpicsProcess->slice.has_value());
 	Expects((_userpicsProcess->fileIndex >= 0)
@@ -831,7 +860,7 @@ bool ApiWrap::loadUserpicProgress(FileProgress progress) {
 			< _userpicsProcess->slice->list.size()));
 
 	return _userpicsProcess->fileProgress(DownloadProgress{
-		_fileProcess->relativePath,
+		progress.path,
 		_userpicsProcess->fileIndex,
 		progress.ready,
 		progress.total });
@@ -1034,7 +1063,10 @@ void ApiWrap::finishExport(FnMut<void()> done) {
 
 	mainRequest(MTPaccount_FinishTakeoutSession(
 		MTP_flags(MTPaccount_FinishTakeoutSession::Flag::f_success)
-	)).done(std::move(done)).send();
+	)).done([=, done = std::move(done)]() mutable {
+		_checkpoint->finish();
+		done();
+	}).send();
 }
 
 void ApiWrap::cancelExportFast() {
@@ -1280,15 +1312,17 @@ void ApiWrap::appendChatsSlice(
 
 void ApiWrap::requestMessagesSlice() {
 	Expects(_chatProcess != nullptr);
+	Expects(_chatProcess->requestId == 0);
 
+	const auto localSplitIndex = _chatProcess->localSplitIndex;
 	const auto count = _chatProcess->info.messagesCountPerSplit[
-		_chatProcess->localSplitIndex];
+		localSplitIndex];
 	if (!count) {
-		loadMessagesFiles({});
+		messagesSliceLoaded(localSplitIndex, {});
 		return;
 	}
 	requestChatMessages(
-		_chatProcess->info.splits[_chatProcess->localSplitIndex],
+		_chatProcess->info.splits[localSplitIndex],
 		_chatProcess->largestIdPlusOne,
 		-kMessagesSliceLimit,
 		kMessagesSliceLimit,
@@ -1301,7 +1335,7 @@ void ApiWrap::requestMessagesSlice() {
 			if constexpr (MTPDmessages_messages::Is<decltype(data)>()) {
 				_chatProcess->lastSlice = true;
 			}
-			loadMessagesFiles(Data::ParseMessagesSlice(
+			messagesSliceLoaded(localSplitIndex, Data::ParseMessagesSlice(
 				_chatProcess->context,
 				data.vmessages(),
 				data.vusers(),
@@ -1323,10 +1357,11 @@ void ApiWrap::requestChatMessages(
 	const auto doneHandler = [=](MTPmessages_Messages &&result) {
 		Expects(_chatProcess != nullptr);
 
+		_chatProcess->requestId = 0;
 		base::take(_chatProcess->requestDone)(std::move(result));
 	};
 	if (_chatProcess->info.onlyMyMessages) {
-		splitRequest(splitIndex, MTPmessages_Search(
+		_chatProcess->requestId = splitRequest(splitIndex, MTPmessages_Search(
 			MTP_flags(MTPmessages_Search::Flag::f_from_id),
 			_chatProcess->info.input,
 			MTP_string(), // query
@@ -1342,7 +1377,7 @@ void ApiWrap::requestChatMessages(
 			MTP_int(0) // hash
 		)).done(doneHandler).send();
 	} else {
-		splitRequest(splitIndex, MTPmessages_GetHistory(
+		_chatProcess->requestId = splitRequest(splitIndex, MTPmessages_GetHistory(
 			_chatProcess->info.input,
 			MTP_int(offsetId),
 			MTP_int(0), // offset_date
@@ -1375,34 +1410,63 @@ void ApiWrap::requestChatMessages(
 	}
 }
 
-void ApiWrap::loadMessagesFiles(Data::MessagesSlice &&slice) {
+void ApiWrap::messagesSliceLoaded(
+		int localSplitIndex,
+		Data::MessagesSlice &&slice) {
 	Expects(_chatProcess != nullptr);
-	Expects(!_chatProcess->slice.has_value());
+	Expects(!_chatProcess->nextSlice.has_value());
 
 	if (slice.list.empty()) {
 		_chatProcess->lastSlice = true;
 	}
-	_chatProcess->slice = std::move(slice);
-	_chatProcess->fileIndex = 0;
-
-	loadNextMessageFile();
+	if (_chatProcess->slice.has_value()) {
+		// Files of the previous slice are still loading.
+		_chatProcess->nextSlice = std::move(slice);
+		_chatProcess->nextSliceSplitIndex = localSplitIndex;
+	} else {
+		loadMessagesFiles(localSplitIndex, std::move(slice));
+	}
 }
 
-Data::Message *ApiWrap::currentFileMessage() const {
+void ApiWrap::loadMessagesFiles(
+		int localSplitIndex,
+		Data::MessagesSlice &&slice) {
 	Expects(_chatProcess != nullptr);
-	Expects(_chatProcess->slice.has_value());
+	Expects(!_chatProcess->slice.has_value());
+	Expects(localSplitIndex < _chatProcess->info.splits.size());
 
-	return &_chatProcess->slice->list[_chatProcess->fileIndex];
+	// localSplitIndex is the split of this slice, while
+	// _chatProcess->localSplitIndex is the split of the next request.
+
+	if (!slice.list.empty()) {
+		_chatProcess->largestIdPlusOne = slice.list.back().id + 1;
+	}
+	if (_chatProcess->lastSlice
+		&& (++_chatProcess->localSplitIndex
+			< _chatProcess->info.splits.size())) {
+		_chatProcess->lastSlice = false;
+		_chatProcess->largestIdPlusOne = 1;
+	}
+	_chatProcess->slice = std::move(slice);
+	_chatProcess->sliceSplitIndex = localSplitIndex;
+	_chatProcess->fileIndex = 0;
+	_chatProcess->thumbNext = false;
+
+	// Request the next slice while the files of this one are loading.
+	if (!_chatProcess->lastSlice) {
+		requestMessagesSlice();
+	}
+	loadNextMessageFile();
 }
 
-Data::FileOrigin ApiWrap::currentFileMessageOrigin() const {
+Data::FileOrigin ApiWrap::fileMessageOrigin(int index) const {
 	Expects(_chatProcess != nullptr);
 	Expects(_chatProcess->slice.has_value());
 
 	auto result = Data::FileOrigin();
-	result.messageId = currentFileMessage()->id;
+	result.messageId = _chatProcess->slice->list[index].id;
 	result.peer = _chatProcess->info.input;
-	result.split = _chatProcess->info.splits[_chatProcess->localSplitIndex];
+	result.split = _chatProcess->info.splits[_chatProcess->sliceSplitIndex];
 	return result;
 }
 
@@ -1410,39 +1474,48 @@ void ApiWrap::loadNextMessageFile() {
 	Expects(_chatProcess != nullptr);
 	Expects(_chatProcess->slice.has_value());
 
-	for (auto &list = _chatProcess->slice->list
-		; _chatProcess->fileIndex < list.size()
-		; ++_chatProcess->fileIndex) {
-		const auto &message = list[_chatProcess->fileIndex];
-		if (Data::SkipMessageByDate(message, *_settings)) {
-			continue;
-		}
+	const auto limit = _settings->media.downloadsCount;
+	auto &list = _chatProcess->slice->list;
+	while (_chatProcess->fileIndex < list.size()
+		&& _chatProcess->filesLoading < limit) {
+		const auto index = _chatProcess->fileIndex;
+		auto &message = list[index];
 		const auto fileProgress = [=](FileProgress value) {
-			return loadMessageFileProgress(value);
+			return loadMessageFileProgress(index, value);
 		};
-		const auto ready = processFileLoad(
-			list[_chatProcess->fileIndex].file(),
-			currentFileMessageOrigin(),
-			fileProgress,
-			[=](const QString &path) { loadMessageFileDone(path); },
-			currentFileMessage());
-		if (!ready) {
-			return;
+		if (!_chatProcess->thumbNext) {
+			if (Data::SkipMessageByDate(message, *_settings)) {
+				++_chatProcess->fileIndex;
+				continue;
+			}
+			_chatProcess->thumbNext = true;
+			const auto ready = processFileLoad(
+				message.file(),
+				fileMessageOrigin(index),
+				fileProgress,
+				[=](const QString &path) { loadMessageFileDone(index, path); },
+				&message);
+			if (!ready) {
+				++_chatProcess->filesLoading;
+				continue;
+			}
 		}
-		const auto thumbProgress = [=](FileProgress value) {
-			return loadMessageThumbProgress(value);
-		};
+		_chatProcess->thumbNext = false;
+		++_chatProcess->fileIndex;
 		const auto thumbReady = processFileLoad(
-			list[_chatProcess->fileIndex].thumb().file,
-			currentFileMessageOrigin(),
-			thumbProgress,
-			[=](const QString &path) { loadMessageThumbDone(path); },
-			currentFileMessage());
+			message.thumb().file,
+			fileMessageOrigin(index),
+			fileProgress,
+			[=](const QString &path) { loadMessageThumbDone(index, path); },
+			&message);
 		if (!thumbReady) {
-			return;
+			++_chatProcess->filesLoading;
 		}
 	}
-	finishMessagesSlice();
+	if (_chatProcess->fileIndex == list.size()
+		&& !_chatProcess->filesLoading) {
+		finishMessagesSlice();
+	}
 }
 
 void ApiWrap::finishMessagesSlice() {
@@ -1451,69 +1524,61 @@ void ApiWrap::finishMessagesSlice() {
 
 	auto slice = *base::take(_chatProcess->slice);
 	if (!slice.list.empty()) {
-		_chatProcess->largestIdPlusOne = slice.list.back().id + 1;
 		if (!_chatProcess->handleSlice(std::move(slice))) {
+			if (const auto requestId = base::take(_chatProcess->requestId)) {
+				_mtp.request(requestId).cancel();
+			}
 			return;
 		}
 	}
-	if (_chatProcess->lastSlice
-		&& (++_chatProcess->localSplitIndex
-			< _chatProcess->info.splits.size())) {
-		_chatProcess->lastSlice = false;
-		_chatProcess->largestIdPlusOne = 1;
-	}
-	if (!_chatProcess->lastSlice) {
-		requestMessagesSlice();
-	} else {
+	if (_chatProcess->nextSlice.has_value()) {
+		loadMessagesFiles(
+			_chatProcess->nextSliceSplitIndex,
+			*base::take(_chatProcess->nextSlice));
+	} else if (!_chatProcess->requestId) {
 		finishMessages();
 	}
 }
 
-bool ApiWrap::loadMessageFileProgress(FileProgress progress) {
-	Expects(_fileProcess != nullptr);
+bool ApiWrap::loadMessageFileProgress(int index, FileProgress progress) {
 	Expects(_chatProcess != nullptr);
 	Expects(_chatProcess->slice.has_value());
-	Expects((_chatProcess->fileIndex >= 0)
-		&& (_chatProcess->fileIndex < _chatProcess->slice->list.size()));
+	Expects((index >= 0) && (index < _chatProcess->slice->list.size()));
 
 	return _chatProcess->fileProgress(DownloadProgress{
-		_fileProcess->relativePath,
-		_chatProcess->fileIndex,
+		progress.path,
+		index,
 		progress.ready,
 		progress.total });
 }
 
-void ApiWrap::loadMessageFileDone(const QString &relativePath) {
+void ApiWrap::loadMessageFileDone(int index, const QString &relativePath) {
 	Expects(_chatProcess != nullptr);
 	Expects(_chatProcess->slice.has_value());
-	Expects((_chatProcess->fileIndex >= 0)
-		&& (_chatProcess->fileIndex < _chatProcess->slice->list.size()));
+	Expects((index >= 0) && (index < _chatProcess->slice->list.size()));
+	Expects(_chatProcess->filesLoading > 0);
 
-	const auto index = _chatProcess->fileIndex;
 	auto &file = _chatProcess->slice->list[index].file();
 	file.relativePath = relativePath;
 	if (relativePath.isEmpty()) {
 		file.skipReason = Data::File::SkipReason::Unavailable;
 	}
+	--_chatProcess->filesLoading;
 	loadNextMessageFile();
 }
 
-bool ApiWrap::loadMessageThumbProgress(FileProgress progress) {
-	return loadMessageFileProgress(progress);
-}
-
-void ApiWrap::loadMessageThumbDone(const QString &relativePath) {
+void ApiWrap::loadMessageThumbDone(int index, const QString &relativePath) {
 	Expects(_chatProcess != nullptr);
 	Expects(_chatProcess->slice.has_value());
-	Expects((_chatProcess->fileIndex >= 0)
-		&& (_chatProcess->fileIndex < _chatProcess->slice->list.size()));
+	Expects((index >= 0) && (index < _chatProcess->slice->list.size()));
+	Expects(_chatProcess->filesLoading > 0);
 
-	const auto index = _chatProcess->fileIndex;
 	auto &file = _chatProcess->slice->list[index].thumb().file;
 	file.relativePath = relativePath;
 	if (relativePath.isEmpty()) {
 		file.skipReason = Data::File::SkipReason::Unavailable;
 	}
+	--_chatProcess->filesLoading;
 	loadNextMessageFile();
 }
 
@@ -1589,6 +1654,14 @@ bool ApiWrap::writePreloadedFile(
 	if (const auto path = _fileCache->find(file.location)) {
 		file.relativePath = *path;
 		return true;
+	} else if (const auto loaded = FindCheckpointFile(*_checkpoint, file)) {
+		file.relativePath = loaded->relativePath;
+		_fileCache->save(file.location, file.relativePath);
+		if (_stats) {
+			_stats->incrementFiles();
+			_stats->incrementBytes(loaded->size);
+		}
+		return true;
 	} else if (!file.content.isEmpty()) {
 		const auto process = prepareFileProcess(file, origin);
 		if (const auto result = process->file.writeBlock(file.content)) {
@@ -1607,25 +1680,28 @@ void ApiWrap::loadFile(
 		const Data::FileOrigin &origin,
 		Fn<bool(FileProgress)> progress,
 		FnMut<void(QString)> done) {
-	Expects(_fileProcess == nullptr);
 	Expects(file.location.dcId != 0
 		|| file.location.data.type() == mtpc_inputTakeoutFileLocation);
 
-	_fileProcess = prepareFileProcess(file, origin);
-	_fileProcess->progress = std::move(progress);
-	_fileProcess->done = std::move(done);
+	auto owned = prepareFileProcess(file, origin);
+	const auto process = owned.get();
+	process->id = ++_fileProcessIdLast;
+	process->progress = std::move(progress);
+	process->done = std::move(done);
+	_fileProcesses.emplace(process->id, std::move(owned));
 
-	if (_fileProcess->progress) {
+	if (process->progress) {
 		const auto progress = FileProgress{
-			_fileProcess->file.size(),
-			_fileProcess->size
+			process->relativePath,
+			process->file.size(),
+			process->size
 		};
-		if (!_fileProcess->progress(progress)) {
+		if (!process->progress(progress)) {
 			return;
 		}
 	}
 
-	loadFilePart();
+	loadFilePart(process);
 }
 
 auto ApiWrap::prepareFileProcess(
@@ -1647,26 +1723,42 @@ auto ApiWrap::prepareFileProcess(
 	return result;
 }
 
-void ApiWrap::loadFilePart() {
-	if (!_fileProcess
-		|| _fileProcess->requests.size() >= kFileRequestsCount
-		|| (_fileProcess->size > 0
-			&& _fileProcess->offset >= _fileProcess->size)) {
+ApiWrap::FileProcess *ApiWrap::fileProcess(uint64 id) const {
+	const auto i = _fileProcesses.find(id);
+	return (i != end(_fileProcesses)) ? i->second.get() : nullptr;
+}
+
+auto ApiWrap::takeFileProcess(uint64 id) -> std::unique_ptr<FileProcess> {
+	const auto i = _fileProcesses.find(id);
+	if (i == end(_fileProcesses)) {
+		return nullptr;
+	}
+	auto result = std::move(i->second);
+	_fileProcesses.erase(i);
+	return result;
+}
+
+void ApiWrap::loadFilePart(not_null<FileProcess*> process) {
+	if (process->requests.size() >= kFileRequestsCount
+		|| (process->size > 0
+			&& process->offset >= process->size)) {
 		return;
 	}
 
-	const auto offset = _fileProcess->offset;
-	_fileProcess->requests.push_back({ offset });
+	const auto id = process->id;
+	const auto offset = process->offset;
+	process->requests.push_back({ offset });
 	fileRequest(
-		_fileProcess->location,
-		_fileProcess->offset
+		id,
+		process->location,
+		process->offset
 	).done([=](const MTPupload_File &result) {
-		filePartDone(offset, result);
+		filePartDone(id, offset, result);
 	}).send();
-	_fileProcess->offset += kFileChunkSize;
+	process->offset += kFileChunkSize;
 
-	if (_fileProcess->size > 0
-		&& _fileProcess->requests.size() < kFileRequestsCount) {
+	if (process->size > 0
+		&& process->requests.size() < kFileRequestsCount) {
 		//const auto runner = _runner;
 		//crl::on_main([=] {
 		//	QTimer::singleShot(kFileNextRequestDelay, [=] {
@@ -1678,9 +1770,16 @@ void ApiWrap::loadFilePart() {
 	}
 }
 
-void ApiWrap::filePartDone(int offset, const MTPupload_File &result) {
-	Expects(_fileProcess != nullptr);
-	Expects(!_fileProcess->requests.empty());
+void ApiWrap::filePartDone(
+		uint64 processId,
+		int offset,
+		const MTPupload_File &result) {
+	const auto process = fileProcess(processId);
+	if (!process) {
+		// The file was reported unavailable by another part request.
+		return;
+	}
+	Assert(!process->requests.empty());
 
 	if (result.type() == mtpc_upload_fileCdnRedirect) {
 		error("Cdn redirect is not supported.");
@@ -1688,18 +1787,18 @@ void ApiWrap::filePartDone(int offset, const MTPupload_File &result) {
 	}
 	const auto &data = result.c_upload_file();
 	if (data.vbytes().v.isEmpty()) {
-		if (_fileProcess->size > 0) {
+		if (process->size > 0) {
 			error("Empty bytes received in file part.");
 			return;
 		}
-		const auto result = _fileProcess->file.writeBlock({});
+		const auto result = process->file.writeBlock({});
 		if (!result) {
 			ioError(result);
 			return;
 		}
 	} else {
 		using Request = FileProcess::Request;
-		auto &requests = _fileProcess->requests;
+		auto &requests = process->requests;
 		const auto i = ranges::find(
 			requests,
 			offset,
@@ -1708,7 +1807,7 @@ void ApiWrap::filePartDone(int offset, const MTPupload_File &result) {
 
 		i->bytes = data.vbytes().v;
 
-		auto &file = _fileProcess->file;
+		auto &file = process->file;
 		while (!requests.empty() && !requests.front().bytes.isEmpty()) {
 			const auto &bytes = requests.front().bytes;
 			if (const auto result = file.writeBlock(bytes); !result) {
@@ -1718,30 +1817,40 @@ void ApiWrap::filePartDone(int offset, const MTPupload_File &result) {
 			requests.pop_front();
 		}
 
-		if (_fileProcess->progress) {
-			_fileProcess->progress(FileProgress{
+		if (process->progress) {
+			process->progress(FileProgress{
+				process->relativePath,
 				file.size(),
-				_fileProcess->size });
+				process->size });
 		}
 
 		if (!requests.empty()
-			|| !_fileProcess->size
-			|| _fileProcess->size > _fileProcess->offset) {
-			loadFilePart();
+			|| !process->size
+			|| process->size > process->offset) {
+			loadFilePart(process);
 			return;
 		}
 	}
 
-	auto process = base::take(_fileProcess);
-	const auto relativePath = process->relativePath;
-	_fileCache->save(process->location, relativePath);
-	process->done(process->relativePath);
+	const auto taken = takeFileProcess(processId);
+	const auto relativePath = taken->relativePath;
+	_fileCache->save(taken->location, relativePath);
+	if (taken->location) {
+		_checkpoint->saveFile(
+			ComputeCheckpointKey(taken->location),
+			relativePath,
+			taken->file.size());
+	}
+	taken->done(relativePath);
 }
 
-void ApiWrap::filePartRefreshReference(int offset) {
-	Expects(_fileProcess != nullptr);
+void ApiWrap::filePartRefreshReference(uint64 processId, int offset) {
+	const auto process = fileProcess(processId);
+	if (!process) {
+		return;
+	}
 
-	const auto &origin = _fileProcess->origin;
+	const auto &origin = process->origin;
 	if (!origin.messageId) {
 		error("FILE_REFERENCE error for non-message file.");
 		return;
@@ -1762,10 +1871,10 @@ void ApiWrap::filePartRefreshReference(int offset) {
 				1,
 				MTP_inputMessageID(MTP_int(origin.messageId)))
 		)).fail([=](const RPCError &error) {
-			filePartUnavailable();
+			filePartUnavailable(processId);
 			return true;
 		}).done([=](const MTPmessages_Messages &result) {
-			filePartExtractReference(offset, result);
+			filePartExtractReference(processId, offset, result);
 		}).send();
 	} else {
 		splitRequest(origin.split, MTPmessages_GetMessages(
@@ -1773,18 +1882,22 @@ void ApiWrap::filePartRefreshReference(int offset) {
 				1,
 				MTP_inputMessageID(MTP_int(origin.messageId)))
 		)).fail([=](const RPCError &error) {
-			filePartUnavailable();
+			filePartUnavailable(processId);
 			return true;
 		}).done([=](const MTPmessages_Messages &result) {
-			filePartExtractReference(offset, result);
+			filePartExtractReference(processId, offset, result);
 		}).send();
 	}
 }
 
 void ApiWrap::filePartExtractReference(
+		uint64 processId,
 		int offset,
 		const MTPmessages_Messages &result) {
-	Expects(_fileProcess != nullptr);
+	const auto process = fileProcess(processId);
+	if (!process) {
+		return;
+	}
 
 	result.match([&](const MTPDmessages_messagesNotModified &data) {
 		error("Unexpected messagesNotModified received.");
@@ -1797,35 +1910,35 @@ void ApiWrap::filePartExtractReference(
 			data.vchats(),
 			_chatProcess->info.relativePath);
 		for (const auto &message : messages.list) {
-			if (message.id == _fileProcess->origin.messageId) {
+			if (message.id == process->origin.messageId) {
 				const auto refresh1 = Data::RefreshFileReference(
-					_fileProcess->location,
+					process->location,
 					message.file().location);
 				const auto refresh2 = Data::RefreshFileReference(
-					_fileProcess->location,
+					process->location,
 					message.thumb().file.location);
 				if (refresh1 || refresh2) {
 					fileRequest(
-						_fileProcess->location,
+						processId,
+						process->location,
 						offset
 					).done([=](const MTPupload_File &result) {
-						filePartDone(offset, result);
+						filePartDone(processId, offset, result);
 					}).send();
 					return;
 				}
 			}
 		}
-		filePartUnavailable();
+		filePartUnavailable(processId);
 	});
 }
 
-void ApiWrap::filePartUnavailable() {
-	Expects(_fileProcess != nullptr);
-	Expects(!_fileProcess->requests.empty());
+void ApiWrap::filePartUnavailable(uint64 processId) {
+	if (const auto process = takeFileProcess(processId)) {
+		LOG(("Export Error: File unavailable."));
 
-	LOG(("Export Error: File unavailable."));
-
-	base::take(_fileProcess)->done(QString());
+		process->done(QString());
+	}
 }
 
 void ApiWrap::error(RPCError &&error) {
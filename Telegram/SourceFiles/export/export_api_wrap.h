@@ -8,6 +8,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #pragma once
 
 #include "mtproto/mtproto_concurrent_sender.h"
+#include "base/flat_map.h"
 
 namespace Export {
 namespace Data {
@@ -32,6 +33,7 @@ class Stats;
 } // namespace Output
 
 struct Settings;
+class Checkpoint;
 
 class ApiWrap {
 public:
@@ -151,17 +153,18 @@ private:
 		int addOffset,
 		int limit,
 		FnMut<void(MTPmessages_Messages&&)> done);
-	void loadMessagesFiles(Data::MessagesSlice &&slice);
+	void messagesSliceLoaded(
+		int localSplitIndex,
+		Data::MessagesSlice &&slice);
+	void loadMessagesFiles(int localSplitIndex, Data::MessagesSlice &&slice);
 	void loadNextMessageFile();
-	bool loadMessageFileProgress(FileProgress value);
-	void loadMessageFileDone(const QString &relativePath);
-	bool loadMessageThumbProgress(FileProgress value);
-	void loadMessageThumbDone(const QString &relativePath);
+	bool loadMessageFileProgress(int index, FileProgress value);
+	void loadMessageFileDone(int index, const QString &relativePath);
+	void loadMessageThumbDone(int index, const QString &relativePath);
 	void finishMessagesSlice();
 	void finishMessages();
 
-	[[nodiscard]] Data::Message *currentFileMessage() const;
-	[[nodiscard]] Data::FileOrigin currentFileMessageOrigin() const;
+	[[nodiscard]] Data::FileOrigin fileMessageOrigin(int index) const;
 
 	bool processFileLoad(
 		Data::File &file,
@@ -180,11 +183,17 @@ private:
 		const Data::FileOrigin &origin,
 		Fn<bool(FileProgress)> progress,
 		FnMut<void(QString)> done);
-	void loadFilePart();
-	void filePartDone(int offset, const MTPupload_File &result);
-	void filePartUnavailable();
-	void filePartRefreshReference(int offset);
+	[[nodiscard]] FileProcess *fileProcess(uint64 id) const;
+	std::unique_ptr<FileProcess> takeFileProcess(uint64 id);
+	void loadFilePart(not_null<FileProcess*> process);
+	void filePartDone(
+		uint64 processId,
+		int offset,
+		const MTPupload_File &result);
+	void filePartUnavailable(uint64 processId);
+	void filePartRefreshReference(uint64 processId, int offset);
 	void filePartExtractReference(
+		uint64 processId,
 		int offset,
 		const MTPmessages_Messages &result);
 
@@ -198,6 +207,7 @@ private:
 	[[nodiscard]] auto splitRequest(int index, Request &&request);
 
 	[[nodiscard]] auto fileRequest(
+		uint64 processId,
 		const Data::FileLocation &location,
 		int offset);
 
@@ -210,6 +220,7 @@ private:
 	Output::Stats *_stats = nullptr;
 
 	std::unique_ptr<Settings> _settings;
+	std::unique_ptr<Checkpoint> _checkpoint;
 	MTPInputUser _user = MTP_inputUserSelf();
 
 	std::unique_ptr<StartProcess> _startProcess;
@@ -217,7 +228,8 @@ private:
 	std::unique_ptr<ContactsProcess> _contactsProcess;
 	std::unique_ptr<UserpicsProcess> _userpicsProcess;
 	std::unique_ptr<OtherDataProcess> _otherDataProcess;
-	std::unique_ptr<FileProcess> _fileProcess;
+	base::flat_map<uint64, std::unique_ptr<FileProcess>> _fileProcesses;
+	uint64 _fileProcessIdLast = 0;
 	std::unique_ptr<LeftChannelsProcess> _leftChannelsProcess;
 	std::unique_ptr<DialogsProcess> _dialogsProcess;
 	std::unique_ptr<ChatProcess> _chatProcess;
@@ -0,0 +1,193 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "export/export_checkpoint.h"
+
+#include "export/export_settings.h"
+
+#include <QtCore/QDataStream>
+
+namespace Export {
+namespace {
+
+constexpr auto kMagic = quint32(0x54444543); // 'TDEC'
+constexpr auto kVersion = qint32(1);
+constexpr auto kFileName = ".export_checkpoint";
+
+// Only the settings that change the exported data, the path and the
+// downloads count can be different in the resumed export.
+QByteArray ComputeFingerprint(const Settings &settings) {
+	auto result = QByteArray();
+	QDataStream stream(&result, QIODevice::WriteOnly);
+	stream.setVersion(QDataStream::Qt_5_1);
+	stream
+		<< quint32(settings.types)
+		<< quint32(settings.fullChats)
+		<< quint32(settings.media.types)
+		<< qint32(settings.media.sizeLimit)
+		<< qint32(settings.format)
+		<< qint32(settings.singlePeerFrom)
+		<< qint32(settings.singlePeerTill)
+		<< qint32(settings.singlePeer.type());
+	settings.singlePeer.match([&](const MTPDinputPeerUser &data) {
+		stream << qint32(data.vuser_id().v);
+	}, [&](const MTPDinputPeerChat &data) {
+		stream << qint32(data.vchat_id().v);
+	}, [&](const MTPDinputPeerChannel &data) {
+		stream << qint32(data.vchannel_id().v);
+	}, [](const auto &data) {
+	});
+	return result;
+}
+
+std::optional<QByteArray> ReadFingerprint(QDataStream &stream) {
+	auto magic = quint32();
+	auto version = qint32();
+	auto fingerprint = QByteArray();
+	stream >> magic >> version >> fingerprint;
+	if (stream.status() != QDataStream::Ok
+		|| magic != kMagic
+		|| version != kVersion) {
+		return std::nullopt;
+	}
+	return fingerprint;
+}
+
+bool HasCheckpoint(const QString &folder, const QByteArray &fingerprint) {
+	QFile file(folder + kFileName);
+	if (!file.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+	QDataStream stream(&file);
+	stream.setVersion(QDataStream::Qt_5_1);
+	return (ReadFingerprint(stream) == fingerprint);
+}
+
+} // namespace
+
+QString Checkpoint::FindUnfinished(const Settings &settings) {
+	const auto fingerprint = ComputeFingerprint(settings);
+	const auto path = QDir(settings.path).absolutePath();
+	const auto base = path.endsWith('/') ? path : (path + '/');
+	if (HasCheckpoint(base, fingerprint)) {
+		return base;
+	}
+	const auto filters = QStringList()
+		<< "DataExport_*"
+		<< "ChatExport_*";
+	const auto list = QDir(base).entryInfoList(
+		filters,
+		QDir::Dirs | QDir::NoDotAndDotDot,
+		QDir::Time);
+	for (const auto &info : list) {
+		const auto folder = info.absoluteFilePath() + '/';
+		if (HasCheckpoint(folder, fingerprint)) {
+			return folder;
+		}
+	}
+	return QString();
+}
+
+Checkpoint::Checkpoint(const Settings &settings)
+: _folder(settings.path)
+, _fingerprint(ComputeFingerprint(settings))
+, _file(_folder + kFileName) {
+	read();
+	start();
+}
+
+void Checkpoint::read() {
+	if (!_file.open(QIODevice::ReadOnly)) {
+		return;
+	}
+	QDataStream stream(&_file);
+	stream.setVersion(QDataStream::Qt_5_1);
+	if (ReadFingerprint(stream) == _fingerprint) {
+		while (!stream.atEnd()) {
+			auto key = FileKey();
+			auto size = qint32();
+			auto relativePath = QString();
+			stream >> key.type >> key.id >> size >> relativePath;
+			if (stream.status() != QDataStream::Ok) {
+				// The export was interrupted while writing the last record.
+				break;
+			}
+			_files[key] = LoadedFile{ relativePath, size };
+		}
+	}
+	_file.close();
+}
+
+void Checkpoint::start() {
+	// Rewrite the whole file to drop a broken tail left by the last run.
+	if (!QDir().mkpath(_folder)
+		|| !_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		fail();
+		return;
+	}
+	QDataStream stream(&_file);
+	stream.setVersion(QDataStream::Qt_5_1);
+	stream << kMagic << kVersion << _fingerprint;
+	for (const auto &[key, file] : _files) {
+		stream
+			<< key.type
+			<< key.id
+			<< qint32(file.size)
+			<< file.relativePath;
+	}
+	if (stream.status() != QDataStream::Ok || !_file.flush()) {
+		fail();
+	}
+}
+
+void Checkpoint::fail() {
+	LOG(("Export Error: Could not write checkpoint to '%1'."
+		).arg(_file.fileName()));
+	_failed = true;
+	_file.close();
+}
+
+std::optional<Checkpoint::LoadedFile> Checkpoint::findFile(
+		const FileKey &key,
+		int expectedSize) const {
+	const auto i = _files.find(key);
+	if (i == end(_files)) {
+		return std::nullopt;
+	}
+	const auto &file = i->second;
+	if ((expectedSize > 0 && file.size != expectedSize)
+		|| QFileInfo(_folder + file.relativePath).size() != file.size) {
+		return std::nullopt;
+	}
+	return file;
+}
+
+void Checkpoint::saveFile(
+		const FileKey &key,
+		const QString &relativePath,
+		int size) {
+	if (_failed) {
+		return;
+	}
+	_files[key] = LoadedFile{ relativePath, size };
+
+	QDataStream stream(&_file);
+	stream.setVersion(QDataStream::Qt_5_1);
+	stream << key.type << key.id << qint32(size) << relativePath;
+	if (stream.status() != QDataStream::Ok || !_file.flush()) {
+		fail();
+	}
+}
+
+void Checkpoint::finish() {
+	_files.clear();
+	_file.close();
+	_file.remove();
+	_failed = true;
+}
+
+} // namespace Export
@@ -0,0 +1,57 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+namespace Export {
+
+struct Settings;
+
+// Remembers files downloaded by an unfinished export, so that the export
+// with the same settings could be resumed in the same folder later.
+class Checkpoint final {
+public:
+	struct FileKey {
+		uint64 type = 0;
+		uint64 id = 0;
+
+		inline bool operator<(const FileKey &other) const {
+			return std::tie(type, id) < std::tie(other.type, other.id);
+		}
+	};
+	struct LoadedFile {
+		QString relativePath;
+		int size = 0;
+	};
+
+	// Returns the folder of the newest unfinished export for the settings.
+	[[nodiscard]] static QString FindUnfinished(const Settings &settings);
+
+	explicit Checkpoint(const Settings &settings);
+
+	// The file is returned only if it is still there with the same size.
+	[[nodiscard]] std::optional<LoadedFile> findFile(
+		const FileKey &key,
+		int expectedSize) const;
+	void saveFile(const FileKey &key, const QString &relativePath, int size);
+
+	void finish();
+
+private:
+	void read();
+	void start();
+	void fail();
+
+	QString _folder;
+	QByteArray _fingerprint;
+	QFile _file;
+	std::map<FileKey, LoadedFile> _files;
+	bool _failed = false;
+
+};
+
+} // namespace Export
@@ -8,6 +8,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "export/export_controller.h"
 
 #include "export/export_api_wrap.h"
+#include "export/export_checkpoint.h"
 #include "export/export_settings.h"
 #include "export/data/export_data_types.h"
 #include "export/output/export_output_abstract.h"
@@ -237,7 +238,10 @@ void ControllerObject::startExport(
 	_settings = NormalizeSettings(settings);
 	_environment = environment;
 
-	_settings.path = Output::NormalizePath(_settings);
+	const auto unfinished = Checkpoint::FindUnfinished(_settings);
+	_settings.path = unfinished.isEmpty()
+		? Output::NormalizePath(_settings)
+		: unfinished;
 	_writer = Output::CreateWriter(_settings.format);
 	fillExportSteps();
 	exportNext();
@@ -13,6 +13,7 @@ namespace Export {
 namespace {
 
 constexpr auto kMaxFileSize = 1500 * 1024 * 1024;
+constexpr auto kMaxDownloadsCount = 8;
 
 } // namespace
 
@@ -21,6 +22,8 @@ bool MediaSettings::validate() const {
 		return false;
 	} else if (sizeLimit < 0 || sizeLimit > kMaxFileSize) {
 		return false;
+	} else if (downloadsCount < 1 || downloadsCount > kMaxDownloadsCount) {
+		return false;
 	}
 	return true;
 }
@@ -37,7 +40,9 @@ bool Settings::validate() const {
 		return false;
 	} else if ((fullChats & MustNotBeFull) != 0) {
 		return false;
-	} else if (format != Format::Html && format != Format::Json) {
+	} else if (format != Format::Html
+		&& format != Format::Json
+		&& format != Format::Binary) {
 		return false;
 	} else if (!media.validate()) {
 		return false;
@@ -35,6 +35,7 @@ struct MediaSettings {
 
 	Types types = DefaultTypes();
 	int sizeLimit = 8 * 1024 * 1024;
+	int downloadsCount = 4; // Files loaded at the same time.
 
 	static inline Types DefaultTypes() {
 		return Type::Photo;
@@ -10,6 +10,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "export/output/export_output_text.h"
 #include "export/output/export_output_html.h"
 #include "export/output/export_output_json.h"
+#include "export/output/export_output_binary.h"
 #include "export/output/export_output_stats.h"
 #include "export/output/export_output_result.h"
 
@@ -54,6 +55,7 @@ std::unique_ptr<AbstractWriter> CreateWriter(Format format) {
 	case Format::Html: return std::make_unique<HtmlWriter>();
 	case Format::Text: return std::make_unique<TextWriter>();
 	case Format::Json: return std::make_unique<JsonWriter>();
+	case Format::Binary: return std::make_unique<BinaryWriter>();
 	}
 	Unexpected("Format in Export::Output::CreateWriter.");
 }
@@ -0,0 +1,627 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "export/output/export_output_binary.h"
+
+#include "export/output/export_output_result.h"
+#include "export/data/export_data_types.h"
+
+#include <QtCore/QtEndian>
+
+namespace Export {
+namespace Output {
+namespace {
+
+constexpr auto kVersion = 1;
+constexpr auto kIndexStep = 1000;
+
+enum class RecordType : uchar {
+	About = 1,
+	Personal,
+	Userpic,
+	Contact,
+	FrequentContact,
+	Session,
+	WebSession,
+	OtherData,
+	Peer,
+	DialogStart,
+	Message,
+	DialogEnd,
+	Index,
+};
+
+enum class MediaType : uchar {
+	None,
+	Photo,
+	Document,
+	SharedContact,
+	GeoPoint,
+	Venue,
+	Game,
+	Invoice,
+	Poll,
+	Unsupported,
+};
+
+enum class ActionType : uchar {
+	None,
+	ChatCreate,
+	ChatEditTitle,
+	ChatEditPhoto,
+	ChatDeletePhoto,
+	ChatAddUser,
+	ChatDeleteUser,
+	ChatJoinedByLink,
+	ChannelCreate,
+	ChatMigrateTo,
+	ChannelMigrateFrom,
+	PinMessage,
+	HistoryClear,
+	GameScore,
+	PaymentSent,
+	PhoneCall,
+	ScreenshotTaken,
+	CustomAction,
+	BotAllowed,
+	SecureValuesSent,
+	ContactSignUp,
+	PhoneNumberRequest,
+};
+
+void AppendNumber(QByteArray &to, uint64 value) {
+	while (value >= 0x80) {
+		to.append(char(uchar(value & 0x7F) | 0x80));
+		value >>= 7;
+	}
+	to.append(char(uchar(value)));
+}
+
+void AppendSigned(QByteArray &to, int64 value) {
+	AppendNumber(to, (uint64(value) << 1) ^ uint64(value >> 63));
+}
+
+void AppendDouble(QByteArray &to, float64 value) {
+	auto bits = uint64();
+	memcpy(&bits, &value, sizeof(bits));
+	const auto little = qToLittleEndian(bits);
+	to.append(reinterpret_cast<const char*>(&little), sizeof(little));
+}
+
+void AppendString(QByteArray &to, const QByteArray &value) {
+	AppendNumber(to, value.size());
+	to.append(value);
+}
+
+void AppendFile(QByteArray &to, const Data::File &file) {
+	AppendNumber(to, uint64(file.skipReason));
+	AppendString(to, file.relativePath.toUtf8());
+}
+
+void AppendRecord(QByteArray &to, RecordType type, const QByteArray &data) {
+	AppendNumber(to, uint64(type));
+	AppendString(to, data);
+}
+
+QByteArray SerializeContact(const Data::ContactInfo &data) {
+	auto result = QByteArray();
+	AppendSigned(result, data.userId);
+	AppendString(result, data.firstName);
+	AppendString(result, data.lastName);
+	AppendString(result, data.phoneNumber);
+	AppendSigned(result, data.date);
+	return result;
+}
+
+QByteArray SerializePeer(const Data::Peer &data) {
+	auto result = QByteArray();
+	AppendNumber(result, data.id());
+	if (const auto user = data.user()) {
+		AppendNumber(result, 0);
+		AppendString(result, user->info.firstName);
+		AppendString(result, user->info.lastName);
+		AppendString(result, user->username);
+	} else if (const auto chat = data.chat()) {
+		AppendNumber(result, chat->isBroadcast ? 2 : 1);
+		AppendString(result, chat->title);
+		AppendString(result, QByteArray());
+		AppendString(result, chat->username);
+	}
+	return result;
+}
+
+void AppendText(QByteArray &to, const std::vector<Data::TextPart> &data) {
+	AppendNumber(to, data.size());
+	for (const auto &part : data) {
+		AppendNumber(to, uint64(part.type));
+		AppendString(to, part.text);
+		AppendString(to, part.additional);
+	}
+}
+
+void AppendMedia(QByteArray &to, const Data::Media &data) {
+	using namespace Data;
+
+	const auto type = data.content.match([](const Photo &) {
+		return MediaType::Photo;
+	}, [](const Document &) {
+		return MediaType::Document;
+	}, [](const SharedContact &) {
+		return MediaType::SharedContact;
+	}, [](const GeoPoint &) {
+		return MediaType::GeoPoint;
+	}, [](const Venue &) {
+		return MediaType::Venue;
+	}, [](const Game &) {
+		return MediaType::Game;
+	}, [](const Invoice &) {
+		return MediaType::Invoice;
+	}, [](const Poll &) {
+		return MediaType::Poll;
+	}, [](const UnsupportedMedia &) {
+		return MediaType::Unsupported;
+	}, [](std::nullopt_t) {
+		return MediaType::None;
+	});
+	AppendNumber(to, uint64(type));
+	if (type == MediaType::None) {
+		return;
+	}
+	AppendSigned(to, data.ttl);
+	data.content.match([&](const Photo &data) {
+		AppendFile(to, data.image.file);
+		AppendNumber(to, data.image.width);
+		AppendNumber(to, data.image.height);
+	}, [&](const Document &data) {
+		AppendFile(to, data.file);
+		AppendFile(to, data.thumb.file);
+		AppendString(to, data.name);
+		AppendString(to, data.mime);
+		AppendNumber(to, data.file.size);
+		AppendNumber(to, data.width);
+		AppendNumber(to, data.height);
+		AppendSigned(to, data.duration);
+		AppendString(to, data.stickerEmoji);
+		AppendString(to, data.songPerformer);
+		AppendString(to, data.songTitle);
+		AppendNumber(to, (data.isSticker ? 0x01 : 0)
+			| (data.isAnimated ? 0x02 : 0)
+			| (data.isVideoMessage ? 0x04 : 0)
+			| (data.isVoiceMessage ? 0x08 : 0)
+			| (data.isVideoFile ? 0x10 : 0)
+			| (data.isAudioFile ? 0x20 : 0));
+	}, [&](const SharedContact &data) {
+		AppendFile(to, data.vcard);
+		to.append(SerializeContact(data.info));
+	}, [&](const GeoPoint &data) {
+		AppendDouble(to, data.valid ? data.latitude : 0.);
+		AppendDouble(to, data.valid ? data.longitude : 0.);
+	}, [&](const Venue &data) {
+		AppendDouble(to, data.point.valid ? data.point.latitude : 0.);
+		AppendDouble(to, data.point.valid ? data.point.longitude : 0.);
+		AppendString(to, data.title);
+		AppendString(to, data.address);
+	}, [&](const Game &data) {
+		AppendString(to, data.shortName);
+		AppendString(to, data.title);
+		AppendString(to, data.description);
+	}, [&](const Invoice &data) {
+		AppendString(to, data.title);
+		AppendString(to, data.description);
+		AppendString(to, data.currency);
+		AppendNumber(to, data.amount);
+		AppendSigned(to, data.receiptMsgId);
+	}, [&](const Poll &data) {
+		AppendString(to, data.question);
+		AppendNumber(to, data.closed ? 1 : 0);
+		AppendNumber(to, data.totalVotes);
+		AppendNumber(to, data.answers.size());
+		for (const auto &answer : data.answers) {
+			AppendString(to, answer.text);
+			AppendNumber(to, answer.votes);
+			AppendNumber(to, answer.my ? 1 : 0);
+		}
+	}, [](const auto &) {});
+}
+
+ActionType ComputeActionType(const Data::ServiceAction &data) {
+	using namespace Data;
+
+	return data.content.match([](const ActionChatCreate &) {
+		return ActionType::ChatCreate;
+	}, [](const ActionChatEditTitle &) {
+		return ActionType::ChatEditTitle;
+	}, [](const ActionChatEditPhoto &) {
+		return ActionType::ChatEditPhoto;
+	}, [](const ActionChatDeletePhoto &) {
+		return ActionType::ChatDeletePhoto;
+	}, [](const ActionChatAddUser &) {
+		return ActionType::ChatAddUser;
+	}, [](const ActionChatDeleteUser &) {
+		return ActionType::ChatDeleteUser;
+	}, [](const ActionChatJoinedByLink &) {
+		return ActionType::ChatJoinedByLink;
+	}, [](const ActionChannelCreate &) {
+		return ActionType::ChannelCreate;
+	}, [](const ActionChatMigrateTo &) {
+		return ActionType::ChatMigrateTo;
+	}, [](const ActionChannelMigrateFrom &) {
+		return ActionType::ChannelMigrateFrom;
+	}, [](const ActionPinMessage &) {
+		return ActionType::PinMessage;
+	}, [](const ActionHistoryClear &) {
+		return ActionType::HistoryClear;
+	}, [](const ActionGameScore &) {
+		return ActionType::GameScore;
+	}, [](const ActionPaymentSent &) {
+		return ActionType::PaymentSent;
+	}, [](const ActionPhoneCall &) {
+		return ActionType::PhoneCall;
+	}, [](const ActionScreenshotTaken &) {
+		return ActionType::ScreenshotTaken;
+	}, [](const ActionCustomAction &) {
+		return ActionType::CustomAction;
+	}, [](const ActionBotAllowed &) {
+		return ActionType::BotAllowed;
+	}, [](const ActionSecureValuesSent &) {
+		return ActionType::SecureValuesSent;
+	}, [](const ActionContactSignUp &) {
+		return ActionType::ContactSignUp;
+	}, [](const ActionPhoneNumberRequest &) {
+		return ActionType::PhoneNumberRequest;
+	}, [](std::nullopt_t) {
+		return ActionType::None;
+	});
+}
+
+void AppendUserIds(QByteArray &to, const std::vector<int32> &userIds) {
+	AppendNumber(to, userIds.size());
+	for (const auto userId : userIds) {
+		AppendSigned(to, userId);
+	}
+}
+
+void AppendAction(QByteArray &to, const Data::ServiceAction &data) {
+	using namespace Data;
+
+	// Pinned, game and invoice message ids are in replyToMsgId.
+	AppendNumber(to, uint64(ComputeActionType(data)));
+	data.content.match([&](const ActionChatCreate &data) {
+		AppendString(to, data.title);
+		AppendUserIds(to, data.userIds);
+	}, [&](const ActionChatEditTitle &data) {
+		AppendString(to, data.title);
+	}, [&](const ActionChatEditPhoto &data) {
+		AppendFile(to, data.photo.image.file);
+		AppendNumber(to, data.photo.image.width);
+		AppendNumber(to, data.photo.image.height);
+	}, [&](const ActionChatAddUser &data) {
+		AppendUserIds(to, data.userIds);
+	}, [&](const ActionChatDeleteUser &data) {
+		AppendSigned(to, data.userId);
+	}, [&](const ActionChatJoinedByLink &data) {
+		AppendSigned(to, data.inviterId);
+	}, [&](const ActionChannelCreate &data) {
+		AppendString(to, data.title);
+	}, [&](const ActionChatMigrateTo &data) {
+		AppendSigned(to, data.channelId);
+	}, [&](const ActionChannelMigrateFrom &data) {
+		AppendString(to, data.title);
+		AppendSigned(to, data.chatId);
+	}, [&](const ActionGameScore &data) {
+		AppendNumber(to, data.gameId);
+		AppendSigned(to, data.score);
+	}, [&](const ActionPaymentSent &data) {
+		AppendString(to, data.currency);
+		AppendNumber(to, data.amount);
+	}, [&](const ActionPhoneCall &data) {
+		AppendNumber(to, uint64(data.discardReason));
+		AppendSigned(to, data.duration);
+	}, [&](const ActionCustomAction &data) {
+		AppendString(to, data.message);
+	}, [&](const ActionBotAllowed &data) {
+		AppendString(to, data.domain);
+	}, [&](const ActionSecureValuesSent &data) {
+		AppendNumber(to, data.types.size());
+		for (const auto type : data.types) {
+			AppendNumber(to, uint64(type));
+		}
+	}, [](const auto &) {});
+}
+
+QByteArray SerializeMessage(const Data::Message &message) {
+	auto result = QByteArray();
+	AppendSigned(result, message.id);
+	AppendSigned(result, message.date);
+	AppendSigned(result, message.edited);
+	AppendSigned(result, message.fromId);
+	AppendNumber(result, message.toId);
+	AppendNumber(result, (message.out ? 0x01 : 0)
+		| (message.forwarded ? 0x02 : 0));
+	if (message.forwarded) {
+		AppendNumber(result, message.forwardedFromId);
+		AppendString(result, message.forwardedFromName);
+		AppendSigned(result, message.forwardedDate);
+	}
+	AppendNumber(result, message.savedFromChatId);
+	AppendString(result, message.signature);
+	AppendSigned(result, message.viaBotId);
+	AppendSigned(result, message.replyToMsgId);
+	AppendText(result, message.text);
+	AppendMedia(result, message.media);
+	AppendAction(result, message.action);
+	return result;
+}
+
+} // namespace
+
+Result BinaryWriter::start(
+		const Settings &settings,
+		const Environment &environment,
+		Stats *stats) {
+	Expects(_output == nullptr);
+	Expects(settings.path.endsWith('/'));
+
+	_settings = base::duplicate(settings);
+	_environment = environment;
+	_stats = stats;
+	_output = std::make_unique<File>(
+		pathWithRelativePath(mainFileRelativePath()),
+		_stats);
+
+	auto block = QByteArray("TDEB");
+	AppendNumber(block, kVersion);
+	AppendRecord(block, RecordType::About, _environment.aboutTelegram);
+	return writeBlock(block);
+}
+
+Result BinaryWriter::writePersonal(const Data::PersonalInfo &data) {
+	Expects(_output != nullptr);
+
+	auto serialized = SerializeContact(data.user.info);
+	AppendString(serialized, data.user.username);
+	AppendString(serialized, data.bio);
+
+	auto block = QByteArray();
+	AppendRecord(block, RecordType::Personal, serialized);
+	return writeBlock(block);
+}
+
+Result BinaryWriter::writeUserpicsStart(const Data::UserpicsInfo &data) {
+	return Result::Success();
+}
+
+Result BinaryWriter::writeUserpicsSlice(const Data::UserpicsSlice &data) {
+	Expects(_output != nullptr);
+
+	auto block = QByteArray();
+	for (const auto &userpic : data.list) {
+		auto serialized = QByteArray();
+		AppendSigned(serialized, userpic.date);
+		AppendFile(serialized, userpic.image.file);
+		AppendRecord(block, RecordType::Userpic, serialized);
+	}
+	return writeBlock(block);
+}
+
+Result BinaryWriter::writeUserpicsEnd() {
+	return Result::Success();
+}
+
+Result BinaryWriter::writeContactsList(const Data::ContactsList &data) {
+	Expects(_output != nullptr);
+
+	auto block = QByteArray();
+	for (const auto index : Data::SortedContactsIndices(data)) {
+		AppendRecord(
+			block,
+			RecordType::Contact,
+			SerializeContact(data.list[index]));
+	}
+	const auto writeList = [&](
+			const std::vector<Data::TopPeer> &peers,
+			int category) {
+		for (const auto &top : peers) {
+			auto serialized = QByteArray();
+			AppendNumber(serialized, category);
+			AppendDouble(serialized, top.rating);
+			serialized.append(SerializePeer(top.peer));
+			AppendRecord(block, RecordType::FrequentContact, serialized);
+		}
+	};
+	writeList(data.correspondents, 0);
+	writeList(data.inlineBots, 1);
+	writeList(data.phoneCalls, 2);
+	return writeBlock(block);
+}
+
+Result BinaryWriter::writeSessionsList(const Data::SessionsList &data) {
+	Expects(_output != nullptr);
+
+	auto block = QByteArray();
+	for (const auto &session : data.list) {
+		auto serialized = QByteArray();
+		AppendSigned(serialized, session.lastActive);
+		AppendString(serialized, session.ip);
+		AppendString(serialized, session.country);
+		AppendString(serialized, session.region);
+		AppendString(serialized, session.applicationName);
+		AppendString(serialized, session.applicationVersion);
+		AppendString(serialized, session.deviceModel);
+		AppendString(serialized, session.platform);
+		AppendString(serialized, session.systemVersion);
+		AppendSigned(serialized, session.created);
+		AppendRecord(block, RecordType::Session, serialized);
+	}
+	for (const auto &session : data.webList) {
+		auto serialized = QByteArray();
+		AppendSigned(serialized, session.lastActive);
+		AppendString(serialized, session.ip);
+		AppendString(serialized, session.region);
+		AppendString(serialized, session.botUsername);
+		AppendString(serialized, session.domain);
+		AppendString(serialized, session.browser);
+		AppendString(serialized, session.platform);
+		AppendSigned(serialized, session.created);
+		AppendRecord(block, RecordType::WebSession, serialized);
+	}
+	return writeBlock(block);
+}
+
+Result BinaryWriter::writeOtherData(const Data::File &data) {
+	Expects(_output != nullptr);
+
+	auto serialized = QByteArray();
+	AppendFile(serialized, data);
+
+	auto block = QByteArray();
+	AppendRecord(block, RecordType::OtherData, serialized);
+	return writeBlock(block);
+}
+
+Result BinaryWriter::writeDialogsStart(const Data::DialogsInfo &data) {
+	return Result::Success();
+}
+
+Result BinaryWriter::writeDialogStart(const Data::DialogInfo &data) {
+	Expects(_output != nullptr);
+	Expects(!_dialogStarted);
+
+	auto dialog = DialogIndex();
+	dialog.peerId = data.peerId;
+	dialog.type = data.type;
+	dialog.name = data.name;
+	dialog.isLeftChannel = data.isLeftChannel;
+	dialog.start = _offset;
+	_dialogs.push_back(std::move(dialog));
+	_dialogStarted = true;
+
+	auto serialized = QByteArray();
+	AppendNumber(serialized, data.peerId);
+	AppendNumber(serialized, uint64(data.type));
+	AppendString(serialized, data.name);
+	AppendString(serialized, data.lastName);
+	AppendNumber(serialized, data.isLeftChannel ? 1 : 0);
+
+	auto block = QByteArray();
+	AppendRecord(block, RecordType::DialogStart, serialized);
+	return writeBlock(block);
+}
+
+Result BinaryWriter::writeDialogSlice(const Data::MessagesSlice &data) {
+	Expects(_output != nullptr);
+	Expects(_dialogStarted);
+
+	auto &dialog = _dialogs.back();
+	auto block = QByteArray();
+	for (const auto &[peerId, peer] : data.peers) {
+		if (_peerOffsets.emplace(peerId, _offset + block.size()).second) {
+			AppendRecord(block, RecordType::Peer, SerializePeer(peer));
+		}
+	}
+	for (const auto &message : data.list) {
+		if (Data::SkipMessageByDate(message, _settings)) {
+			continue;
+		}
+		if (!(dialog.count % kIndexStep)) {
+			dialog.marks.push_back({
+				message.date,
+				message.id,
+				_offset + block.size() });
+		}
+		if (!dialog.count || message.date < dialog.minDate) {
+			dialog.minDate = message.date;
+		}
+		if (!dialog.count || message.date > dialog.maxDate) {
+			dialog.maxDate = message.date;
+		}
+		++dialog.count;
+		AppendRecord(block, RecordType::Message, SerializeMessage(message));
+	}
+	return block.isEmpty() ? Result::Success() : writeBlock(block);
+}
+
+Result BinaryWriter::writeDialogEnd() {
+	Expects(_output != nullptr);
+	Expects(_dialogStarted);
+
+	_dialogStarted = false;
+	_dialogs.back().end = _offset;
+
+	auto block = QByteArray();
+	AppendRecord(block, RecordType::DialogEnd, QByteArray());
+	return writeBlock(block);
+}
+
+Result BinaryWriter::writeDialogsEnd() {
+	return Result::Success();
+}
+
+QByteArray BinaryWriter::serializeIndex() const {
+	auto result = QByteArray();
+	AppendNumber(result, _dialogs.size());
+	for (const auto &dialog : _dialogs) {
+		AppendNumber(result, dialog.peerId);
+		AppendNumber(result, uint64(dialog.type));
+		AppendString(result, dialog.name);
+		AppendNumber(result, dialog.isLeftChannel ? 1 : 0);
+		AppendNumber(result, dialog.start);
+		AppendNumber(result, dialog.end);
+		AppendNumber(result, dialog.count);
+		AppendSigned(result, dialog.minDate);
+		AppendSigned(result, dialog.maxDate);
+		AppendNumber(result, dialog.marks.size());
+		for (const auto &mark : dialog.marks) {
+			AppendSigned(result, mark.date);
+			AppendSigned(result, mark.messageId);
+			AppendNumber(result, mark.offset);
+		}
+	}
+	AppendNumber(result, _peerOffsets.size());
+	for (const auto &[peerId, offset] : _peerOffsets) {
+		AppendNumber(result, peerId);
+		AppendNumber(result, offset);
+	}
+	return result;
+}
+
+Result BinaryWriter::finish() {
+	Expects(_output != nullptr);
+	Expects(!_dialogStarted);
+
+	const auto index = qToLittleEndian(quint64(_offset));
+	auto block = QByteArray();
+	AppendRecord(block, RecordType::Index, serializeIndex());
+	block.append(reinterpret_cast<const char*>(&index), sizeof(index));
+	block.append("TDEI");
+	return writeBlock(block);
+}
+
+QString BinaryWriter::mainFilePath() {
+	return pathWithRelativePath(mainFileRelativePath());
+}
+
+QString BinaryWriter::mainFileRelativePath() const {
+	return "result.tdexport";
+}
+
+QString BinaryWriter::pathWithRelativePath(const QString &path) const {
+	return _settings.path + path;
+}
+
+Result BinaryWriter::writeBlock(const QByteArray &block) {
+	Expects(_output != nullptr);
+
+	const auto result = _output->writeBlock(block);
+	if (result) {
+		_offset += block.size();
+	}
+	return result;
+}
+
+} // namespace Output
+} // namespace Export
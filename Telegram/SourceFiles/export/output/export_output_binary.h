@@ -0,0 +1,101 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+#include "export/output/export_output_abstract.h"
+#include "export/output/export_output_file.h"
+#include "export/export_settings.h"
+#include "export/data/export_data_types.h"
+#include "base/flat_map.h"
+
+namespace Export {
+namespace Output {
+
+// The whole export is written to a single file as a sequence of
+// length-prefixed records, followed by an index of dialogs by date
+// and of peer records by peer id.
+//
+// File: "TDEB", version, records..., index offset (8 bytes), "TDEI".
+// Record: varint type, varint payload size, payload.
+//
+// Sizes, counts, peer ids and enum values in payloads are varints, while
+// dates, user / message ids and other signed numbers are zigzag-encoded
+// varints. Strings are a varint size followed by UTF-8 bytes.
+class BinaryWriter : public AbstractWriter {
+public:
+	Format format() override {
+		return Format::Binary;
+	}
+
+	Result start(
+		const Settings &settings,
+		const Environment &environment,
+		Stats *stats) override;
+
+	Result writePersonal(const Data::PersonalInfo &data) override;
+
+	Result writeUserpicsStart(const Data::UserpicsInfo &data) override;
+	Result writeUserpicsSlice(const Data::UserpicsSlice &data) override;
+	Result writeUserpicsEnd() override;
+
+	Result writeContactsList(const Data::ContactsList &data) override;
+
+	Result writeSessionsList(const Data::SessionsList &data) override;
+
+	Result writeOtherData(const Data::File &data) override;
+
+	Result writeDialogsStart(const Data::DialogsInfo &data) override;
+	Result writeDialogStart(const Data::DialogInfo &data) override;
+	Result writeDialogSlice(const Data::MessagesSlice &data) override;
+	Result writeDialogEnd() override;
+	Result writeDialogsEnd() override;
+
+	Result finish() override;
+
+	QString mainFilePath() override;
+
+private:
+	struct IndexMark {
+		TimeId date = 0;
+		int32 messageId = 0;
+		int64 offset = 0;
+	};
+	struct DialogIndex {
+		Data::PeerId peerId = 0;
+		Data::DialogInfo::Type type = Data::DialogInfo::Type::Unknown;
+		Data::Utf8String name;
+		bool isLeftChannel = false;
+		int64 start = 0;
+		int64 end = 0;
+		int count = 0;
+		TimeId minDate = 0;
+		TimeId maxDate = 0;
+		std::vector<IndexMark> marks;
+	};
+
+	[[nodiscard]] QString mainFileRelativePath() const;
+	[[nodiscard]] QString pathWithRelativePath(const QString &path) const;
+
+	[[nodiscard]] Result writeBlock(const QByteArray &block);
+	[[nodiscard]] QByteArray serializeIndex() const;
+
+	Settings _settings;
+	Environment _environment;
+	Stats *_stats = nullptr;
+
+	std::unique_ptr<File> _output;
+	int64 _offset = 0;
+
+	base::flat_map<Data::PeerId, int64> _peerOffsets;
+	std::vector<DialogIndex> _dialogs;
+	bool _dialogStarted = false;
+
+};
+
+} // namespace Output
+} // namespace Export
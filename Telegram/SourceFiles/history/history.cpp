@@ -19,6 +19,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "data/data_channel_admins.h"
 #include "data/data_scheduled_messages.h"
 #include "data/data_folder.h"
+#include "data/data_history_cache.h"
 #include "data/data_photo.h"
 #include "data/data_channel.h"
 #include "data/data_chat.h"
@@ -61,6 +62,7 @@ constexpr auto kStatusShowClientsidePlayGame = 10000;
 constexpr auto kSetMyActionForMs = 10000;
 constexpr auto kNewBlockEachMessage = 50;
 constexpr auto kSkipCloudDraftsFor = TimeId(3);
+constexpr auto kLazyResizeScreensAround = 2;
 
 } // namespace
 
@@ -2844,6 +2846,9 @@ void History::resizeToWidth(int newWidth) {
 		return;
 	}
 	_flags &= ~(Flag::f_has_pending_resized_items);
+	if (resizeAllItems) {
+		_flags &= ~(Flag::f_has_lazy_resized_items);
+	}
 
 	_width = newWidth;
 	int y = 0;
@@ -2854,6 +2859,101 @@ void History::resizeToWidth(int newWidth) {
 	_height = y;
 }
 
+void History::resizeToWidthLazy(int newWidth, int visibleHeight) {
+	if (visibleHeight <= 0 && _width == newWidth) {
+		// The history could be hidden before all the lazy resized
+		// elements got their heights for this width, finish them now.
+		resizeLazyItems(std::numeric_limits<crl::time>::max(), 0);
+	}
+	if (!_width || _width == newWidth || visibleHeight <= 0) {
+		resizeToWidth(newWidth);
+		return;
+	}
+	_width = newWidth;
+	_flags |= Flag::f_has_lazy_resized_items;
+	resizeLazyItemsAround(visibleHeight);
+
+	// Recount the positions, resizing only the pending elements.
+	setHasPendingResizedItems();
+	resizeToWidth(newWidth);
+}
+
+bool History::hasLazyResizedItems() const {
+	return _flags & Flag::f_has_lazy_resized_items;
+}
+
+bool History::resizeLazyItems(crl::time deadline, int visibleHeight) {
+	if (!hasLazyResizedItems()) {
+		return false;
+	}
+	// Positions should be recounted by resizeToWidth() after that.
+	setHasPendingResizedItems();
+	resizeLazyItemsAround(visibleHeight);
+
+	// Newer messages are more likely to be viewed, start from them.
+	for (auto b = int(blocks.size()); b != 0;) {
+		const auto &block = blocks[--b];
+		for (auto i = int(block->messages.size()); i != 0;) {
+			const auto view = block->messages[--i].get();
+			if (view->width() == _width) {
+				continue;
+			}
+			view->resizeGetHeight(_width);
+			if (crl::now() >= deadline) {
+				return true;
+			}
+		}
+	}
+	_flags &= ~(Flag::f_has_lazy_resized_items);
+	return false;
+}
+
+void History::resizeLazyItemsAround(int visibleHeight) {
+	if (isEmpty()) {
+		return;
+	}
+	const auto resize = [&](not_null<Element*> view) {
+		if (view->width() != _width) {
+			view->resizeGetHeight(_width);
+		}
+		return view->height();
+	};
+	const auto margin = visibleHeight * kLazyResizeScreensAround;
+
+	// Without scrollTopItem we're at the bottom of the history.
+	const auto from = scrollTopItem
+		? scrollTopItem
+		: blocks.back()->messages.back().get();
+	const auto fromBlock = from->block()->indexInHistory();
+	const auto fromIndex = from->indexInBlock();
+	const auto belowLimit = scrollTopItem ? (visibleHeight + margin) : 0;
+	const auto aboveLimit = scrollTopItem ? margin : (visibleHeight + margin);
+
+	auto below = 0;
+	for (auto b = fromBlock
+		; b != int(blocks.size()) && below < belowLimit
+		; ++b) {
+		const auto &messages = blocks[b]->messages;
+		for (auto i = (b == fromBlock) ? fromIndex : 0
+			; i != int(messages.size()) && below < belowLimit
+			; ++i) {
+			below += resize(messages[i].get());
+		}
+	}
+	auto above = 0;
+	for (auto b = fromBlock + 1; b != 0 && above < aboveLimit;) {
+		const auto &messages = blocks[--b]->messages;
+		auto i = (b != fromBlock)
+			? int(messages.size())
+			: scrollTopItem
+			? fromIndex
+			: (fromIndex + 1);
+		while (i != 0 && above < aboveLimit) {
+			above += resize(messages[--i].get());
+		}
+	}
+}
+
 void History::forceFullResize() {
 	_width = 0;
 	_flags |= Flag::f_has_pending_resized_items;
@@ -3140,6 +3240,7 @@ void History::clear(ClearType type) {
 			item->destroy();
 		}
 		_notifications.clear();
+		owner().historyCache().remove(this);
 		owner().notifyHistoryCleared(this);
 		if (unreadCountKnown()) {
 			setUnreadCount(0);
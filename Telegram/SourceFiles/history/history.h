@@ -240,6 +240,16 @@ public:
 	HistoryItem *lastSentMessage() const;
 
 	void resizeToWidth(int newWidth);
+
+	// If the width has changed only the elements around scrollTopItem
+	// are resized right away, others keep their previous heights as an
+	// estimate until resizeLazyItems() gets to them.
+	void resizeToWidthLazy(int newWidth, int visibleHeight);
+	[[nodiscard]] bool hasLazyResizedItems() const;
+
+	// Returns true if there are still elements left to resize.
+	bool resizeLazyItems(crl::time deadline, int visibleHeight);
+
 	void forceFullResize();
 	int height() const;
 
@@ -403,6 +413,7 @@ private:
 
 	enum class Flag {
 		f_has_pending_resized_items = (1 << 0),
+		f_has_lazy_resized_items = (1 << 1),
 	};
 	using Flags = base::flags<Flag>;
 	friend inline constexpr auto is_flag_type(Flag) {
@@ -418,6 +429,8 @@ private:
 	// helper method for countScrollState(int top)
 	void countScrollTopItem(int top);
 
+	void resizeLazyItemsAround(int visibleHeight);
+
 	// this method just removes a block from the blocks list
 	// when the last item from this block was detached and
 	// calls the required previousItemChanged()
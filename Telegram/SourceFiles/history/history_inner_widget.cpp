@@ -2066,7 +2066,7 @@ void HistoryInner::checkHistoryActivation() {
 	session().data().histories().readInboxTill(view->data());
 }
 
-void HistoryInner::recountHistoryGeometry() {
+void HistoryInner::recountHistoryGeometry(bool lazy) {
 	_contentWidth = _scroll->width();
 
 	const auto visibleHeight = _scroll->height();
@@ -2075,9 +2075,11 @@ void HistoryInner::recountHistoryGeometry() {
 		accumulate_max(oldHistoryPaddingTop, st::msgMargin.top() + st::msgMargin.bottom() + st::msgPadding.top() + st::msgPadding.bottom() + st::msgNameFont->height + st::botDescSkip + _botAbout->height);
 	}
 
-	_history->resizeToWidth(_contentWidth);
+	// In lazy mode elements far from the viewport keep their heights.
+	const auto lazyHeight = lazy ? visibleHeight : 0;
+	_history->resizeToWidthLazy(_contentWidth, lazyHeight);
 	if (_migrated) {
-		_migrated->resizeToWidth(_contentWidth);
+		_migrated->resizeToWidthLazy(_contentWidth, lazyHeight);
 	}
 
 	// With migrated history we perhaps do not need to display
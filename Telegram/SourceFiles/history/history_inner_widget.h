@@ -63,7 +63,7 @@ public:
 	void touchScrollUpdated(const QPoint &screenPos);
 
 	void checkHistoryActivation();
-	void recountHistoryGeometry();
+	void recountHistoryGeometry(bool lazy = false);
 	void updateSize();
 
 	void repaintItem(const HistoryItem *item);
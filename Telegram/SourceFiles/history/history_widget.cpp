@@ -42,6 +42,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "data/data_scheduled_messages.h"
 #include "data/data_file_origin.h"
 #include "data/data_histories.h"
+#include "data/data_history_cache.h"
 #include "history/history.h"
 #include "history/history_item.h"
 #include "history/history_message.h"
@@ -129,6 +130,8 @@ constexpr auto kSaveDraftAnywayTimeout = 5000;
 constexpr auto kSaveCloudDraftIdleTimeout = 14000;
 constexpr auto kRecordingUpdateDelta = crl::time(100);
 constexpr auto kRefreshSlowmodeLabelTimeout = crl::time(200);
+constexpr auto kLazyResizeDelay = crl::time(16);
+constexpr auto kLazyResizeDuration = crl::time(8);
 constexpr auto kCommonModifiers = 0
 	| Qt::ShiftModifier
 	| Qt::MetaModifier
@@ -244,6 +247,38 @@ void ShowErrorToast(const QString &text) {
 	Ui::Toast::Show(config);
 }
 
+// Users and chats stored with the cached slice may be outdated,
+// so only the ones we don't know yet are applied from it.
+void ProcessUnknownPeers(
+		not_null<Data::Session*> owner,
+		const MTPVector<MTPUser> &users,
+		const MTPVector<MTPChat> &chats) {
+	auto unknownUsers = QVector<MTPUser>();
+	for (const auto &user : users.v) {
+		const auto id = user.match([](const auto &data) {
+			return peerFromUser(data.vid());
+		});
+		if (!owner->peerLoaded(id)) {
+			unknownUsers.push_back(user);
+		}
+	}
+	auto unknownChats = QVector<MTPChat>();
+	for (const auto &chat : chats.v) {
+		const auto id = chat.match([](const MTPDchannel &data) {
+			return peerFromChannel(data.vid());
+		}, [](const MTPDchannelForbidden &data) {
+			return peerFromChannel(data.vid());
+		}, [](const auto &data) {
+			return peerFromChat(data.vid());
+		});
+		if (!owner->peerLoaded(id)) {
+			unknownChats.push_back(chat);
+		}
+	}
+	owner->processUsers(MTP_vector<MTPUser>(unknownUsers));
+	owner->processChats(MTP_vector<MTPChat>(unknownChats));
+}
+
 } // namespace
 
 HistoryWidget::HistoryWidget(
@@ -253,6 +288,7 @@ HistoryWidget::HistoryWidget(
 , _updateEditTimeLeftDisplay([=] { updateField(); })
 , _fieldBarCancel(this, st::historyReplyCancel)
 , _previewTimer([=] { requestPreview(); })
+, _lazyResizeTimer([=] { resizeLazyItems(); })
 , _topBar(this, controller)
 , _scroll(this, st::historyScroll, false)
 , _historyDown(_scroll, st::historyToDown)
@@ -1945,6 +1981,11 @@ void HistoryWidget::clearAllLoadRequests() {
 		histories.cancelRequest(_firstLoadRequest);
 		_firstLoadRequest = 0;
 	}
+	if (_cacheReconcileRequest) {
+		histories.cancelRequest(_cacheReconcileRequest);
+		_cacheReconcileRequest = 0;
+		dropCachedMessages(_history);
+	}
 	if (_preloadRequest) {
 		histories.cancelRequest(_preloadRequest);
 		_preloadRequest = 0;
@@ -2375,6 +2416,10 @@ bool HistoryWidget::messagesFailed(const RPCError &error, int requestId) {
 	} else if (_firstLoadRequest == requestId) {
 		_firstLoadRequest = 0;
 		controller()->showBackFromStack();
+	} else if (_cacheReconcileRequest == requestId) {
+		_cacheReconcileRequest = 0;
+		dropCachedMessages(_history);
+		controller()->showBackFromStack();
 	} else if (_delayedShowAtRequest == requestId) {
 		_delayedShowAtRequest = 0;
 	}
@@ -2392,6 +2437,9 @@ void HistoryWidget::messagesReceived(PeerData *peer, const MTPmessages_Messages
 			_preloadDownRequest = 0;
 		} else if (_firstLoadRequest == requestId) {
 			_firstLoadRequest = 0;
+		} else if (_cacheReconcileRequest == requestId) {
+			_cacheReconcileRequest = 0;
+			dropCachedMessages(peer->owner().history(peer));
 		} else if (_delayedShowAtRequest == requestId) {
 			_delayedShowAtRequest = 0;
 		}
@@ -2476,6 +2524,9 @@ void HistoryWidget::messagesReceived(PeerData *peer, const MTPmessages_Messages
 		}
 
 		historyLoaded();
+	} else if (_cacheReconcileRequest == requestId) {
+		_cacheReconcileRequest = 0;
+		reconcileCachedMessages(peer, *histList);
 	} else if (_delayedShowAtRequest == requestId) {
 		if (toMigrated) {
 			_history->clear(History::ClearType::Unload);
@@ -2565,6 +2616,7 @@ bool HistoryWidget::doWeReadMentions() const {
 		&& _list
 		&& _historyInited
 		&& !_firstLoadRequest
+		&& !_cacheReconcileRequest
 		&& !_delayedShowAtRequest
 		&& !_a_show.animating()
 		&& App::wnd()->doWeMarkAsRead();
@@ -2577,7 +2629,7 @@ void HistoryWidget::checkHistoryActivation() {
 }
 
 void HistoryWidget::firstLoadMessages() {
-	if (!_history || _firstLoadRequest) {
+	if (!_history || _firstLoadRequest || _cacheReconcileRequest) {
 		return;
 	}
 
@@ -2622,8 +2674,14 @@ void HistoryWidget::firstLoadMessages() {
 	auto historyHash = 0;
 
 	const auto history = from;
+	const auto fromEnd = (history == _history) && !offsetId && !offset;
 	const auto type = Data::Histories::RequestType::History;
 	auto &histories = history->owner().histories();
+
+	// If the cached slice was shown the request becomes a reconcile one.
+	const auto requestId = [=] {
+		return _firstLoadRequest ? _firstLoadRequest : _cacheReconcileRequest;
+	};
 	_firstLoadRequest = histories.sendRequest(history, type, [=](Fn<void()> finish) {
 		return history->session().api().request(MTPmessages_GetHistory(
 			history->peer->input,
@@ -2634,14 +2692,88 @@ void HistoryWidget::firstLoadMessages() {
 			MTP_int(maxId),
 			MTP_int(minId),
 			MTP_int(historyHash)
-		)).done([=](const MTPmessages_Messages &result) {
-			messagesReceived(history->peer, result, _firstLoadRequest);
+		)).parseInBackground(
+		).done([=](const MTPmessages_Messages &result) {
+			if (fromEnd) {
+				history->owner().historyCache().save(history, result);
+			}
+			messagesReceived(history->peer, result, requestId());
 			finish();
 		}).fail([=](const RPCError &error) {
-			messagesFailed(error, _firstLoadRequest);
+			messagesFailed(error, requestId());
 			finish();
 		}).send();
 	});
+	if (fromEnd && _history->isEmpty()) {
+		const auto firstLoadRequest = _firstLoadRequest;
+		history->owner().historyCache().load(history, crl::guard(this, [=](
+				MTPmessages_Messages &&result) {
+			cachedMessagesReceived(history, result, firstLoadRequest);
+		}));
+	}
+}
+
+void HistoryWidget::cachedMessagesReceived(
+		not_null<History*> history,
+		const MTPmessages_Messages &messages,
+		int requestId) {
+	if (_history != history
+		|| _firstLoadRequest != requestId
+		|| !_history->isEmpty()
+		|| (_migrated && !_migrated->isEmpty())) {
+		return;
+	}
+	const auto owner = &history->owner();
+	const auto list = messages.match([](
+			const MTPDmessages_messagesNotModified &) {
+		return QVector<MTPMessage>();
+	}, [&](const auto &data) {
+		ProcessUnknownPeers(owner, data.vusers(), data.vchats());
+		return data.vmessages().v;
+	});
+	if (list.isEmpty()) {
+		return;
+	}
+
+	// Remember the items created from the cache, they'll be replaced
+	// by the server ones when the first load request is finished.
+	_cachedSliceItems.clear();
+	for (const auto &message : list) {
+		const auto id = FullMsgId(
+			history->channelId(),
+			IdFromMessage(message));
+		if (!owner->message(id)) {
+			_cachedSliceItems.push_back(id);
+		}
+	}
+	addMessagesToFront(history->peer, list);
+	if (_history->isEmpty()) {
+		_cachedSliceItems.clear();
+		return;
+	}
+	_cacheReconcileRequest = base::take(_firstLoadRequest);
+	historyLoaded();
+}
+
+void HistoryWidget::reconcileCachedMessages(
+		PeerData *peer,
+		const QVector<MTPMessage> &messages) {
+	dropCachedMessages(_history);
+	_firstLoadRequest = -1; // hack - don't updateListSize yet
+	addMessagesToFront(peer, messages);
+	_firstLoadRequest = 0;
+
+	_historyInited = false;
+	doneShow();
+}
+
+void HistoryWidget::dropCachedMessages(not_null<History*> history) {
+	history->clear(History::ClearType::Unload);
+	for (const auto &id : base::take(_cachedSliceItems)) {
+		if (const auto item = history->owner().message(id)) {
+			item->destroy();
+		}
+	}
 }
 
 void HistoryWidget::loadMessages() {
@@ -2685,7 +2817,8 @@ void HistoryWidget::loadMessages() {
 			MTP_int(maxId),
 			MTP_int(minId),
 			MTP_int(historyHash)
-		)).done([=](const MTPmessages_Messages &result) {
+		)).parseInBackground(
+		).done([=](const MTPmessages_Messages &result) {
 			messagesReceived(history->peer, result, _preloadRequest);
 			finish();
 		}).fail([=](const RPCError &error) {
@@ -2736,7 +2869,8 @@ void HistoryWidget::loadMessagesDown() {
 			MTP_int(maxId),
 			MTP_int(minId),
 			MTP_int(historyHash)
-		)).done([=](const MTPmessages_Messages &result) {
+		)).parseInBackground(
+		).done([=](const MTPmessages_Messages &result) {
 			messagesReceived(history->peer, result, _preloadDownRequest);
 			finish();
 		}).fail([=](const RPCError &error) {
@@ -2800,7 +2934,8 @@ void HistoryWidget::delayedShowAt(MsgId showAtMsgId) {
 			MTP_int(maxId),
 			MTP_int(minId),
 			MTP_int(historyHash)
-		)).done([=](const MTPmessages_Messages &result) {
+		)).parseInBackground(
+		).done([=](const MTPmessages_Messages &result) {
 			messagesReceived(history->peer, result, _delayedShowAtRequest);
 			finish();
 		}).fail([=](const RPCError &error) {
@@ -2868,6 +3003,7 @@ void HistoryWidget::preloadHistoryIfNeeded() {
 
 void HistoryWidget::preloadHistoryByScroll() {
 	if (_firstLoadRequest
+		|| _cacheReconcileRequest
 		|| _delayedShowAtRequest
 		|| _scroll->isHidden()
 		|| !_peer
@@ -5287,7 +5423,12 @@ void HistoryWidget::updateHistoryGeometry(
 }
 
 void HistoryWidget::updateListSize() {
-	_list->recountHistoryGeometry();
+	// After the initial layout the scroll is anchored to scrollTopItem,
+	// so elements far from it may be resized later.
+	_list->recountHistoryGeometry(_historyInited);
+	if (hasLazyResizedItems() && !_lazyResizeTimer.isActive()) {
+		_lazyResizeTimer.callOnce(kLazyResizeDelay);
+	}
 	auto washidden = _scroll->isHidden();
 	if (washidden) {
 		_scroll->show();
@@ -5304,6 +5445,29 @@ bool HistoryWidget::hasPendingResizedItems() const {
 		|| (_migrated && _migrated->hasPendingResizedItems());
 }
 
+bool HistoryWidget::hasLazyResizedItems() const {
+	return (_history && _history->hasLazyResizedItems())
+		|| (_migrated && _migrated->hasLazyResizedItems());
+}
+
+void HistoryWidget::resizeLazyItems() {
+	if (!_list || !_historyInited || !hasLazyResizedItems()) {
+		return;
+	}
+	const auto deadline = crl::now() + kLazyResizeDuration;
+	const auto visibleHeight = _scroll->height();
+	_history->resizeLazyItems(deadline, visibleHeight);
+	if (_migrated) {
+		_migrated->resizeLazyItems(deadline, visibleHeight);
+	}
+
+	// The scroll stays at the same scrollTopItem with the same offset.
+	updateHistoryGeometry();
+	if (hasLazyResizedItems() && !_lazyResizeTimer.isActive()) {
+		_lazyResizeTimer.callOnce(kLazyResizeDelay);
+	}
+}
+
 std::optional<int> HistoryWidget::unreadBarTop() const {
 	const auto bar = [&]() -> HistoryView::Element* {
 		if (const auto bar = _migrated ? _migrated->unreadBar() : nullptr) {
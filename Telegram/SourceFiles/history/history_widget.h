@@ -571,6 +571,14 @@ private:
 	void gotPreview(QString links, const MTPMessageMedia &media, mtpRequestId req);
 	void messagesReceived(PeerData *peer, const MTPmessages_Messages &messages, int requestId);
 	bool messagesFailed(const RPCError &error, int requestId);
+	void cachedMessagesReceived(
+		not_null<History*> history,
+		const MTPmessages_Messages &messages,
+		int requestId);
+	void reconcileCachedMessages(
+		PeerData *peer,
+		const QVector<MTPMessage> &messages);
+	void dropCachedMessages(not_null<History*> history);
 	void addMessagesToFront(PeerData *peer, const QVector<MTPMessage> &messages);
 	void addMessagesToBack(PeerData *peer, const QVector<MTPMessage> &messages);
 
@@ -582,6 +590,8 @@ private:
 
 	// Does any of the shown histories has this flag set.
 	bool hasPendingResizedItems() const;
+	bool hasLazyResizedItems() const;
+	void resizeLazyItems();
 
 	// Counts scrollTop for placing the scroll right at the unread
 	// messages bar, choosing from _history and _migrated unreadBar.
@@ -671,6 +681,7 @@ private:
 	Ui::Text::String _previewTitle;
 	Ui::Text::String _previewDescription;
 	base::Timer _previewTimer;
+	base::Timer _lazyResizeTimer;
 	bool _previewCancelled = false;
 
 	bool _replyForwardPressed = false;
@@ -685,9 +696,13 @@ private:
 	MsgId _showAtMsgId = ShowAtUnreadMsgId;
 
 	int _firstLoadRequest = 0; // Not real mtpRequestId.
+	int _cacheReconcileRequest = 0; // Not real mtpRequestId.
 	int _preloadRequest = 0; // Not real mtpRequestId.
 	int _preloadDownRequest = 0; // Not real mtpRequestId.
 
+	// Items created from the cached slice, shown until the server answers.
+	std::vector<FullMsgId> _cachedSliceItems;
+
 	MsgId _delayedShowAtMsgId = -1;
 	int _delayedShowAtRequest = 0; // Not real mtpRequestId.
 
@@ -11,8 +11,15 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "core/crash_reports.h"
 #include "core/launcher.h"
 
+#include <thread>
+#include <condition_variable>
+
 namespace {
 
+// Debug log lines are written to the disk in batches by a separate thread.
+constexpr auto kDebugFlushTimeout = std::chrono::milliseconds(500);
+constexpr auto kDebugWakeSize = 256 * 1024;
+
 std::atomic<int> ThreadCounter/* = 0*/;
 
 } // namespace
@@ -67,6 +74,18 @@ public:
 		}
 	}
 
+	~LogsDataFields() {
+		auto lock = std::unique_lock<std::mutex>(queueMutex);
+		if (!writer.joinable()) {
+			return;
+		}
+		stopping = true;
+		lock.unlock();
+
+		queueCondition.notify_one();
+		writer.join();
+	}
+
 	bool openMain() {
 		return reopen(LogDataMain, 0, qsl("start"));
 	}
@@ -97,10 +116,11 @@ public:
 	}
 
 	void write(LogDataType type, const QString &msg) {
-		QMutexLocker lock(_logsMutex(type));
 		if (type != LogDataMain) {
-			reopenDebug();
+			enqueue(type, msg);
+			return;
 		}
+		QMutexLocker lock(_logsMutex(type));
 		const auto file = files[type].get();
 		if (!file || !file->isOpen()) {
 			return;
@@ -109,9 +129,94 @@ public:
 		file->flush();
 	}
 
+	// Called from the crash handler, so it doesn't wait for any locks.
+	void flushOnCrash() {
+		if (!queueMutex.try_lock()) {
+			return;
+		}
+		auto lines = base::take(queue);
+		queueSize = 0;
+		queueMutex.unlock();
+
+		const auto mutex = _logsMutex(LogDataDebug);
+		if (mutex->tryLock()) {
+			writeDebugLines(lines);
+			mutex->unlock();
+		}
+	}
+
 private:
+	struct Line {
+		LogDataType type = LogDataDebug;
+		QString text;
+	};
+
+	void enqueue(LogDataType type, const QString &msg) {
+		auto lock = std::unique_lock<std::mutex>(queueMutex);
+		if (stopping) {
+			return;
+		} else if (!writer.joinable()) {
+			writer = std::thread([=] { writerLoop(); });
+		}
+		queue.push_back({ type, msg });
+		queueSize += msg.size();
+		if (queueSize < kDebugWakeSize) {
+			return;
+		}
+		lock.unlock();
+		queueCondition.notify_one();
+	}
+
+	void writerLoop() {
+		auto lines = std::vector<Line>();
+		auto finished = false;
+		while (!finished) {
+			auto lock = std::unique_lock<std::mutex>(queueMutex);
+			if (!stopping && queueSize < kDebugWakeSize) {
+				queueCondition.wait_for(lock, kDebugFlushTimeout);
+			}
+			std::swap(lines, queue);
+			queueSize = 0;
+			finished = stopping;
+			lock.unlock();
+
+			QMutexLocker filesLock(_logsMutex(LogDataDebug));
+			writeDebugLines(lines);
+			lines.clear();
+		}
+	}
+
+	// Requires _logsMutex(LogDataDebug) to be locked.
+	void writeDebugLines(const std::vector<Line> &lines) {
+		if (lines.empty()) {
+			return;
+		}
+		reopenDebug();
+
+		auto written = std::array<bool, LogDataCount>{ { false } };
+		for (const auto &line : lines) {
+			const auto file = files[line.type].get();
+			if (file && file->isOpen()) {
+				file->write(line.text.toUtf8());
+				written[line.type] = true;
+			}
+		}
+		for (auto i = 0; i != LogDataCount; ++i) {
+			if (written[i]) {
+				files[i]->flush();
+			}
+		}
+	}
+
 	std::unique_ptr<QFile> files[LogDataCount];
 
+	std::mutex queueMutex;
+	std::condition_variable queueCondition;
+	std::vector<Line> queue;
+	int queueSize = 0;
+	bool stopping = false;
+	std::thread writer;
+
 	int32 part = -1;
 
 	bool reopen(LogDataType type, int32 dayIndex, const QString &postfix) {
@@ -524,6 +629,12 @@ void closeMain() {
 	}
 }
 
+void flushOnCrash() {
+	if (LogsData) {
+		LogsData->flushOnCrash();
+	}
+}
+
 void writeMain(const QString &v) {
 	time_t t = time(NULL);
 	struct tm tm;
@@ -30,6 +30,9 @@ void multipleInstances();
 
 void closeMain();
 
+// Writes the debug log lines that are still waiting in the queue.
+void flushOnCrash();
+
 void writeMain(const QString &v);
 
 void writeDebug(const char *file, int32 line, const QString &v);
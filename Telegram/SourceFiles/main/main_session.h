@@ -30,6 +30,7 @@ class Session;
 
 namespace Storage {
 class DownloadManagerMtproto;
+class FileWriter;
 class Uploader;
 class Facade;
 } // namespace Storage
@@ -83,6 +84,9 @@ public:
 	[[nodiscard]] Storage::DownloadManagerMtproto &downloader() {
 		return *_downloader;
 	}
+	[[nodiscard]] Storage::FileWriter &fileWriter() {
+		return *_fileWriter;
+	}
 	[[nodiscard]] Storage::Uploader &uploader() {
 		return *_uploader;
 	}
@@ -147,6 +151,7 @@ private:
 	const std::unique_ptr<ApiWrap> _api;
 	const std::unique_ptr<Calls::Instance> _calls;
 	const std::unique_ptr<Storage::DownloadManagerMtproto> _downloader;
+	const std::unique_ptr<Storage::FileWriter> _fileWriter;
 	const std::unique_ptr<Storage::Uploader> _uploader;
 	const std::unique_ptr<Storage::Facade> _storage;
 	const std::unique_ptr<Window::Notifications::System> _notifications;
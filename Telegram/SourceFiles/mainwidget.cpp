@@ -2933,6 +2933,7 @@ void MainWidget::gotChannelDifference(
 
 void MainWidget::feedChannelDifference(
 		const MTPDupdates_channelDifference &data) {
+	session().data().startUpdatesBatch();
 	session().data().processUsers(data.vusers());
 	session().data().processChats(data.vchats());
 
@@ -2943,6 +2944,7 @@ void MainWidget::feedChannelDifference(
 		NewMessageType::Unread);
 	feedUpdateVector(data.vother_updates(), true);
 	_handlingChannelDifference = false;
+	session().data().finishUpdatesBatch();
 }
 
 bool MainWidget::failChannelDifference(ChannelData *channel, const RPCError &error) {
@@ -3084,11 +3086,13 @@ void MainWidget::feedDifference(
 		const MTPVector<MTPMessage> &msgs,
 		const MTPVector<MTPUpdate> &other) {
 	session().checkAutoLock();
+	session().data().startUpdatesBatch();
 	session().data().processUsers(users);
 	session().data().processChats(chats);
 	feedMessageIds(other);
 	session().data().processMessages(msgs, NewMessageType::Unread);
 	feedUpdateVector(other, true);
+	session().data().finishUpdatesBatch();
 }
 
 bool MainWidget::failDifference(const RPCError &error) {
@@ -3173,7 +3177,7 @@ void MainWidget::getDifference() {
 			MTPint(),
 			MTP_int(updDate),
 			MTP_int(updQts)),
-		rpcDone(&MainWidget::gotDifference),
+		rpcParseInBackground(rpcDone(&MainWidget::gotDifference)),
 		rpcFail(&MainWidget::failDifference));
 }
 
@@ -3206,7 +3210,8 @@ void MainWidget::getChannelDifference(ChannelData *channel, ChannelDifferenceReq
 			filter,
 			MTP_int(channel->pts()),
 			MTP_int(kChannelGetDifferenceLimit)),
-		rpcDone(&MainWidget::gotChannelDifference, channel),
+		rpcParseInBackground(
+			rpcDone(&MainWidget::gotChannelDifference, channel)),
 		rpcFail(&MainWidget::failChannelDifference, channel));
 }
 
@@ -3710,9 +3715,11 @@ void MainWidget::feedUpdates(const MTPUpdates &updates, uint64 randomId) {
 			}
 		}
 
+		session().data().startUpdatesBatch();
 		session().data().processUsers(d.vusers());
 		session().data().processChats(d.vchats());
 		feedUpdateVector(d.vupdates());
+		session().data().finishUpdatesBatch();
 
 		updSetState(0, d.vdate().v, updQts, d.vseq().v);
 	} break;
@@ -3730,9 +3737,11 @@ void MainWidget::feedUpdates(const MTPUpdates &updates, uint64 randomId) {
 			}
 		}
 
+		session().data().startUpdatesBatch();
 		session().data().processUsers(d.vusers());
 		session().data().processChats(d.vchats());
 		feedUpdateVector(d.vupdates());
+		session().data().finishUpdatesBatch();
 
 		updSetState(0, d.vdate().v, updQts, d.vseq().v);
 	} break;
@@ -27,6 +27,11 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 
 #include <numeric>
 
+#if defined __SSE2__ || defined _M_X64 || (defined _M_IX86_FP && _M_IX86_FP >= 2)
+#define TDESKTOP_AUDIO_SSE2
+#include <emmintrin.h>
+#endif // __SSE2__ || _M_X64 || _M_IX86_FP >= 2
+
 Q_DECLARE_METATYPE(AudioMsgId);
 Q_DECLARE_METATYPE(VoiceWaveform);
 
@@ -43,6 +48,58 @@ ALCcontext *AudioContext = nullptr;
 auto VolumeMultiplierAll = 1.;
 auto VolumeMultiplierSong = 1.;
 
+// Same as accumulating ReadOneSample() of each sample with accumulate_max.
+uint16 MaxSample(gsl::span<const uchar> samples) {
+	auto min = uchar(0x80);
+	auto max = uchar(0x80);
+	for (const auto sample : samples) {
+		accumulate_min(min, sample);
+		accumulate_max(max, sample);
+	}
+	return std::max(
+		Media::Audio::ReadOneSample(min),
+		Media::Audio::ReadOneSample(max));
+}
+
+uint16 MaxSample(gsl::span<const int16> samples) {
+	const auto data = samples.data();
+	const auto count = int(samples.size());
+	auto result = uint16(0);
+	auto i = 0;
+#ifdef TDESKTOP_AUDIO_SSE2
+	// qAbs(int16(-0x8000)) gives 0x8000 as uint16, and so does this.
+	// Flip the sign bits to compare the unsigned values as signed ones.
+	const auto zero = _mm_setzero_si128();
+	const auto sign = _mm_set1_epi16(int16(0x8000));
+	auto max = sign;
+	const auto abs = [&](int index) {
+		const auto value = _mm_loadu_si128(
+			reinterpret_cast<const __m128i*>(data + index));
+		return _mm_xor_si128(
+			_mm_max_epi16(value, _mm_sub_epi16(zero, value)),
+			sign);
+	};
+	for (; i + 32 <= count; i += 32) {
+		max = _mm_max_epi16(
+			_mm_max_epi16(
+				_mm_max_epi16(max, abs(i)),
+				abs(i + 8)),
+			_mm_max_epi16(abs(i + 16), abs(i + 24)));
+	}
+	for (; i + 8 <= count; i += 8) {
+		max = _mm_max_epi16(max, abs(i));
+	}
+	max = _mm_max_epi16(max, _mm_srli_si128(max, 8));
+	max = _mm_max_epi16(max, _mm_srli_si128(max, 4));
+	max = _mm_max_epi16(max, _mm_srli_si128(max, 2));
+	result = uint16(_mm_cvtsi128_si32(max)) ^ uint16(0x8000);
+#endif // TDESKTOP_AUDIO_SSE2
+	for (; i < count; ++i) {
+		accumulate_max(result, Media::Audio::ReadOneSample(data[i]));
+	}
+	return result;
+}
+
 // Value for AL_PITCH_SHIFTER_COARSE_TUNE effect, 0.5 <= speed <= 2.
 int CoarseTuneForSpeed(float64 speed) {
 	Expects(speed >= 0.5 && speed <= 2.);
@@ -1674,15 +1731,24 @@ public:
 		QVector<uint16> peaks;
 		peaks.reserve(Media::Player::kWaveformSamplesCount);
 
+		// Each sample adds kWaveformSamplesCount to sumbytes and each
+		// countbytes of them give one peak, so we find the peak of all
+		// the samples till the next boundary at once.
 		auto fmt = format();
 		auto peak = uint16(0);
-		auto callback = [&](uint16 sample) {
-			accumulate_max(peak, sample);
-			sumbytes += Media::Player::kWaveformSamplesCount;
-			if (sumbytes >= countbytes) {
-				sumbytes -= countbytes;
-				peaks.push_back(peak);
-				peak = 0;
+		const auto accumulate = [&](auto samples) {
+			constexpr auto kStep = int64(Media::Player::kWaveformSamplesCount);
+			while (!samples.empty()) {
+				const auto tillPeak = (countbytes - sumbytes + kStep - 1) / kStep;
+				const auto count = std::min(int64(samples.size()), tillPeak);
+				accumulate_max(peak, MaxSample(samples.subspan(0, count)));
+				samples = samples.subspan(count);
+				sumbytes += count * kStep;
+				if (sumbytes >= countbytes) {
+					sumbytes -= countbytes;
+					peaks.push_back(peak);
+					peak = 0;
+				}
 			}
 		};
 		while (processed < countbytes) {
@@ -1697,11 +1763,16 @@ public:
 				continue;
 			}
 
-			auto sampleBytes = bytes::make_span(buffer);
+			const auto data = buffer.constData();
+			const auto size = buffer.size();
 			if (fmt == AL_FORMAT_MONO8 || fmt == AL_FORMAT_STEREO8) {
-				Media::Audio::IterateSamples<uchar>(sampleBytes, callback);
+				accumulate(gsl::make_span(
+					reinterpret_cast<const uchar*>(data),
+					size));
 			} else if (fmt == AL_FORMAT_MONO16 || fmt == AL_FORMAT_STEREO16) {
-				Media::Audio::IterateSamples<int16>(sampleBytes, callback);
+				accumulate(gsl::make_span(
+					reinterpret_cast<const int16*>(data),
+					size / int(sizeof(int16))));
 			}
 			processed += sampleSize() * samples;
 		}
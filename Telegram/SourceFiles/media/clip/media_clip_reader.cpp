@@ -29,9 +29,20 @@ namespace Media {
 namespace Clip {
 namespace {
 
+// A frame processed later than that is counted as late and lets
+// the idle threads steal readers from the thread that is late.
+constexpr auto kLateFrameDelay = crl::time(20);
+
+// A thread that sleeps at least that long is idle and may steal readers.
+constexpr auto kStealIdleTimeout = crl::time(20);
+
 QVector<QThread*> threads;
 QVector<Manager*> managers;
 
+// Managers looked up by the clip threads themselves, while the
+// 'managers' vector above is accessed only from the main thread.
+std::array<std::atomic<Manager*>, ClipThreadsCount> Registered;
+
 QImage PrepareFrameImage(const FrameRequest &request, const QImage &original, bool hasAlpha, QImage &cache) {
 	auto needResize = (original.width() != request.framew) || (original.height() != request.frameh);
 	auto needOuterFill = (request.outerw != request.framew) || (request.outerh != request.frameh);
@@ -110,23 +121,26 @@ Reader::Reader(const QByteArray &data, Callback &&callback, Mode mode, crl::time
 }
 
 void Reader::init(const FileLocation &location, const QByteArray &data) {
+	auto index = 0;
 	if (threads.size() < ClipThreadsCount) {
-		_threadIndex = threads.size();
+		index = threads.size();
 		threads.push_back(new QThread());
-		managers.push_back(new Manager(threads.back()));
+		managers.push_back(new Manager(threads.back(), index));
+		Registered[index] = managers.back();
 		threads.back()->start();
 	} else {
-		_threadIndex = int32(rand_value<uint32>() % threads.size());
+		index = int32(rand_value<uint32>() % threads.size());
 		int32 loadLevel = 0x7FFFFFFF;
 		for (int32 i = 0, l = threads.size(); i < l; ++i) {
 			int32 level = managers.at(i)->loadLevel();
 			if (level < loadLevel) {
-				_threadIndex = i;
+				index = i;
 				loadLevel = level;
 			}
 		}
 	}
-	managers.at(_threadIndex)->append(this, location, data);
+	_threadIndex.storeRelease(index);
+	managers.at(index)->append(this, location, data);
 }
 
 Reader::Frame *Reader::frameToShow(int32 *index) const { // 0 means not ready
@@ -200,13 +214,24 @@ void Reader::moveToNextWrite() const {
 
 void Reader::callback(Reader *reader, qint32 threadIndex, qint32 notification) {
 	// Check if reader is not deleted already
-	if (managers.size() > threadIndex && managers.at(threadIndex)->carries(reader) && reader->_callback) {
+	const auto carried = [&] {
+		if (managers.size() > threadIndex
+			&& managers.at(threadIndex)->carries(reader)) {
+			return true;
+		}
+		// The reader could be stolen by another thread after the
+		// notification was sent, so we can't rely on threadIndex here.
+		return ranges::any_of(managers, [&](Manager *manager) {
+			return manager->carries(reader);
+		});
+	}();
+	if (carried && reader->_callback) {
 		reader->_callback(Notification(notification));
 	}
 }
 
 void Reader::start(int32 framew, int32 frameh, int32 outerw, int32 outerh, ImageRoundRadius radius, RectParts corners) {
-	if (managers.size() <= _threadIndex) error();
+	if (managers.size() <= threadIndex()) error();
 	if (_state == State::Error) return;
 
 	if (_step.loadAcquire() == WaitingForRequestStep) {
@@ -221,7 +246,7 @@ void Reader::start(int32 framew, int32 frameh, int32 outerw, int32 outerh, Image
 		request.corners = corners;
 		_frames[0].request = _frames[1].request = _frames[2].request = request;
 		moveToNextShow();
-		managers.at(_threadIndex)->start(this);
+		managers.at(threadIndex())->start(this);
 	}
 }
 
@@ -237,9 +262,9 @@ QPixmap Reader::current(int32 framew, int32 frameh, int32 outerw, int32 outerh,
 		frame->displayed.storeRelease(1);
 		if (_autoPausedGif.loadAcquire()) {
 			_autoPausedGif.storeRelease(0);
-			if (managers.size() <= _threadIndex) error();
+			if (managers.size() <= threadIndex()) error();
 			if (_state != State::Error) {
-				managers.at(_threadIndex)->update(this);
+				managers.at(threadIndex())->update(this);
 			}
 		}
 	} else {
@@ -270,9 +295,9 @@ QPixmap Reader::current(int32 framew, int32 frameh, int32 outerw, int32 outerh,
 
 	moveToNextShow();
 
-	if (managers.size() <= _threadIndex) error();
+	if (managers.size() <= threadIndex()) error();
 	if (_state != State::Error) {
-		managers.at(_threadIndex)->update(this);
+		managers.at(threadIndex())->update(this);
 	}
 
 	return frame->pix;
@@ -317,11 +342,11 @@ crl::time Reader::getDurationMs() const {
 }
 
 void Reader::pauseResumeVideo() {
-	if (managers.size() <= _threadIndex) error();
+	if (managers.size() <= threadIndex()) error();
 	if (_state == State::Error) return;
 
 	_videoPauseRequest.storeRelease(1 - _videoPauseRequest.loadAcquire());
-	managers.at(_threadIndex)->start(this);
+	managers.at(threadIndex())->start(this);
 }
 
 bool Reader::videoPaused() const {
@@ -341,9 +366,9 @@ State Reader::state() const {
 }
 
 void Reader::stop() {
-	if (managers.size() <= _threadIndex) error();
+	if (managers.size() <= threadIndex()) error();
 	if (_state != State::Error) {
-		managers.at(_threadIndex)->stop(this);
+		managers.at(threadIndex())->stop(this);
 		_width = _height = 0;
 	}
 }
@@ -609,7 +634,7 @@ private:
 
 };
 
-Manager::Manager(QThread *thread) {
+Manager::Manager(QThread *thread, int index) : _index(index) {
 	moveToThread(thread);
 	connect(thread, SIGNAL(started()), this, SLOT(process()));
 	connect(thread, SIGNAL(finished()), this, SLOT(finish()));
@@ -638,6 +663,12 @@ void Manager::start(Reader *reader) {
 
 void Manager::update(Reader *reader) {
 	QMutexLocker lock(&_readerPointersMutex);
+	if (const auto index = reader->threadIndex(); index != _index) {
+		// The reader was stolen by another thread.
+		lock.unlock();
+		managers.at(index)->update(reader);
+		return;
+	}
 	auto i = _readerPointers.find(reader);
 	if (i == _readerPointers.cend()) {
 		_readerPointers.insert(reader, QAtomicInt(1));
@@ -648,10 +679,14 @@ void Manager::update(Reader *reader) {
 }
 
 void Manager::stop(Reader *reader) {
-	if (!carries(reader)) return;
-
 	QMutexLocker lock(&_readerPointersMutex);
-	_readerPointers.remove(reader);
+	if (const auto index = reader->threadIndex(); index != _index) {
+		lock.unlock();
+		managers.at(index)->stop(reader);
+		return;
+	}
+	if (!_readerPointers.remove(reader)) return;
+
 	emit processDelayed();
 }
 
@@ -764,12 +799,111 @@ Manager::ResultHandleState Manager::handleResult(ReaderPrivate *reader, ProcessR
 				reader->_frame = index;
 			}
 		}
+		++_framesDecoded;
 		return handleResult(reader, reader->finishProcess(ms), ms);
 	}
 
 	return ResultHandleContinue;
 }
 
+ThreadStats Manager::stats() const {
+	auto result = ThreadStats();
+	result.activeReaders = _activeReaders.load();
+	result.loadLevel = _loadLevel.load();
+	result.lateFrames = _lateFrames.load();
+	result.framesDecoded = _framesDecoded.load();
+	result.framesLate = _framesLate.load();
+	result.readersStolen = _readersStolen.load();
+	result.readersGiven = _readersGiven.load();
+	return result;
+}
+
+bool Manager::canStealFrom(not_null<const Manager*> other) const {
+	return (other != this)
+		&& (other->_activeReaders.load() > _activeReaders.load() + 1);
+}
+
+void Manager::requestSteal() {
+	auto victim = (Manager*)nullptr;
+	auto victimLate = 0;
+	for (const auto &registered : Registered) {
+		const auto manager = registered.load();
+		if (!manager || !canStealFrom(manager)) {
+			continue;
+		}
+		const auto late = manager->_lateFrames.load();
+		if (late > victimLate) {
+			victim = manager;
+			victimLate = late;
+		}
+	}
+	if (victim) {
+		auto none = -1;
+		victim->_stealRequest.compare_exchange_strong(none, _index);
+	}
+}
+
+void Manager::wakeIdle() {
+	if (_stealRequest.load() >= 0) {
+		return;
+	}
+	for (const auto &registered : Registered) {
+		const auto manager = registered.load();
+		if (manager
+			&& manager->canStealFrom(this)
+			&& manager->_idle.exchange(false)) {
+			emit manager->processDelayed();
+		}
+	}
+}
+
+Manager *Manager::takeThief() {
+	const auto index = _stealRequest.exchange(-1);
+	if (index < 0) {
+		return nullptr;
+	}
+	const auto thief = Registered[index].load();
+	return (thief && thief->canStealFrom(this)) ? thief : nullptr;
+}
+
+bool Manager::giveReader(ReaderPrivate *reader, not_null<Manager*> thief) {
+	// Always lock the mutexes in the same order.
+	const auto firstIsOurs = (_index < thief->_index);
+	QMutexLocker first(firstIsOurs
+		? &_readerPointersMutex
+		: &thief->_readerPointersMutex);
+	QMutexLocker second(firstIsOurs
+		? &thief->_readerPointersMutex
+		: &_readerPointersMutex);
+
+	auto it = unsafeFindReaderPointer(reader);
+	if (it == _readerPointers.cend()) {
+		// Stopped already, it will be destroyed right here.
+		return false;
+	}
+	const auto interface = it.key();
+	thief->_readerPointers.insert(interface, QAtomicInt(it->loadAcquire()));
+	_readerPointers.erase(it);
+	thief->_incoming.push_back(reader);
+	interface->_threadIndex.storeRelease(thief->_index);
+
+	const auto load = (reader->_width > 0)
+		? (reader->_width * reader->_height)
+		: AverageGifSize;
+	_loadLevel.fetchAndAddRelaxed(-load);
+	thief->_loadLevel.fetchAndAddRelaxed(load);
+	--_activeReaders;
+	++thief->_activeReaders;
+	++_readersGiven;
+	++thief->_readersStolen;
+
+	DEBUG_LOG(("Clip Info: reader stolen from thread %1 by thread %2."
+		).arg(_index
+		).arg(thief->_index));
+	emit thief->processDelayed();
+	return true;
+}
+
 void Manager::process() {
 	if (_processingInThread) {
 		_needReProcess = true;
@@ -783,6 +917,9 @@ void Manager::process() {
 	auto ms = crl::now(), minms = ms + 86400 * crl::time(1000);
 	{
 		QMutexLocker lock(&_readerPointersMutex);
+		for (const auto reader : base::take(_incoming)) {
+			_readers.insert(reader, 0);
+		}
 		for (auto it = _readerPointers.begin(), e = _readerPointers.end(); it != e; ++it) {
 			if (it->loadAcquire() && it.key()->_private != nullptr) {
 				auto i = _readers.find(it.key()->_private);
@@ -807,9 +944,20 @@ void Manager::process() {
 		checkAllReaders = (_readers.size() > _readerPointers.size());
 	}
 
+	auto active = 0;
+	auto late = 0;
 	for (auto i = _readers.begin(), e = _readers.end(); i != e;) {
 		ReaderPrivate *reader = i.key();
 		if (i.value() <= ms) {
+			if (const auto thief = takeThief()) {
+				if (giveReader(reader, thief)) {
+					i = _readers.erase(i);
+					continue;
+				}
+			}
+			if (i.value() > 0 && ms - i.value() > kLateFrameDelay) {
+				++late;
+			}
 			ResultHandleState state = handleResult(reader, reader->process(ms), ms);
 			if (state == ResultHandleRemove) {
 				i = _readers.erase(i);
@@ -836,19 +984,32 @@ void Manager::process() {
 				continue;
 			}
 		}
+		if (!reader->_autoPausedGif && !reader->_videoPausedAtMs) {
+			++active;
+		}
 		if (!reader->_autoPausedGif && i.value() < minms) {
 			minms = i.value();
 		}
 		++i;
 	}
+	_activeReaders = active;
+	_lateFrames = late;
+	_framesLate += late;
 
 	ms = crl::now();
 	if (_needReProcess || minms <= ms) {
 		_needReProcess = false;
+		_idle = false;
 		_timer.start(1);
 	} else {
+		_idle = (minms - ms >= kStealIdleTimeout);
 		_timer.start(minms - ms);
 	}
+	if (late > 0) {
+		wakeIdle();
+	} else if (_idle) {
+		requestSteal();
+	}
 
 	_processingInThread = nullptr;
 }
@@ -865,6 +1026,9 @@ void Manager::clear() {
 			it.key()->_private = nullptr;
 		}
 		_readerPointers.clear();
+		for (const auto reader : base::take(_incoming)) {
+			delete reader;
+		}
 	}
 
 	for (Readers::iterator i = _readers.begin(), e = _readers.end(); i != e; ++i) {
@@ -919,12 +1083,36 @@ FileMediaInformation::Video PrepareForSending(const QString &fname, const QByteA
 	return result;
 }
 
+std::vector<ThreadStats> GetThreadsStats() {
+	return ranges::view::all(
+		managers
+	) | ranges::view::transform([](Manager *manager) {
+		return manager->stats();
+	}) | ranges::to_vector;
+}
+
 void Finish() {
 	if (!threads.isEmpty()) {
+		for (int32 i = 0, l = threads.size(); i < l; ++i) {
+			const auto stats = managers.at(i)->stats();
+			DEBUG_LOG(("Clip Info: thread %1 decoded %2 frames, %3 late, "
+				"stole %4 readers, gave %5 readers."
+				).arg(i
+				).arg(stats.framesDecoded
+				).arg(stats.framesLate
+				).arg(stats.readersStolen
+				).arg(stats.readersGiven));
+		}
+
+		// Stop all the threads before destroying any of the managers,
+		// because the threads may give readers to each other.
 		for (int32 i = 0, l = threads.size(); i < l; ++i) {
 			threads.at(i)->quit();
 			DEBUG_LOG(("Waiting for clipThread to finish: %1").arg(i));
 			threads.at(i)->wait();
+		}
+		for (int32 i = 0, l = threads.size(); i < l; ++i) {
+			Registered[i] = nullptr;
 			delete managers.at(i);
 			delete threads.at(i);
 		}
@@ -97,7 +97,7 @@ public:
 	}
 	bool videoPaused() const;
 	int threadIndex() const {
-		return _threadIndex;
+		return _threadIndex.loadAcquire();
 	}
 
 	int width() const;
@@ -166,7 +166,10 @@ private:
 
 	QAtomicInt _autoPausedGif = 0;
 	QAtomicInt _videoPauseRequest = 0;
-	int32 _threadIndex;
+
+	// Changed only by the clip threads when they steal the reader,
+	// under the locks of both the old and the new Manager.
+	QAtomicInt _threadIndex = 0;
 
 	bool _autoplay = false;
 
@@ -244,15 +247,30 @@ enum class ProcessResult {
 	Wait,
 };
 
+struct ThreadStats {
+	int activeReaders = 0;
+	int loadLevel = 0;
+	int lateFrames = 0; // In the last pass over the readers.
+	int64 framesDecoded = 0;
+	int64 framesLate = 0;
+	int readersStolen = 0;
+	int readersGiven = 0;
+};
+
+// Idle threads steal due readers from the threads that are late with
+// their frames: the idle thread leaves a steal request and the busy one
+// gives it the next due reader, so each ReaderPrivate is always touched
+// by a single thread.
 class Manager : public QObject {
 	Q_OBJECT
 
 public:
 
-	Manager(QThread *thread);
+	Manager(QThread *thread, int index);
 	int32 loadLevel() const {
 		return _loadLevel.load();
 	}
+	[[nodiscard]] ThreadStats stats() const;
 	void append(Reader *reader, const FileLocation &location, const QByteArray &data);
 	void start(Reader *reader);
 	void update(Reader *reader);
@@ -273,9 +291,17 @@ private:
 
 	void clear();
 
+	[[nodiscard]] bool canStealFrom(not_null<const Manager*> other) const;
+	void requestSteal();
+	void wakeIdle();
+	[[nodiscard]] Manager *takeThief();
+	bool giveReader(ReaderPrivate *reader, not_null<Manager*> thief);
+
+	const int _index = 0;
 	QAtomicInt _loadLevel;
 	using ReaderPointers = QMap<Reader*, QAtomicInt>;
 	ReaderPointers _readerPointers;
+	std::vector<ReaderPrivate*> _incoming; // Stolen from other threads.
 	mutable QMutex _readerPointersMutex;
 
 	ReaderPointers::const_iterator constUnsafeFindReaderPointer(ReaderPrivate *reader) const;
@@ -297,8 +323,20 @@ private:
 	QThread *_processingInThread = nullptr;
 	bool _needReProcess = false;
 
+	std::atomic<int> _stealRequest = -1; // Index of the thief thread.
+	std::atomic<bool> _idle = false;
+	std::atomic<int> _activeReaders = 0;
+	std::atomic<int> _lateFrames = 0;
+	std::atomic<int64> _framesDecoded = 0;
+	std::atomic<int64> _framesLate = 0;
+	std::atomic<int> _readersStolen = 0;
+	std::atomic<int> _readersGiven = 0;
+
 };
 
+// Per-thread load counters, for diagnostics, main thread only.
+[[nodiscard]] std::vector<ThreadStats> GetThreadsStats();
+
 FileMediaInformation::Video PrepareForSending(const QString &fname, const QByteArray &data);
 
 void Finish();
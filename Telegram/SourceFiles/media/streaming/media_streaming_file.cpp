@@ -17,6 +17,47 @@ namespace {
 
 constexpr auto kMaxSingleReadAmount = 8 * 1024 * 1024;
 constexpr auto kMaxQueuedPackets = 1024;
+constexpr auto kSeekIndexMinDelta = crl::time(1000);
+
+[[nodiscard]] int64 ComputeBitrate(
+		not_null<AVFormatContext*> format,
+		int size) {
+	if (format->bit_rate > 0) {
+		return format->bit_rate;
+	} else if (format->duration > 0) {
+		return int64(size) * 8 * AV_TIME_BASE / format->duration;
+	}
+	return 0;
+}
+
+[[nodiscard]] SeekIndex ComputeSeekIndex(
+		not_null<AVFormatContext*> format,
+		const Stream &stream) {
+	const auto info = format->streams[stream.index];
+	auto result = SeekIndex();
+	for (auto i = 0; i != info->nb_index_entries; ++i) {
+		const auto &entry = info->index_entries[i];
+		if (!(entry.flags & AVINDEX_KEYFRAME)
+			|| entry.pos < 0
+			|| entry.pos > std::numeric_limits<int>::max()) {
+			continue;
+		}
+		const auto position = FFmpeg::PtsToTime(
+			entry.timestamp,
+			stream.timeBase);
+		if (position < 0
+			|| position > std::numeric_limits<int32>::max()
+			|| (!result.empty()
+				&& position < result.back().position + kSeekIndexMinDelta)) {
+			continue;
+		}
+		result.push_back({ position, int(entry.pos) });
+		if (int(result.size()) == kMaxSeekIndexEntries) {
+			break;
+		}
+	}
+	return result;
+}
 
 } // namespace
 
@@ -236,6 +277,7 @@ void File::Context::start(crl::time position) {
 	if (unroll()) {
 		return;
 	}
+	_reader->seekHint(position);
 	auto format = FFmpeg::MakeFormatPointer(
 		static_cast<void *>(this),
 		&Context::Read,
@@ -260,11 +302,14 @@ void File::Context::start(crl::time position) {
 	}
 
 	_reader->headerDone();
+	_reader->setBitrate(ComputeBitrate(format.get(), _size));
 	if (_reader->isRemoteLoader()) {
 		sendFullInCache(true);
 	}
 	if (video.codec || audio.codec) {
-		seekToPosition(format.get(), video.codec ? video : audio, position);
+		const auto &stream = video.codec ? video : audio;
+		seekToPosition(format.get(), stream, position);
+		_reader->setSeekIndex(ComputeSeekIndex(format.get(), stream));
 	}
 	if (unroll()) {
 		return;
@@ -435,6 +480,10 @@ void File::setLoaderPriority(int priority) {
 	_reader->setLoaderPriority(priority);
 }
 
+void File::setSpeed(float64 speed) {
+	_reader->setPlaybackSpeed(speed);
+}
+
 File::~File() {
 	stop();
 }
@@ -38,6 +38,7 @@ public:
 
 	[[nodiscard]] bool isRemoteLoader() const;
 	void setLoaderPriority(int priority);
+	void setSpeed(float64 speed);
 
 	~File();
 
@@ -122,11 +122,14 @@ bool LoaderMtproto::readyToRequest() const {
 	return !_requested.empty();
 }
 
-int LoaderMtproto::takeNextRequestOffset() {
+auto LoaderMtproto::takeNextRequest(int maxPartSize) -> PartRequest {
+	// Reader works with fixed kPartSize parts, they can't be joined.
+	Expects(maxPartSize >= kPartSize);
+
 	const auto offset = _requested.take();
 
 	Ensures(offset.has_value());
-	return *offset;
+	return { *offset, kPartSize };
 }
 
 bool LoaderMtproto::feedPart(int offset, const QByteArray &bytes) {
@@ -44,7 +44,7 @@ public:
 
 private:
 	bool readyToRequest() const override;
-	int takeNextRequestOffset() override;
+	PartRequest takeNextRequest(int maxPartSize) override;
 	bool feedPart(int offset, const QByteArray &bytes) override;
 	void cancelOnFail() override;
 
@@ -543,6 +543,7 @@ void Player::play(const PlaybackOptions &options) {
 		_options.speed = 1.;
 	}
 	_stage = Stage::Initializing;
+	_file->setSpeed(_options.speed);
 	_file->start(delegate(), _options.position);
 }
 
@@ -834,6 +835,7 @@ void Player::setSpeed(float64 speed) {
 	}
 	if (_options.speed != speed) {
 		_options.speed = speed;
+		_file->setSpeed(speed);
 		if (active()) {
 			if (_audio) {
 				_audio->setSpeed(speed);
@@ -23,10 +23,27 @@ constexpr auto kMaxOnlyInHeader = 80 * kPartSize;
 constexpr auto kPartsOutsideFirstSliceGood = 8;
 constexpr auto kSlicesInMemory = 2;
 
-// 1 MB of parts are requested from cloud ahead of reading demand.
+// 1 MB of parts are requested from cloud ahead of reading demand,
+// while the bitrate of the file is unknown.
 constexpr auto kPreloadPartsAhead = 8;
 constexpr auto kDownloaderRequestsLimit = 4;
 
+// With a known bitrate we request that much playback time ahead
+// and keep that much playback time in memory.
+constexpr auto kPreloadAheadTime = crl::time(6000);
+constexpr auto kKeepInMemoryTime = crl::time(20000);
+constexpr auto kMinPreloadPartsAhead = 2;
+constexpr auto kMaxPreloadPartsAhead = 32;
+constexpr auto kMaxSlicesInMemory = 4;
+
+// Each stall after the header is read doubles the preload, that many times.
+constexpr auto kMaxStallsBoost = 2;
+
+// The seek index is kept in the cache right after the slices, so it is
+// cached only for files with less slices than this number (~2000 MB).
+constexpr auto kSeekIndexCacheNumber = 0xFF;
+constexpr auto kSeekIndexVersion = 1;
+
 using PartsMap = base::flat_map<int, QByteArray>;
 
 struct ParsedCacheEntry {
@@ -34,6 +51,52 @@ struct ParsedCacheEntry {
 	std::optional<PartsMap> included;
 };
 
+QByteArray SerializeSeekIndex(const SeekIndex &index) {
+	Expects(int(index.size()) <= kMaxSeekIndexEntries);
+
+	const auto count = int(index.size());
+	auto result = QByteArray(
+		(2 + 2 * count) * sizeof(int32),
+		Qt::Uninitialized);
+	auto data = reinterpret_cast<int32*>(result.data());
+	*data++ = kSeekIndexVersion;
+	*data++ = count;
+	for (const auto &entry : index) {
+		*data++ = int32(entry.position);
+		*data++ = int32(entry.offset);
+	}
+	return result;
+}
+
+SeekIndex ParseSeekIndex(bytes::const_span data, int size) {
+	if (data.size() < 2 * sizeof(int32)) {
+		return {};
+	}
+	const auto ints = reinterpret_cast<const int32*>(data.data());
+	const auto version = ints[0];
+	const auto count = ints[1];
+	if (version != kSeekIndexVersion
+		|| count <= 0
+		|| count > kMaxSeekIndexEntries
+		|| data.size() != (2 + 2 * count) * sizeof(int32)) {
+		return {};
+	}
+	auto result = SeekIndex();
+	result.reserve(count);
+	for (auto i = 0; i != count; ++i) {
+		const auto position = crl::time(ints[2 + 2 * i]);
+		const auto offset = ints[3 + 2 * i];
+		if (position < 0
+			|| offset < 0
+			|| offset >= size
+			|| (!result.empty() && result.back().position >= position)) {
+			return {};
+		}
+		result.push_back({ position, offset });
+	}
+	return result;
+}
+
 bool IsContiguousSerialization(int serializedSize, int maxSliceSize) {
 	return !(serializedSize % kPartSize) || (serializedSize == maxSliceSize);
 }
@@ -59,6 +122,10 @@ int SlicesCount(int size) {
 	return (size + kInSlice - 1) / kInSlice;
 }
 
+bool SeekIndexCacheAllowed(int size) {
+	return (SlicesCount(size) < kSeekIndexCacheNumber);
+}
+
 int MaxSliceSize(int sliceNumber, int size) {
 	return !sliceNumber
 		? size
@@ -225,6 +292,7 @@ struct Reader::CacheHelper {
 	QMutex mutex;
 	base::flat_map<int, PartsMap> results;
 	std::vector<int> sizes;
+	std::optional<SeekIndex> seekIndex;
 	std::atomic<crl::semaphore*> waiting = nullptr;
 };
 
@@ -262,14 +330,14 @@ void Reader::Slice::addPart(int offset, QByteArray bytes) {
 	}
 }
 
-auto Reader::Slice::prepareFill(int from, int till) -> PrepareFillResult {
+auto Reader::Slice::prepareFill(int from, int till, int preloadParts)
+-> PrepareFillResult {
 	auto result = PrepareFillResult();
 
 	result.ready = false;
 	const auto fromOffset = (from / kPartSize) * kPartSize;
 	const auto tillPart = (till + kPartSize - 1) / kPartSize;
-	const auto preloadTillOffset = (tillPart + kPreloadPartsAhead)
-		* kPartSize;
+	const auto preloadTillOffset = (tillPart + preloadParts) * kPartSize;
 
 	const auto after = ranges::upper_bound(
 		parts,
@@ -310,6 +378,8 @@ auto Reader::Slice::prepareFill(int from, int till) -> PrepareFillResult {
 
 auto Reader::Slice::offsetsFromLoader(int from, int till) const
 -> StackIntVector<Reader::kLoadFromRemoteMax> {
+	static_assert(kMaxPreloadPartsAhead + 2 <= kLoadFromRemoteMax);
+
 	auto result = StackIntVector<kLoadFromRemoteMax>();
 
 	const auto after = ranges::upper_bound(
@@ -333,7 +403,9 @@ auto Reader::Slice::offsetsFromLoader(int from, int till) const
 }
 
 Reader::Slices::Slices(int size, bool useCache)
-: _size(size) {
+: _size(size)
+, _preloadParts(kPreloadPartsAhead)
+, _slicesInMemory(kSlicesInMemory) {
 	Expects(size > 0);
 
 	if (useCache) {
@@ -362,6 +434,14 @@ bool Reader::Slices::computeIsGoodHeader() const {
 	return ComputeIsGoodHeader(_size, _header.parts);
 }
 
+void Reader::Slices::setReadAhead(int preloadParts, int slicesInMemory) {
+	Expects(preloadParts > 0);
+	Expects(slicesInMemory > 0);
+
+	_preloadParts = preloadParts;
+	_slicesInMemory = slicesInMemory;
+}
+
 void Reader::Slices::headerDone(bool fromCache) {
 	if (_headerMode != HeaderMode::Unknown) {
 		return;
@@ -595,9 +675,15 @@ auto Reader::Slices::fill(int offset, bytes::span buffer) -> FillResult {
 	const auto firstTill = std::min(kInSlice, till - fromSlice * kInSlice);
 	const auto secondFrom = 0;
 	const auto secondTill = till - (fromSlice + 1) * kInSlice;
-	const auto first = _data[fromSlice].prepareFill(firstFrom, firstTill);
+	const auto first = _data[fromSlice].prepareFill(
+		firstFrom,
+		firstTill,
+		_preloadParts);
 	const auto second = (fromSlice + 1 < tillSlice)
-		? _data[fromSlice + 1].prepareFill(secondFrom, secondTill)
+		? _data[fromSlice + 1].prepareFill(
+			secondFrom,
+			secondTill,
+			_preloadParts)
 		: Slice::PrepareFillResult();
 	handlePrepareResult(fromSlice, first);
 	if (fromSlice + 1 < tillSlice) {
@@ -629,13 +715,46 @@ auto Reader::Slices::fill(int offset, bytes::span buffer) -> FillResult {
 	return result;
 }
 
+auto Reader::Slices::prepareFillAt(int offset) -> FillResult {
+	Expects(offset >= 0 && offset < _size);
+
+	using Flag = Slice::Flag;
+
+	auto result = FillResult();
+	if (isFullInHeader()
+		|| (_headerMode != HeaderMode::NoCache
+			&& !(_header.flags & Flag::LoadedFromCache))) {
+		return result;
+	}
+	const auto index = offset / kInSlice;
+	auto &slice = _data[index];
+	if ((_headerMode != HeaderMode::NoCache)
+		&& (_headerMode != HeaderMode::Unknown)
+		&& !(slice.flags & Flag::LoadedFromCache)) {
+		if (!(slice.flags & Flag::LoadingFromCache)) {
+			slice.flags |= Flag::LoadingFromCache;
+			result.sliceNumbersFromCache.add(index + 1);
+		}
+		return result;
+	}
+	const auto from = offset - index * kInSlice;
+	const auto prepared = slice.prepareFill(from, from + 1, _preloadParts);
+	for (const auto offset : prepared.offsetsFromLoader.values()) {
+		const auto full = offset + index * kInSlice;
+		if (offset < kInSlice && full < _size) {
+			result.offsetsFromLoader.add(full);
+		}
+	}
+	return result;
+}
+
 auto Reader::Slices::fillFromHeader(int offset, bytes::span buffer)
 -> FillResult {
 	auto result = FillResult();
 	const auto from = offset;
 	const auto till = int(offset + buffer.size());
 
-	const auto prepared = _header.prepareFill(from, till);
+	const auto prepared = _header.prepareFill(from, till, _preloadParts);
 	for (const auto full : prepared.offsetsFromLoader.values()) {
 		if (full < _size) {
 			result.offsetsFromLoader.add(full);
@@ -703,7 +822,7 @@ Reader::SerializedSlice Reader::Slices::serializeAndUnloadUnused() {
 	using Flag = Slice::Flag;
 
 	if (_headerMode == HeaderMode::Unknown
-		|| _usedSlices.size() <= kSlicesInMemory) {
+		|| int(_usedSlices.size()) <= _slicesInMemory) {
 		return {};
 	}
 	const auto purgeSlice = _usedSlices.front();
@@ -844,6 +963,116 @@ Reader::SerializedSlice Reader::Slices::unloadToCache() {
 	return {};
 }
 
+Reader::ReadAhead::ReadAhead()
+: _preloadParts(kPreloadPartsAhead)
+, _slicesInMemory(kSlicesInMemory) {
+}
+
+void Reader::ReadAhead::setBitrate(int64 bitrate) {
+	if (_bitrate != bitrate) {
+		_bitrate = bitrate;
+		refresh();
+	}
+}
+
+void Reader::ReadAhead::setSpeed(float64 speed) {
+	if (_speed != speed) {
+		_speed = speed;
+		refresh();
+	}
+}
+
+void Reader::ReadAhead::headerDone() {
+	_headerDone = true;
+}
+
+void Reader::ReadAhead::stalled(int offset) {
+	// We count only waits after the header was read and something after
+	// it was read as well, so that the initial loading is not a stall.
+	if (!_reading) {
+		return;
+	}
+
+	// Waits for data far from the reading position follow seeks,
+	// a bigger preload wouldn't help there.
+	const auto preloaded = _preloadParts * kPartSize;
+	if (std::abs(offset - _readTill) > preloaded) {
+		return;
+	}
+	++_stalls;
+	if (_stallsBoost < kMaxStallsBoost) {
+		++_stallsBoost;
+		refresh();
+	}
+}
+
+void Reader::ReadAhead::partLoaded(int offset, int size) {
+	if (_prefetchedUnread.emplace(offset, size).second) {
+		_prefetchedBytes += size;
+		_prefetchedUnreadBytes += size;
+	}
+}
+
+void Reader::ReadAhead::partsRead(int from, int till) {
+	if (_headerDone) {
+		_reading = true;
+	}
+	_readTill = till;
+	const auto begin = _prefetchedUnread.lower_bound(
+		(from / kPartSize) * kPartSize);
+	const auto end = _prefetchedUnread.lower_bound(till);
+	if (begin == end) {
+		return;
+	}
+	for (auto i = begin; i != end; ++i) {
+		_prefetchedUnreadBytes -= i->second;
+	}
+	_prefetchedUnread.erase(begin, end);
+}
+
+int Reader::ReadAhead::preloadParts() const {
+	return _preloadParts;
+}
+
+int Reader::ReadAhead::slicesInMemory() const {
+	return _slicesInMemory;
+}
+
+ReadAheadStats Reader::ReadAhead::stats() const {
+	auto result = ReadAheadStats();
+	result.bitrate = _bitrate;
+	result.speed = _speed;
+	result.preloadParts = _preloadParts;
+	result.slicesInMemory = _slicesInMemory;
+	result.stalls = _stalls;
+	result.prefetchedBytes = _prefetchedBytes;
+	result.prefetchedUnreadBytes = _prefetchedUnreadBytes;
+	return result;
+}
+
+void Reader::ReadAhead::refresh() {
+	if (_bitrate <= 0) {
+		_preloadParts = (kPreloadPartsAhead << _stallsBoost);
+		_slicesInMemory = kSlicesInMemory;
+	} else {
+		const auto bytesPerSecond = int64(_bitrate * _speed / 8);
+		const auto preload = bytesPerSecond * kPreloadAheadTime / 1000;
+		const auto parts = int((preload + kPartSize - 1) / kPartSize);
+		_preloadParts = std::clamp(
+			parts << _stallsBoost,
+			kMinPreloadPartsAhead,
+			kMaxPreloadPartsAhead);
+
+		// Keep the slice being read and enough slices behind it.
+		const auto keep = bytesPerSecond * kKeepInMemoryTime / 1000;
+		const auto slices = int((keep + kInSlice - 1) / kInSlice) + 1;
+		_slicesInMemory = std::clamp(
+			slices,
+			kSlicesInMemory,
+			kMaxSlicesInMemory);
+	}
+}
+
 Reader::Reader(
 	not_null<Storage::Cache::Database*> cache,
 	std::unique_ptr<Loader> loader)
@@ -867,6 +1096,9 @@ Reader::Reader(
 
 	if (_cacheHelper) {
 		readFromCache(0);
+		if (SeekIndexCacheAllowed(size())) {
+			readSeekIndexFromCache();
+		}
 	}
 }
 
@@ -1181,6 +1413,85 @@ bool Reader::readFromCacheForDownloader(int sliceNumber) {
 	return true;
 }
 
+void Reader::readSeekIndexFromCache() {
+	Expects(_cacheHelper != nullptr);
+	Expects(SeekIndexCacheAllowed(size()));
+
+	const auto size = _loader->size();
+	const auto cache = std::weak_ptr<CacheHelper>(_cacheHelper);
+	const auto key = _cacheHelper->key(kSeekIndexCacheNumber);
+	_cache->get(key, [=](QByteArray &&result) {
+		crl::async([=, result = std::move(result)] {
+			auto index = ParseSeekIndex(bytes::make_span(result), size);
+			if (const auto strong = cache.lock()) {
+				QMutexLocker lock(&strong->mutex);
+				strong->seekIndex = std::move(index);
+				if (const auto waiting = strong->waiting.load()) {
+					strong->waiting.store(nullptr, std::memory_order_release);
+					waiting->release();
+				}
+			}
+		});
+	});
+}
+
+void Reader::seekHint(crl::time position) {
+	if (position > 0 && _cacheHelper && SeekIndexCacheAllowed(size())) {
+		_seekHint = position;
+	}
+}
+
+void Reader::setSeekIndex(SeekIndex &&index) {
+	_seekHint = std::nullopt;
+	if (!_cacheHelper
+		|| !SeekIndexCacheAllowed(size())
+		|| index.empty()
+		|| index == _seekIndex) {
+		return;
+	}
+	_seekIndex = std::move(index);
+	_cache->put(
+		_cacheHelper->key(kSeekIndexCacheNumber),
+		SerializeSeekIndex(_seekIndex));
+}
+
+void Reader::checkSeekHint() {
+	if (!_seekHint
+		|| _seekIndex.empty()
+		|| _slices.headerModeUnknown()
+		|| _slices.waitingForHeaderCache()) {
+		return;
+	}
+	const auto position = *base::take(_seekHint);
+	const auto i = ranges::upper_bound(
+		_seekIndex,
+		position,
+		ranges::less(),
+		&SeekIndexEntry::position);
+	if (i == begin(_seekIndex)) {
+		return;
+	}
+	const auto offset = (i - 1)->offset;
+	if (offset >= size()) {
+		return;
+	}
+
+	// Request the slice with the keyframe from the cache or the parts
+	// with it from the loader, without reading or unloading anything.
+	const auto result = _slices.prepareFillAt(offset);
+	for (const auto sliceNumber : result.sliceNumbersFromCache.values()) {
+		readFromCache(sliceNumber);
+	}
+	auto checkPriority = true;
+	for (const auto loadOffset : result.offsetsFromLoader.values()) {
+		if (checkPriority) {
+			checkLoadWillBeFirst(loadOffset);
+			checkPriority = false;
+		}
+		loadAtOffset(loadOffset);
+	}
+}
+
 void Reader::putToCache(SerializedSlice &&slice) {
 	Expects(_cacheHelper != nullptr);
 	Expects(slice.number >= 0);
@@ -1198,6 +1509,7 @@ std::optional<Error> Reader::streamingError() const {
 
 void Reader::headerDone() {
 	_slices.headerDone(false);
+	_readAhead.headerDone();
 }
 
 int Reader::headerSize() const {
@@ -1208,6 +1520,20 @@ bool Reader::fullInCache() const {
 	return _slices.fullInCache();
 }
 
+void Reader::setBitrate(int64 bitrate) {
+	_readAhead.setBitrate(bitrate);
+	applyReadAhead();
+}
+
+ReadAheadStats Reader::readAheadStats() const {
+	QMutexLocker lock(&_readAheadStatsMutex);
+	return _readAheadStats;
+}
+
+void Reader::setPlaybackSpeed(float64 speed) {
+	_playbackSpeed.store(speed, std::memory_order_relaxed);
+}
+
 bool Reader::fill(
 		int offset,
 		bytes::span buffer,
@@ -1236,15 +1562,26 @@ bool Reader::fill(
 		return false;
 	};
 
+	_readAhead.setSpeed(_playbackSpeed.load(std::memory_order_relaxed));
+	applyReadAhead();
+
 	checkForSomethingMoreReceived();
 	if (_streamingError) {
 		return failed();
 	}
 
+	auto stalled = false;
 	do {
+		checkSeekHint();
 		if (fillFromSlices(offset, buffer)) {
+			_readAhead.partsRead(offset, offset + int(buffer.size()));
+			publishReadAheadStats();
 			clearWaiting();
 			return true;
+		} else if (!stalled) {
+			stalled = true;
+			_readAhead.stalled(offset);
+			applyReadAhead();
 		}
 		startWaiting();
 	} while (checkForSomethingMoreReceived());
@@ -1252,6 +1589,18 @@ bool Reader::fill(
 	return _streamingError ? failed() : false;
 }
 
+void Reader::applyReadAhead() {
+	_slices.setReadAhead(
+		_readAhead.preloadParts(),
+		_readAhead.slicesInMemory());
+	publishReadAheadStats();
+}
+
+void Reader::publishReadAheadStats() {
+	QMutexLocker lock(&_readAheadStatsMutex);
+	_readAheadStats = _readAhead.stats();
+}
+
 bool Reader::fillFromSlices(int offset, bytes::span buffer) {
 	using namespace rpl::mappers;
 
@@ -1310,8 +1659,13 @@ bool Reader::processCacheResults() {
 	QMutexLocker lock(&_cacheHelper->mutex);
 	auto loaded = base::take(_cacheHelper->results);
 	auto sizes = base::take(_cacheHelper->sizes);
+	auto seekIndex = base::take(_cacheHelper->seekIndex);
 	lock.unlock();
 
+	if (seekIndex && _seekIndex.empty()) {
+		_seekIndex = std::move(*seekIndex);
+	}
+
 	for (auto &[sliceNumber, cachedParts] : _downloaderReadCache) {
 		if (!cachedParts) {
 			const auto i = loaded.find(sliceNumber);
@@ -1351,6 +1705,8 @@ bool Reader::processLoadedParts() {
 			return false;
 		} else if (!_loadingOffsets.remove(part.offset)) {
 			continue;
+		} else if (!_downloaderOffsetsRequested.contains(part.offset)) {
+			_readAhead.partLoaded(part.offset, part.bytes.size());
 		}
 		_slices.processPart(
 			part.offset,
@@ -1388,6 +1744,16 @@ void Reader::finalizeCache() {
 }
 
 Reader::~Reader() {
+	const auto stats = _readAhead.stats();
+	if (stats.prefetchedBytes > 0) {
+		DEBUG_LOG(("Streaming Info: read-ahead bitrate %1, preload %2 parts, "
+			"stalls %3, prefetched %4 bytes, never read %5 bytes."
+			).arg(stats.bitrate
+			).arg(stats.preloadParts
+			).arg(stats.stalls
+			).arg(stats.prefetchedBytes
+			).arg(stats.prefetchedUnreadBytes));
+	}
 	finalizeCache();
 }
 
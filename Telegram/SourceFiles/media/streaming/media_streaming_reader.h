@@ -30,6 +30,28 @@ class Loader;
 struct LoadedPart;
 enum class Error;
 
+struct SeekIndexEntry {
+	crl::time position = 0;
+	int offset = 0;
+
+	inline bool operator==(const SeekIndexEntry &other) const {
+		return (position == other.position) && (offset == other.offset);
+	}
+};
+using SeekIndex = std::vector<SeekIndexEntry>;
+
+constexpr auto kMaxSeekIndexEntries = 8192;
+
+struct ReadAheadStats {
+	int64 bitrate = 0;
+	float64 speed = 1.;
+	int preloadParts = 0;
+	int slicesInMemory = 0;
+	int stalls = 0;
+	int64 prefetchedBytes = 0;
+	int64 prefetchedUnreadBytes = 0;
+};
+
 class Reader final : public base::has_weak_ptr {
 public:
 	// Main thread.
@@ -42,18 +64,29 @@ public:
 	// Any thread.
 	[[nodiscard]] int size() const;
 	[[nodiscard]] bool isRemoteLoader() const;
+	[[nodiscard]] ReadAheadStats readAheadStats() const;
 
-	// Single thread.
+	// Single thread, the one that reads the file through fill().
 	[[nodiscard]] bool fill(
 		int offset,
 		bytes::span buffer,
 		not_null<crl::semaphore*> notify);
 	[[nodiscard]] std::optional<Error> streamingError() const;
-	void headerDone();
 	[[nodiscard]] int headerSize() const;
 	[[nodiscard]] bool fullInCache() const;
 
+	// The same thread, when the header is parsed. They choose
+	// the read-ahead that the following fill() calls will use.
+	void headerDone();
+	void setBitrate(int64 bitrate);
+
+	// The same thread. Requests the data around the keyframe before
+	// the position as soon as the cached seek index allows to find it.
+	void seekHint(crl::time position);
+	void setSeekIndex(SeekIndex &&index);
+
 	// Thread safe.
+	void setPlaybackSpeed(float64 speed);
 	void startSleep(not_null<crl::semaphore*> wake);
 	void wakeFromSleep();
 	void stopSleep();
@@ -74,7 +107,8 @@ public:
 	~Reader();
 
 private:
-	static constexpr auto kLoadFromRemoteMax = 8;
+	// Enough for the largest read-ahead and the two parts being read.
+	static constexpr auto kLoadFromRemoteMax = 34;
 
 	struct CacheHelper;
 
@@ -123,7 +157,7 @@ private:
 
 		void processCacheData(PartsMap &&data);
 		void addPart(int offset, QByteArray bytes);
-		PrepareFillResult prepareFill(int from, int till);
+		PrepareFillResult prepareFill(int from, int till, int preloadParts);
 
 		// Get up to kLoadFromRemoteMax not loaded parts in from-till range.
 		StackIntVector<kLoadFromRemoteMax> offsetsFromLoader(
@@ -140,6 +174,7 @@ private:
 		Slices(int size, bool useCache);
 
 		void headerDone(bool fromCache);
+		void setReadAhead(int preloadParts, int slicesInMemory);
 		[[nodiscard]] int headerSize() const;
 		[[nodiscard]] bool fullInCache() const;
 		[[nodiscard]] bool headerWontBeFilled() const;
@@ -155,6 +190,10 @@ private:
 		void processPart(int offset, QByteArray &&bytes);
 
 		[[nodiscard]] FillResult fill(int offset, bytes::span buffer);
+
+		// Only the requests needed to read at offset, nothing is read.
+		[[nodiscard]] FillResult prepareFillAt(int offset);
+
 		[[nodiscard]] SerializedSlice unloadToCache();
 
 		[[nodiscard]] QByteArray partForDownloader(int offset) const;
@@ -191,10 +230,49 @@ private:
 		std::deque<int> _usedSlices;
 		int _size = 0;
 		HeaderMode _headerMode = HeaderMode::Unknown;
+		int _preloadParts = 0;
+		int _slicesInMemory = 0;
 		bool _fullInCache = false;
 
 	};
 
+	// Chooses how many parts we request ahead of the reading position
+	// and how many slices we keep in memory from the container bitrate
+	// and the playback speed, collects the prefetch statistics.
+	class ReadAhead {
+	public:
+		ReadAhead();
+
+		void setBitrate(int64 bitrate);
+		void setSpeed(float64 speed);
+		void headerDone();
+		void stalled(int offset);
+
+		void partLoaded(int offset, int size);
+		void partsRead(int from, int till);
+
+		[[nodiscard]] int preloadParts() const;
+		[[nodiscard]] int slicesInMemory() const;
+		[[nodiscard]] ReadAheadStats stats() const;
+
+	private:
+		void refresh();
+
+		int64 _bitrate = 0;
+		float64 _speed = 1.;
+		int _stallsBoost = 0;
+		int _preloadParts = 0;
+		int _slicesInMemory = 0;
+		int _stalls = 0;
+		int64 _prefetchedBytes = 0;
+		int64 _prefetchedUnreadBytes = 0;
+		base::flat_map<int, int> _prefetchedUnread;
+		int _readTill = 0;
+		bool _headerDone = false;
+		bool _reading = false;
+
+	};
+
 	// 0 is for headerData, slice index = sliceNumber - 1.
 	// returns false if asked for a known-empty downloader slice cache.
 	void readFromCache(int sliceNumber);
@@ -210,6 +288,11 @@ private:
 	bool checkForSomethingMoreReceived();
 
 	bool fillFromSlices(int offset, bytes::span buffer);
+	void applyReadAhead();
+	void publishReadAheadStats();
+
+	void readSeekIndexFromCache();
+	void checkSeekHint();
 
 	void finalizeCache();
 
@@ -239,6 +322,14 @@ private:
 	PriorityQueue _loadingOffsets;
 
 	Slices _slices;
+	ReadAhead _readAhead;
+
+	// Copy of _readAhead.stats() for other threads.
+	mutable QMutex _readAheadStatsMutex;
+	ReadAheadStats _readAheadStats;
+	std::atomic<float64> _playbackSpeed = 1.;
+	SeekIndex _seekIndex;
+	std::optional<crl::time> _seekHint;
 
 	// Even if streaming had failed, the Reader can work for the downloader.
 	std::optional<Error> _streamingError;
@@ -11,12 +11,49 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "ui/image/image_prepare.h"
 #include "ffmpeg/ffmpeg_utility.h"
 
+#if defined __SSE2__ || defined _M_X64 || (defined _M_IX86_FP && _M_IX86_FP >= 2)
+#define TDESKTOP_STREAMING_SSE2
+#include <emmintrin.h>
+#endif // __SSE2__ || _M_X64 || _M_IX86_FP >= 2
+
 namespace Media {
 namespace Streaming {
 namespace {
 
 constexpr auto kSkipInvalidDataPackets = 10;
 
+// Wipe out possible alpha values.
+void CopyLineFillAlpha(uint32 *to, const uint32 *from, int count) {
+	auto x = 0;
+#ifdef TDESKTOP_STREAMING_SSE2
+	const auto alpha = _mm_set1_epi32(int(0xFF000000U));
+	const auto load = [&](int index) {
+		return _mm_loadu_si128(reinterpret_cast<const __m128i*>(from + index));
+	};
+	const auto store = [&](int index, __m128i value) {
+		_mm_storeu_si128(
+			reinterpret_cast<__m128i*>(to + index),
+			_mm_or_si128(value, alpha));
+	};
+	for (; x + 16 <= count; x += 16) {
+		const auto a = load(x);
+		const auto b = load(x + 4);
+		const auto c = load(x + 8);
+		const auto d = load(x + 12);
+		store(x, a);
+		store(x + 4, b);
+		store(x + 8, c);
+		store(x + 12, d);
+	}
+	for (; x + 4 <= count; x += 4) {
+		store(x, load(x));
+	}
+#endif // TDESKTOP_STREAMING_SSE2
+	for (; x < count; ++x) {
+		to[x] = 0xFF000000U | from[x];
+	}
+}
+
 } // namespace
 
 crl::time FramePosition(const Stream &stream) {
@@ -133,17 +170,12 @@ QImage ConvertFrame(
 		static_assert(sizeof(uint32) == FFmpeg::kPixelBytesSize);
 		auto to = reinterpret_cast<uint32*>(storage.bits());
 		auto from = reinterpret_cast<const uint32*>(frame->data[0]);
-		const auto deltaTo = (storage.bytesPerLine() / sizeof(uint32))
-			- storage.width();
-		const auto deltaFrom = (frame->linesize[0] / sizeof(uint32))
-			- frame->width;
+		const auto perLineTo = storage.bytesPerLine() / sizeof(uint32);
+		const auto perLineFrom = frame->linesize[0] / sizeof(uint32);
 		for (const auto y : ranges::view::ints(0, frame->height)) {
-			for (const auto x : ranges::view::ints(0, frame->width)) {
-				// Wipe out possible alpha values.
-				*to++ = 0xFF000000U | *from++;
-			}
-			to += deltaTo;
-			from += deltaFrom;
+			CopyLineFillAlpha(to, from, frame->width);
+			to += perLineTo;
+			from += perLineFrom;
 		}
 	} else {
 		stream.swscale = MakeSwscalePointer(
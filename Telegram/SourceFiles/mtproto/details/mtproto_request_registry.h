@@ -0,0 +1,93 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+#include <unordered_map>
+
+namespace MTP::details {
+
+// Request ids are consecutive, so requests handled by different session
+// threads at the same time almost always land in different shards.
+inline constexpr auto kRequestRegistryShards = 16;
+
+template <typename Value>
+class RequestRegistry final {
+public:
+	void set(mtpRequestId requestId, Value value) {
+		auto &shard = shardFor(requestId);
+		QMutexLocker lock(&shard.mutex);
+		shard.values[requestId] = std::move(value);
+	}
+	bool emplace(mtpRequestId requestId, Value value) {
+		auto &shard = shardFor(requestId);
+		QMutexLocker lock(&shard.mutex);
+		return shard.values.emplace(requestId, std::move(value)).second;
+	}
+	[[nodiscard]] std::optional<Value> find(mtpRequestId requestId) const {
+		const auto &shard = shardFor(requestId);
+		QMutexLocker lock(&shard.mutex);
+		const auto i = shard.values.find(requestId);
+		return (i != end(shard.values))
+			? std::make_optional(i->second)
+			: std::nullopt;
+	}
+	[[nodiscard]] bool contains(mtpRequestId requestId) const {
+		const auto &shard = shardFor(requestId);
+		QMutexLocker lock(&shard.mutex);
+		return (shard.values.find(requestId) != end(shard.values));
+	}
+	std::optional<Value> take(mtpRequestId requestId) {
+		auto &shard = shardFor(requestId);
+		QMutexLocker lock(&shard.mutex);
+		const auto i = shard.values.find(requestId);
+		if (i == end(shard.values)) {
+			return std::nullopt;
+		}
+		auto result = std::make_optional(std::move(i->second));
+		shard.values.erase(i);
+		return result;
+	}
+	void remove(mtpRequestId requestId) {
+		auto &shard = shardFor(requestId);
+		QMutexLocker lock(&shard.mutex);
+		shard.values.erase(requestId);
+	}
+
+	// Calls method(Value&) under the lock, returns the changed value.
+	template <typename Method>
+	std::optional<Value> modify(mtpRequestId requestId, Method &&method) {
+		auto &shard = shardFor(requestId);
+		QMutexLocker lock(&shard.mutex);
+		const auto i = shard.values.find(requestId);
+		if (i == end(shard.values)) {
+			return std::nullopt;
+		}
+		method(i->second);
+		return i->second;
+	}
+
+private:
+	// Each shard is aligned to a cache line, so that threads locking
+	// different shards don't fight for the same line.
+	struct alignas(64) Shard {
+		mutable QMutex mutex;
+		std::unordered_map<mtpRequestId, Value> values;
+	};
+
+	[[nodiscard]] Shard &shardFor(mtpRequestId requestId) {
+		return _shards[uint32(requestId) % kRequestRegistryShards];
+	}
+	[[nodiscard]] const Shard &shardFor(mtpRequestId requestId) const {
+		return _shards[uint32(requestId) % kRequestRegistryShards];
+	}
+
+	std::array<Shard, kRequestRegistryShards> _shards;
+
+};
+
+} // namespace MTP::details
@@ -100,13 +100,21 @@ uint32 SerializedRequest::getSeqNo() const {
 	return uint32((*_data)[kSeqNoPosition]);
 }
 
-void SerializedRequest::addPadding(bool extended, bool old) {
+void SerializedRequest::addPadding(
+		bool extended,
+		bool old,
+		uint32 gatheredInts) {
 	Expects(_data != nullptr);
 	Expects(_data->size() > kMessageBodyPosition);
 
 	const auto requestSize = (tl::count_length(*this) >> 2);
+	Assert(requestSize >= gatheredInts);
+
 	const auto padding = CountPaddingPrimesCount(requestSize, extended, old);
-	const auto fullSize = kMessageBodyPosition + requestSize + padding;
+	const auto fullSize = kMessageBodyPosition
+		+ requestSize
+		+ padding
+		- gatheredInts;
 	if (uint32(_data->size()) != fullSize) {
 		_data->resize(fullSize);
 		if (padding > 0) {
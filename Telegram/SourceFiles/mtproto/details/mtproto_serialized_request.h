@@ -65,7 +65,9 @@ public:
 	void setSeqNo(uint32 seqNo);
 	[[nodiscard]] uint32 getSeqNo() const;
 
-	void addPadding(bool extended, bool old);
+	// gatheredInts are counted in the message length, but are not
+	// placed in this buffer, see SessionPrivate::sendSecureRequest.
+	void addPadding(bool extended, bool old, uint32 gatheredInts = 0);
 	[[nodiscard]] uint32 messageSize() const;
 
 	[[nodiscard]] bool needAck() const;
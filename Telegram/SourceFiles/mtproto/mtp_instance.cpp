@@ -9,6 +9,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 
 #include "mtproto/details/mtproto_dcenter.h"
 #include "mtproto/details/mtproto_rsa_public_key.h"
+#include "mtproto/details/mtproto_request_registry.h"
 #include "mtproto/special_config_request.h"
 #include "mtproto/session.h"
 #include "mtproto/dc_options.h"
@@ -125,6 +126,7 @@ public:
 	SerializedRequest getRequest(mtpRequestId requestId);
 	void execCallback(mtpRequestId requestId, const mtpPrime *from, const mtpPrime *end);
 	bool hasCallbacks(mtpRequestId requestId);
+	void prepareCallback(mtpRequestId requestId, const mtpPrime *from, const mtpPrime *end);
 	void globalCallback(const mtpPrime *from, const mtpPrime *end);
 
 	void onStateChange(ShiftedDcId shiftedDcId, int32 state);
@@ -227,17 +229,13 @@ private:
 	rpl::event_stream<> _allKeysDestroyed;
 
 	// holds dcWithShift for request to this dc or -dc for request to main dc
-	std::map<mtpRequestId, ShiftedDcId> _requestsByDc;
-	mutable QMutex _requestByDcLock;
+	RequestRegistry<ShiftedDcId> _requestsByDc;
 
 	// holds target dcWithShift for auth export request
 	std::map<mtpRequestId, ShiftedDcId> _authExportRequests;
 
-	std::map<mtpRequestId, RPCResponseHandler> _parserMap;
-	QMutex _parserMapLock;
-
-	std::map<mtpRequestId, SerializedRequest> _requestMap;
-	QReadWriteLock _requestMapLock;
+	RequestRegistry<RPCResponseHandler> _parserMap;
+	RequestRegistry<SerializedRequest> _requestMap;
 
 	std::deque<std::pair<mtpRequestId, crl::time>> _delayedRequests;
 
@@ -552,22 +550,15 @@ void Instance::Private::cancel(mtpRequestId requestId) {
 	DEBUG_LOG(("MTP Info: Cancel request %1.").arg(requestId));
 	const auto shiftedDcId = queryRequestByDc(requestId);
 	auto msgId = mtpMsgId(0);
-	{
-		QWriteLocker locker(&_requestMapLock);
-		auto it = _requestMap.find(requestId);
-		if (it != _requestMap.end()) {
-			msgId = *(mtpMsgId*)(it->second->constData() + 4);
-			_requestMap.erase(it);
-		}
+	if (const auto request = _requestMap.take(requestId)) {
+		msgId = *(mtpMsgId*)((*request)->constData() + 4);
 	}
 	unregisterRequest(requestId);
 	if (shiftedDcId) {
 		const auto session = getSession(qAbs(*shiftedDcId));
 		session->cancel(requestId, msgId);
 	}
-
-	QMutexLocker locker(&_parserMapLock);
-	_parserMap.erase(requestId);
+	_parserMap.remove(requestId);
 }
 
 // result < 0 means waiting for such count of ms.
@@ -866,28 +857,19 @@ bool Instance::Private::configLoadFail(const RPCError &error) {
 
 std::optional<ShiftedDcId> Instance::Private::queryRequestByDc(
 		mtpRequestId requestId) const {
-	QMutexLocker locker(&_requestByDcLock);
-	auto it = _requestsByDc.find(requestId);
-	if (it != _requestsByDc.cend()) {
-		return it->second;
-	}
-	return std::nullopt;
+	return _requestsByDc.find(requestId);
 }
 
 std::optional<ShiftedDcId> Instance::Private::changeRequestByDc(
 		mtpRequestId requestId,
 		DcId newdc) {
-	QMutexLocker locker(&_requestByDcLock);
-	auto it = _requestsByDc.find(requestId);
-	if (it != _requestsByDc.cend()) {
-		if (it->second < 0) {
-			it->second = -newdc;
+	return _requestsByDc.modify(requestId, [&](ShiftedDcId &shiftedDcId) {
+		if (shiftedDcId < 0) {
+			shiftedDcId = -newdc;
 		} else {
-			it->second = ShiftDcId(newdc, GetDcIdShift(it->second));
+			shiftedDcId = ShiftDcId(newdc, GetDcIdShift(shiftedDcId));
 		}
-		return it->second;
-	}
-	return std::nullopt;
+	});
 }
 
 void Instance::Private::checkDelayedRequests() {
@@ -904,18 +886,13 @@ void Instance::Private::checkDelayedRequests() {
 			continue;
 		}
 
-		auto request = SerializedRequest();
-		{
-			QReadLocker locker(&_requestMapLock);
-			auto it = _requestMap.find(requestId);
-			if (it == _requestMap.cend()) {
-				DEBUG_LOG(("MTP Error: could not find request %1").arg(requestId));
-				continue;
-			}
-			request = it->second;
+		const auto request = _requestMap.find(requestId);
+		if (!request) {
+			DEBUG_LOG(("MTP Error: could not find request %1").arg(requestId));
+			continue;
 		}
 		const auto session = getSession(qAbs(dcWithShift));
-		session->sendPrepared(request);
+		session->sendPrepared(*request);
 	}
 
 	if (!_delayedRequests.empty()) {
@@ -953,22 +930,15 @@ void Instance::Private::sendRequest(
 void Instance::Private::registerRequest(
 		mtpRequestId requestId,
 		ShiftedDcId shiftedDcId) {
-	QMutexLocker locker(&_requestByDcLock);
-	_requestsByDc[requestId] = shiftedDcId;
+	_requestsByDc.set(requestId, shiftedDcId);
 }
 
 void Instance::Private::unregisterRequest(mtpRequestId requestId) {
 	DEBUG_LOG(("MTP Info: unregistering request %1.").arg(requestId));
 
 	_requestsDelays.erase(requestId);
-
-	{
-		QWriteLocker locker(&_requestMapLock);
-		_requestMap.erase(requestId);
-	}
-
-	QMutexLocker locker(&_requestByDcLock);
-	_requestsByDc.erase(requestId);
+	_requestMap.remove(requestId);
+	_requestsByDc.remove(requestId);
 }
 
 void Instance::Private::storeRequest(
@@ -976,25 +946,13 @@ void Instance::Private::storeRequest(
 		const SerializedRequest &request,
 		RPCResponseHandler &&callbacks) {
 	if (callbacks.onDone || callbacks.onFail) {
-		QMutexLocker locker(&_parserMapLock);
 		_parserMap.emplace(requestId, std::move(callbacks));
 	}
-	{
-		QWriteLocker locker(&_requestMapLock);
-		_requestMap.emplace(requestId, request);
-	}
+	_requestMap.emplace(requestId, request);
 }
 
 SerializedRequest Instance::Private::getRequest(mtpRequestId requestId) {
-	auto result = SerializedRequest();
-	{
-		QReadLocker locker(&_requestMapLock);
-		auto it = _requestMap.find(requestId);
-		if (it != _requestMap.cend()) {
-			result = it->second;
-		}
-	}
-	return result;
+	return _requestMap.find(requestId).value_or(SerializedRequest());
 }
 
 
@@ -1003,15 +961,10 @@ void Instance::Private::execCallback(
 		const mtpPrime *from,
 		const mtpPrime *end) {
 	RPCResponseHandler h;
-	{
-		QMutexLocker locker(&_parserMapLock);
-		auto it = _parserMap.find(requestId);
-		if (it != _parserMap.cend()) {
-			h = it->second;
-			_parserMap.erase(it);
-
-			DEBUG_LOG(("RPC Info: found parser for request %1, trying to parse response...").arg(requestId));
-		}
+	if (auto parser = _parserMap.take(requestId)) {
+		h = std::move(*parser);
+
+		DEBUG_LOG(("RPC Info: found parser for request %1, trying to parse response...").arg(requestId));
 	}
 	if (h.onDone || h.onFail) {
 		const auto handleError = [&](const RPCError &error) {
@@ -1023,7 +976,6 @@ void Instance::Private::execCallback(
 			if (rpcErrorOccured(requestId, h, error)) {
 				unregisterRequest(requestId);
 			} else {
-				QMutexLocker locker(&_parserMapLock);
 				_parserMap.emplace(requestId, h);
 			}
 		};
@@ -1054,9 +1006,25 @@ void Instance::Private::execCallback(
 }
 
 bool Instance::Private::hasCallbacks(mtpRequestId requestId) {
-	QMutexLocker locker(&_parserMapLock);
-	auto it = _parserMap.find(requestId);
-	return (it != _parserMap.cend());
+	return _parserMap.contains(requestId);
+}
+
+void Instance::Private::prepareCallback(
+		mtpRequestId requestId,
+		const mtpPrime *from,
+		const mtpPrime *end) {
+	if (from >= end || *from == mtpc_rpc_error) {
+		return;
+	}
+	const auto handler = _parserMap.find(requestId);
+	if (!handler
+		|| !handler->onDone
+		|| !handler->onDone->parseInBackground()) {
+		return;
+	}
+	// The response will be passed to the main thread only after that,
+	// so the handler is not used there at the same time.
+	handler->onDone->prepare(from, end);
 }
 
 void Instance::Private::globalCallback(const mtpPrime *from, const mtpPrime *end) {
@@ -1120,10 +1088,9 @@ void Instance::Private::importDone(const MTPauth_Authorization &result, mtpReque
 
 	auto &waiters = _authWaiters[newdc];
 	if (waiters.size()) {
-		QReadLocker locker(&_requestMapLock);
 		for (auto waitedRequestId : waiters) {
-			auto it = _requestMap.find(waitedRequestId);
-			if (it == _requestMap.cend()) {
+			const auto request = _requestMap.find(waitedRequestId);
+			if (!request) {
 				LOG(("MTP Error: could not find request %1 for resending").arg(waitedRequestId));
 				continue;
 			}
@@ -1136,7 +1103,7 @@ void Instance::Private::importDone(const MTPauth_Authorization &result, mtpReque
 			}
 			DEBUG_LOG(("MTP Info: resending request %1 to dc %2 after import auth").arg(waitedRequestId).arg(*shiftedDcId));
 			const auto session = getSession(*shiftedDcId);
-			session->sendPrepared(it->second);
+			session->sendPrepared(*request);
 		}
 		waiters.clear();
 	}
@@ -1243,14 +1210,11 @@ bool Instance::Private::onErrorDefault(mtpRequestId requestId, const RPCError &e
 		}
 
 		auto request = SerializedRequest();
-		{
-			QReadLocker locker(&_requestMapLock);
-			auto it = _requestMap.find(requestId);
-			if (it == _requestMap.cend()) {
-				LOG(("MTP Error: could not find request %1").arg(requestId));
-				return false;
-			}
-			request = it->second;
+		if (const auto found = _requestMap.find(requestId)) {
+			request = *found;
+		} else {
+			LOG(("MTP Error: could not find request %1").arg(requestId));
+			return false;
 		}
 		const auto session = getSession(newdcWithShift);
 		registerRequest(
@@ -1315,14 +1279,11 @@ bool Instance::Private::onErrorDefault(mtpRequestId requestId, const RPCError &e
 		return true;
 	} else if (err == qstr("CONNECTION_NOT_INITED") || err == qstr("CONNECTION_LAYER_INVALID")) {
 		SerializedRequest request;
-		{
-			QReadLocker locker(&_requestMapLock);
-			auto it = _requestMap.find(requestId);
-			if (it == _requestMap.cend()) {
-				LOG(("MTP Error: could not find request %1").arg(requestId));
-				return false;
-			}
-			request = it->second;
+		if (const auto found = _requestMap.find(requestId)) {
+			request = *found;
+		} else {
+			LOG(("MTP Error: could not find request %1").arg(requestId));
+			return false;
 		}
 		auto dcWithShift = ShiftedDcId(0);
 		if (const auto shiftedDcId = queryRequestByDc(requestId)) {
@@ -1340,14 +1301,11 @@ bool Instance::Private::onErrorDefault(mtpRequestId requestId, const RPCError &e
 		Lang::CurrentCloudManager().resetToDefault();
 	} else if (err == qstr("MSG_WAIT_FAILED")) {
 		SerializedRequest request;
-		{
-			QReadLocker locker(&_requestMapLock);
-			auto it = _requestMap.find(requestId);
-			if (it == _requestMap.cend()) {
-				LOG(("MTP Error: could not find request %1").arg(requestId));
-				return false;
-			}
-			request = it->second;
+		if (const auto found = _requestMap.find(requestId)) {
+			request = *found;
+		} else {
+			LOG(("MTP Error: could not find request %1").arg(requestId));
+			return false;
 		}
 		if (!request->after) {
 			LOG(("MTP Error: wait failed for not dependent request %1").arg(requestId));
@@ -1820,6 +1778,10 @@ bool Instance::hasCallbacks(mtpRequestId requestId) {
 	return _private->hasCallbacks(requestId);
 }
 
+void Instance::prepareCallback(mtpRequestId requestId, const mtpPrime *from, const mtpPrime *end) {
+	_private->prepareCallback(requestId, from, end);
+}
+
 void Instance::globalCallback(const mtpPrime *from, const mtpPrime *end) {
 	_private->globalCallback(from, end);
 }
@@ -102,6 +102,9 @@ public:
 
 	void execCallback(mtpRequestId requestId, const mtpPrime *from, const mtpPrime *end);
 	bool hasCallbacks(mtpRequestId requestId);
+
+	// May be called from any session thread.
+	void prepareCallback(mtpRequestId requestId, const mtpPrime *from, const mtpPrime *end);
 	void globalCallback(const mtpPrime *from, const mtpPrime *end);
 
 	// return true if need to clean request data
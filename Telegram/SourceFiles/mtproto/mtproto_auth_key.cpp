@@ -158,6 +158,58 @@ void aesIgeEncryptRaw(const void *src, void *dst, uint32 len, const void *key, c
 	AES_ige_encrypt(static_cast<const uchar*>(src), static_cast<uchar*>(dst), len, &aes, aes_iv, AES_ENCRYPT);
 }
 
+void aesIgeEncrypt(
+		const std::vector<bytes::const_span> &parts,
+		void *dst,
+		const AuthKeyPtr &authKey,
+		const MTPint128 &msgKey) {
+	MTPint256 aesKey, aesIV;
+	authKey->prepareAES(msgKey, aesKey, aesIV, true);
+
+	uchar aes_key[32], aes_iv[32];
+	memcpy(aes_key, &aesKey, 32);
+	memcpy(aes_iv, &aesIV, 32);
+
+	AES_KEY aes;
+	AES_set_encrypt_key(aes_key, 256, &aes);
+
+	// AES_ige_encrypt() leaves the iv for the next block in aes_iv,
+	// so we encrypt the parts one by one, carrying the incomplete blocks.
+	constexpr auto kBlockSize = int(AES_BLOCK_SIZE);
+	auto to = static_cast<uchar*>(dst);
+	uchar carry[kBlockSize];
+	auto carried = 0;
+	for (const auto &part : parts) {
+		auto from = reinterpret_cast<const uchar*>(part.data());
+		auto left = int(part.size());
+		if (carried > 0) {
+			const auto add = std::min(kBlockSize - carried, left);
+			memcpy(carry + carried, from, add);
+			carried += add;
+			from += add;
+			left -= add;
+			if (carried < kBlockSize) {
+				continue;
+			}
+			AES_ige_encrypt(carry, to, kBlockSize, &aes, aes_iv, AES_ENCRYPT);
+			to += kBlockSize;
+			carried = 0;
+		}
+		const auto whole = left - (left % kBlockSize);
+		if (whole > 0) {
+			AES_ige_encrypt(from, to, whole, &aes, aes_iv, AES_ENCRYPT);
+			to += whole;
+			from += whole;
+			left -= whole;
+		}
+		if (left > 0) {
+			memcpy(carry, from, left);
+			carried = left;
+		}
+	}
+	Ensures(!carried);
+}
+
 void aesIgeDecryptRaw(const void *src, void *dst, uint32 len, const void *key, const void *iv) {
 	uchar aes_key[32], aes_iv[32];
 	memcpy(aes_key, key, 32);
@@ -82,6 +82,13 @@ inline void aesIgeEncrypt(const void *src, void *dst, uint32 len, const AuthKeyP
 	return aesIgeEncryptRaw(src, dst, len, static_cast<const void*>(&aesKey), static_cast<const void*>(&aesIV));
 }
 
+// Encrypts the concatenation of the parts without copying them together.
+void aesIgeEncrypt(
+	const std::vector<bytes::const_span> &parts,
+	void *dst,
+	const AuthKeyPtr &authKey,
+	const MTPint128 &msgKey);
+
 inline void aesEncryptLocal(const void *src, void *dst, uint32 len, const AuthKeyPtr &authKey, const void *key128) {
 	MTPint256 aesKey, aesIV;
 	authKey->prepareAES_oldmtp(*(const MTPint128*)key128, aesKey, aesIV, false);
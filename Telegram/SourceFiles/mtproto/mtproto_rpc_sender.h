@@ -69,9 +69,57 @@ public:
 	virtual ~RPCAbstractDoneHandler() {
 	}
 
+	// If enabled, prepare() is called in the session thread before the
+	// response is passed to operator() in the main thread.
+	void setParseInBackground(bool enabled) {
+		_parseInBackground = enabled;
+	}
+	[[nodiscard]] bool parseInBackground() const {
+		return _parseInBackground;
+	}
+	virtual void prepare(const mtpPrime *from, const mtpPrime *end) {
+	}
+
+private:
+	bool _parseInBackground = false;
+
 };
 using RPCDoneHandlerPtr = std::shared_ptr<RPCAbstractDoneHandler>;
 
+// Asks for the response to be parsed in the session thread, it is
+// worth it only for large responses, like getDifference or getHistory.
+inline RPCDoneHandlerPtr rpcParseInBackground(RPCDoneHandlerPtr &&handler) {
+	if (handler) {
+		handler->setParseInBackground(true);
+	}
+	return std::move(handler);
+}
+
+template <typename TResponse>
+class RPCPreparedResponse {
+public:
+	void prepare(const mtpPrime *from, const mtpPrime *end) {
+		auto response = TResponse();
+		if (response.read(from, end)) {
+			_response = std::move(response);
+		}
+	}
+	[[nodiscard]] bool take(
+			TResponse &response,
+			const mtpPrime *from,
+			const mtpPrime *end) {
+		if (auto prepared = base::take(_response)) {
+			response = std::move(*prepared);
+			return true;
+		}
+		return response.read(from, end);
+	}
+
+private:
+	std::optional<TResponse> _response;
+
+};
+
 class RPCAbstractFailHandler { // abstract fail
 public:
 	virtual bool operator()(mtpRequestId requestId, const RPCError &e) = 0;
@@ -131,14 +179,18 @@ public:
 	}
 	bool operator()(mtpRequestId requestId, const mtpPrime *from, const mtpPrime *end) override {
 		auto response = TResponse();
-		if (!response.read(from, end)) {
+		if (!_prepared.take(response, from, end)) {
 			return false;
 		}
 		(*_onDone)(std::move(response));
 		return true;
 	}
+	void prepare(const mtpPrime *from, const mtpPrime *end) override {
+		_prepared.prepare(from, end);
+	}
 
 private:
+	RPCPreparedResponse<TResponse> _prepared;
 	CallbackType _onDone;
 
 };
@@ -152,14 +204,18 @@ public:
 	}
 	bool operator()(mtpRequestId requestId, const mtpPrime *from, const mtpPrime *end) override {
 		auto response = TResponse();
-		if (!response.read(from, end)) {
+		if (!_prepared.take(response, from, end)) {
 			return false;
 		}
 		(*_onDone)(std::move(response), requestId);
 		return true;
 	}
+	void prepare(const mtpPrime *from, const mtpPrime *end) override {
+		_prepared.prepare(from, end);
+	}
 
 private:
+	RPCPreparedResponse<TResponse> _prepared;
 	CallbackType _onDone;
 
 };
@@ -386,7 +442,7 @@ public:
 	}
 	bool operator()(mtpRequestId requestId, const mtpPrime *from, const mtpPrime *end) override {
 		auto response = TResponse();
-		if (!response.read(from, end)) {
+		if (!_prepared.take(response, from, end)) {
 			return false;
 		}
 		if (_owner) {
@@ -394,8 +450,12 @@ public:
 		}
 		return true;
 	}
+	void prepare(const mtpPrime *from, const mtpPrime *end) override {
+		_prepared.prepare(from, end);
+	}
 
 private:
+	RPCPreparedResponse<TResponse> _prepared;
 	CallbackType _onDone;
 
 };
@@ -409,7 +469,7 @@ public:
 	}
 	bool operator()(mtpRequestId requestId, const mtpPrime *from, const mtpPrime *end) override {
 		auto response = TResponse();
-		if (!response.read(from, end)) {
+		if (!_prepared.take(response, from, end)) {
 			return false;
 		}
 		if (_owner) {
@@ -417,8 +477,12 @@ public:
 		}
 		return true;
 	}
+	void prepare(const mtpPrime *from, const mtpPrime *end) override {
+		_prepared.prepare(from, end);
+	}
 
 private:
+	RPCPreparedResponse<TResponse> _prepared;
 	CallbackType _onDone;
 
 };
@@ -504,7 +568,7 @@ public:
 	}
 	bool operator()(mtpRequestId requestId, const mtpPrime *from, const mtpPrime *end) override {
 		auto response = TResponse();
-		if (!response.read(from, end)) {
+		if (!_prepared.take(response, from, end)) {
 			return false;
 		}
 		if (_owner) {
@@ -512,8 +576,12 @@ public:
 		}
 		return true;
 	}
+	void prepare(const mtpPrime *from, const mtpPrime *end) override {
+		_prepared.prepare(from, end);
+	}
 
 private:
+	RPCPreparedResponse<TResponse> _prepared;
 	CallbackType _onDone;
 	T _b;
 
@@ -528,7 +596,7 @@ public:
 	}
 	bool operator()(mtpRequestId requestId, const mtpPrime *from, const mtpPrime *end) override {
 		auto response = TResponse();
-		if (!response.read(from, end)) {
+		if (!_prepared.take(response, from, end)) {
 			return false;
 		}
 		if (_owner) {
@@ -536,8 +604,12 @@ public:
 		}
 		return true;
 	}
+	void prepare(const mtpPrime *from, const mtpPrime *end) override {
+		_prepared.prepare(from, end);
+	}
 
 private:
+	RPCPreparedResponse<TResponse> _prepared;
 	CallbackType _onDone;
 	T _b;
 
@@ -901,7 +973,7 @@ public:
 	using RPCDoneHandlerImplementation<R(const TResponse&)>::Parent::Parent;
 	bool operator()(mtpRequestId requestId, const mtpPrime *from, const mtpPrime *end) override {
 		auto response = TResponse();
-		if (!response.read(from, end)) {
+		if (!_prepared.take(response, from, end)) {
 			return false;
 		}
 		if (this->_handler) {
@@ -909,6 +981,12 @@ public:
 		}
 		return true;
 	}
+	void prepare(const mtpPrime *from, const mtpPrime *end) override {
+		_prepared.prepare(from, end);
+	}
+
+private:
+	RPCPreparedResponse<TResponse> _prepared;
 
 };
 
@@ -918,7 +996,7 @@ public:
 	using RPCDoneHandlerImplementation<R(const TResponse&, mtpRequestId)>::Parent::Parent;
 	bool operator()(mtpRequestId requestId, const mtpPrime *from, const mtpPrime *end) override {
 		auto response = TResponse();
-		if (!response.read(from, end)) {
+		if (!_prepared.take(response, from, end)) {
 			return false;
 		}
 		if (this->_handler) {
@@ -926,6 +1004,12 @@ public:
 		}
 		return true;
 	}
+	void prepare(const mtpPrime *from, const mtpPrime *end) override {
+		_prepared.prepare(from, end);
+	}
+
+private:
+	RPCPreparedResponse<TResponse> _prepared;
 
 };
 
@@ -59,7 +59,7 @@ class Sender {
 				_sender->senderRequestHandled(requestId);
 
 				auto result = Response();
-				if (!result.read(from, end)) {
+				if (!_prepared.take(result, from, end)) {
 					return false;
 				}
 				if (handler) {
@@ -67,10 +67,14 @@ class Sender {
 				}
 				return true;
 			}
+			void prepare(const mtpPrime *from, const mtpPrime *end) override {
+				_prepared.prepare(from, end);
+			}
 
 		private:
 			not_null<Sender*> _sender;
 			Callback _handler;
+			RPCPreparedResponse<Response> _prepared;
 
 		};
 
@@ -151,6 +155,9 @@ class Sender {
 		void setAfter(mtpRequestId requestId) noexcept {
 			_afterRequestId = requestId;
 		}
+		void setParseInBackground() noexcept {
+			_parseInBackground = true;
+		}
 
 		ShiftedDcId takeDcId() const noexcept {
 			return _dcId;
@@ -159,6 +166,9 @@ class Sender {
 			return _canWait;
 		}
 		RPCDoneHandlerPtr takeOnDone() noexcept {
+			if (_done && _parseInBackground) {
+				_done->setParseInBackground(true);
+			}
 			return std::move(_done);
 		}
 		RPCFailHandlerPtr takeOnFail() {
@@ -188,6 +198,7 @@ class Sender {
 		base::variant<FailPlainHandler, FailRequestIdHandler> _fail;
 		FailSkipPolicy _failSkipPolicy = FailSkipPolicy::Simple;
 		mtpRequestId _afterRequestId = 0;
+		bool _parseInBackground = false;
 
 	};
 
@@ -245,6 +256,10 @@ public:
 			setAfter(requestId);
 			return *this;
 		}
+		[[nodiscard]] SpecificRequestBuilder &parseInBackground() noexcept {
+			setParseInBackground();
+			return *this;
+		}
 
 		mtpRequestId send() {
 			const auto id = sender()->instance()->send(
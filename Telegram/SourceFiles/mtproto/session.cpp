@@ -359,11 +359,15 @@ void Session::resetDone() {
 void Session::cancel(mtpRequestId requestId, mtpMsgId msgId) {
 	if (requestId) {
 		QWriteLocker locker(_data->toSendMutex());
-		_data->toSendMap().remove(requestId);
+		if (!_data->toSendMap().remove(requestId)) {
+			// If it is being sent right now it will be removed
+			// from haveSentMap() as soon as it is placed there.
+			_data->sendingIds().remove(requestId);
+		}
 	}
 	if (msgId) {
 		QWriteLocker locker(_data->haveSentMutex());
-		_data->haveSentMap().remove(msgId);
+		_data->haveSentMap().erase(msgId);
 	}
 }
 
@@ -397,7 +401,8 @@ int32 Session::requestState(mtpRequestId requestId) const {
 	}
 
 	QWriteLocker locker(_data->toSendMutex());
-	return _data->toSendMap().contains(requestId)
+	return (_data->toSendMap().contains(requestId)
+		|| _data->sendingIds().contains(requestId))
 		? MTP::RequestSending
 		: MTP::RequestSent;
 }
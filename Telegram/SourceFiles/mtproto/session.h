@@ -52,6 +52,10 @@ struct SessionOptions {
 
 };
 
+// Sent requests are acked mostly in the order of their growing msg ids,
+// so a node based map avoids shifting all the later entries on each ack.
+using SentRequestsMap = std::map<mtpMsgId, SerializedRequest>;
+
 class Session;
 class SessionData final {
 public:
@@ -81,7 +85,10 @@ public:
 	base::flat_map<mtpRequestId, SerializedRequest> &toSendMap() {
 		return _toSend;
 	}
-	base::flat_map<mtpMsgId, SerializedRequest> &haveSentMap() {
+	base::flat_set<mtpRequestId> &sendingIds() {
+		return _sendingIds;
+	}
+	SentRequestsMap &haveSentMap() {
 		return _haveSent;
 	}
 	base::flat_map<mtpRequestId, mtpBuffer> &haveReceivedResponses() {
@@ -123,9 +130,10 @@ private:
 	mutable QReadWriteLock _optionsLock;
 
 	base::flat_map<mtpRequestId, SerializedRequest> _toSend; // map of request_id -> request, that is waiting to be sent
+	base::flat_set<mtpRequestId> _sendingIds; // requests taken from _toSend, but not yet placed to _haveSent, guarded by _toSendLock
 	QReadWriteLock _toSendLock;
 
-	base::flat_map<mtpMsgId, SerializedRequest> _haveSent; // map of msg_id -> request, that was sent
+	SentRequestsMap _haveSent; // map of msg_id -> request, that was sent
 	QReadWriteLock _haveSentLock;
 
 	base::flat_map<mtpRequestId, mtpBuffer> _receivedResponses; // map of request_id -> response that should be processed in the main thread
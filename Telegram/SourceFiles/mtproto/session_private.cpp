@@ -57,6 +57,9 @@ constexpr auto kSendStateRequestWaiting = crl::time(1000);
 // How much time to wait for some more requests, when sending msg acks.
 constexpr auto kAckSendWaiting = 10 * crl::time(1000);
 
+// Messages of that size (in mtpPrime-s) are not copied to the container.
+constexpr auto kGatherMessagesFromSize = 4096;
+
 using namespace details;
 
 [[nodiscard]] QString LogIdsVector(const QVector<MTPlong> &ids) {
@@ -80,7 +83,7 @@ using namespace details;
 void WrapInvokeAfter(
 		SerializedRequest &to,
 		const SerializedRequest &from,
-		const base::flat_map<mtpMsgId, SerializedRequest> &haveSent,
+		const SentRequestsMap &haveSent,
 		int32 skipBeforeRequest = 0) {
 	const auto afterId = *(mtpMsgId*)(from->after->data() + 4);
 	const auto i = afterId ? haveSent.find(afterId) : haveSent.end();
@@ -104,6 +107,59 @@ void WrapInvokeAfter(
 	}
 }
 
+[[nodiscard]] uint32 GatheredSize(
+		const std::vector<GatheredMessage> &gathered) {
+	auto result = uint32(0);
+	for (const auto &message : gathered) {
+		result += message.request.messageSize();
+	}
+	return result;
+}
+
+void FlattenGathered(
+		SerializedRequest &request,
+		std::vector<GatheredMessage> &&gathered) {
+	// Positions count all the previous gathered messages as inserted.
+	for (const auto &message : gathered) {
+		const auto len = message.request.messageSize();
+		request->insert(int(message.position), int(len), mtpPrime(0));
+		memcpy(
+			request->data() + message.position,
+			message.request->constData() + 4,
+			len * sizeof(mtpPrime));
+	}
+	gathered.clear();
+}
+
+[[nodiscard]] std::vector<bytes::const_span> GatheredParts(
+		const SerializedRequest &request,
+		uint32 fullSize,
+		const std::vector<GatheredMessage> &gathered) {
+	const auto span = [](const mtpPrime *from, uint32 size) {
+		return bytes::const_span(
+			reinterpret_cast<const bytes::type*>(from),
+			size * sizeof(mtpPrime));
+	};
+	auto result = std::vector<bytes::const_span>();
+	result.reserve(2 * gathered.size() + 1);
+	auto position = uint32(0);
+	auto owned = uint32(0);
+	for (const auto &message : gathered) {
+		Assert(message.position >= position);
+		const auto len = message.request.messageSize();
+		const auto before = message.position - position;
+		if (before > 0) {
+			result.push_back(span(request->constData() + owned, before));
+		}
+		result.push_back(span(message.request->constData() + 4, len));
+		owned += before;
+		position = message.position + len;
+	}
+	Assert(fullSize >= position);
+	result.push_back(span(request->constData() + owned, fullSize - position));
+	return result;
+}
+
 } // namespace
 
 SessionPrivate::SessionPrivate(
@@ -424,7 +480,7 @@ mtpMsgId SessionPrivate::replaceMsgId(SerializedRequest &request, mtpMsgId newId
 
 	while (_resendingIds.contains(newId)
 		|| _ackedIds.contains(newId)
-		|| haveSent.contains(newId)) {
+		|| (haveSent.find(newId) != end(haveSent))) {
 		newId = base::unixtime::mtproto_msg_id();
 	}
 
@@ -626,19 +682,24 @@ void SessionPrivate::tryToSend() {
 		initSize = initSizeInInts * sizeof(mtpPrime);
 	}
 
+	auto toSend = base::flat_map<mtpRequestId, SerializedRequest>();
+	if (sendAll) {
+		// Take all the requests at once, so that adding new requests
+		// doesn't wait while we serialize and encrypt these ones.
+		// Until they are placed to haveSentMap() they are in sendingIds().
+		QWriteLocker locker(_sessionData->toSendMutex());
+		toSend = base::take(_sessionData->toSendMap());
+		auto &sending = _sessionData->sendingIds();
+		for (const auto &[requestId, request] : toSend) {
+			sending.emplace(requestId);
+		}
+	}
+	auto sentIds = std::vector<std::pair<mtpRequestId, mtpMsgId>>();
+
 	bool needAnyResponse = false;
 	SerializedRequest toSendRequest;
+	auto gathered = std::vector<GatheredMessage>();
 	{
-		QWriteLocker locker1(_sessionData->toSendMutex());
-
-		auto toSendDummy = base::flat_map<mtpRequestId, SerializedRequest>();
-		auto &toSend = sendAll
-			? _sessionData->toSendMap()
-			: toSendDummy;
-		if (!sendAll) {
-			locker1.unlock();
-		}
-
 		uint32 toSendCount = toSend.size();
 		if (pingRequest) ++toSendCount;
 		if (ackRequest) ++toSendCount;
@@ -666,10 +727,7 @@ void SessionPrivate::tryToSend() {
 			: toSend.begin()->second;
 		if (toSendCount == 1 && !first->forceSendInContainer) {
 			toSendRequest = first;
-			if (sendAll) {
-				toSend.clear();
-				locker1.unlock();
-			}
+			toSend.clear();
 
 			const auto msgId = prepareToSend(
 				toSendRequest,
@@ -696,6 +754,7 @@ void SessionPrivate::tryToSend() {
 					QWriteLocker locker2(_sessionData->haveSentMutex());
 					auto &haveSent = _sessionData->haveSentMap();
 					haveSent.emplace(msgId, toSendRequest);
+					sentIds.emplace_back(toSendRequest->requestId, msgId);
 
 					const auto wrapLayer = needsLayer && toSendRequest->needsLayer;
 					if (toSendRequest->after) {
@@ -818,6 +877,7 @@ void SessionPrivate::tryToSend() {
 						// #TODO rewrite so that it will always hold.
 						//Assert(!haveSent.contains(msgId));
 						haveSent.emplace(msgId, request);
+						sentIds.emplace_back(request->requestId, msgId);
 						sentIdsWrap.messages.push_back(msgId);
 						needAnyResponse = true;
 					} else {
@@ -826,8 +886,15 @@ void SessionPrivate::tryToSend() {
 				}
 				if (!added) {
 					uint32 from = toSendRequest->size(), len = request.messageSize();
-					toSendRequest->resize(from + len);
-					memcpy(toSendRequest->data() + from, request->constData() + 4, len * sizeof(mtpPrime));
+					if (len >= kGatherMessagesFromSize) {
+						gathered.push_back({
+							from + GatheredSize(gathered),
+							request
+						});
+					} else {
+						toSendRequest->resize(from + len);
+						memcpy(toSendRequest->data() + from, request->constData() + 4, len * sizeof(mtpPrime));
+					}
 				}
 			}
 			toSend.clear();
@@ -872,7 +939,22 @@ void SessionPrivate::tryToSend() {
 			_sentContainers.emplace(containerMsgId, std::move(sentIdsWrap));
 		}
 	}
-	sendSecureRequest(std::move(toSendRequest), needAnyResponse);
+	if (sendAll) {
+		// Forget the requests that were canceled while being sent.
+		QWriteLocker locker(_sessionData->toSendMutex());
+		const auto sending = base::take(_sessionData->sendingIds());
+		QWriteLocker locker2(_sessionData->haveSentMutex());
+		auto &haveSent = _sessionData->haveSentMap();
+		for (const auto &[requestId, msgId] : sentIds) {
+			if (!sending.contains(requestId)) {
+				haveSent.erase(msgId);
+			}
+		}
+	}
+	sendSecureRequest(
+		std::move(toSendRequest),
+		std::move(gathered),
+		needAnyResponse);
 }
 
 void SessionPrivate::retryByTimer() {
@@ -1743,6 +1825,12 @@ SessionPrivate::HandleResult SessionPrivate::handleOneReceived(
 		}
 		const auto requestId = wasSent(requestMsgId);
 		if (requestId && requestId != mtpRequestId(0xFFFFFFFF)) {
+			// Parse the response here if the handler asked for that.
+			_instance->prepareCallback(
+				requestId,
+				response.constData(),
+				response.constData() + response.size());
+
 			// Save rpc_result for processing in the main thread.
 			QWriteLocker locker(_sessionData->haveReceivedMutex());
 			_sessionData->haveReceivedResponses().emplace(requestId, response);
@@ -2047,7 +2135,8 @@ void SessionPrivate::handleMsgsStates(const QVector<MTPlong> &ids, const QByteAr
 		const auto requestMsgId = ids[i].v;
 		{
 			QReadLocker locker(_sessionData->haveSentMutex());
-			if (!_sessionData->haveSentMap().contains(requestMsgId)) {
+			const auto &haveSent = _sessionData->haveSentMap();
+			if (haveSent.find(requestMsgId) == end(haveSent)) {
 				DEBUG_LOG(("Message Info: state was received for msgId %1, but request is not found, looking in resent requests...").arg(requestMsgId));
 				const auto reqIt = _resendingIds.find(requestMsgId);
 				if (reqIt != _resendingIds.cend()) {
@@ -2483,15 +2572,28 @@ void SessionPrivate::destroyTemporaryKey() {
 
 bool SessionPrivate::sendSecureRequest(
 		SerializedRequest &&request,
+		std::vector<GatheredMessage> &&gathered,
 		bool needAnyResponse) {
+	// Debug logging may be enabled from another thread meanwhile,
+	// so we check it once both for flattening and for the dump.
+	const auto dump = Logs::DebugEnabled() || !Logs::started();
 #ifdef TDESKTOP_MTPROTO_OLD
 	const auto oldPadding = true;
+	FlattenGathered(request, std::move(gathered));
 #else // TDESKTOP_MTPROTO_OLD
 	const auto oldPadding = false;
+	if (dump) {
+		// The dump below reads the whole message from the buffer.
+		FlattenGathered(request, std::move(gathered));
+	}
 #endif // TDESKTOP_MTPROTO_OLD
-	request.addPadding(_connection->requiresExtendedPadding(), oldPadding);
+	const auto gatheredSize = GatheredSize(gathered);
+	request.addPadding(
+		_connection->requiresExtendedPadding(),
+		oldPadding,
+		gatheredSize);
 
-	uint32 fullSize = request->size();
+	uint32 fullSize = request->size() + gatheredSize;
 	if (fullSize < 9) {
 		return false;
 	}
@@ -2504,12 +2606,14 @@ bool SessionPrivate::sendSecureRequest(
 	memcpy(request->data() + 0, &_sessionSalt, 2 * sizeof(mtpPrime));
 	memcpy(request->data() + 2, &_sessionId, 2 * sizeof(mtpPrime));
 
-	auto from = request->constData() + 4;
-	MTP_LOG(_shiftedDcId, ("Send: ")
-		+ DumpToText(from, from + messageSize)
-		+ QString(" (protocolDcId:%1,key:%2)"
-		).arg(getProtocolDcId()
-		).arg(_encryptionKey->keyId()));
+	if (dump) {
+		const auto from = request->constData() + 4;
+		Logs::writeMtp(_shiftedDcId, QString("Send: ")
+			+ DumpToText(from, from + messageSize)
+			+ QString(" (protocolDcId:%1,key:%2)"
+			).arg(getProtocolDcId()
+			).arg(_encryptionKey->keyId()));
+	}
 
 #ifdef TDESKTOP_MTPROTO_OLD
 	uint32 padding = fullSize - 4 - messageSize;
@@ -2538,7 +2642,10 @@ bool SessionPrivate::sendSecureRequest(
 	SHA256_CTX msgKeyLargeContext;
 	SHA256_Init(&msgKeyLargeContext);
 	SHA256_Update(&msgKeyLargeContext, _encryptionKey->partForMsgKey(true), 32);
-	SHA256_Update(&msgKeyLargeContext, request->constData(), fullSize * sizeof(mtpPrime));
+	const auto parts = GatheredParts(request, fullSize, gathered);
+	for (const auto &part : parts) {
+		SHA256_Update(&msgKeyLargeContext, part.data(), part.size());
+	}
 	SHA256_Final(encryptedSHA256, &msgKeyLargeContext);
 
 	auto packet = _connection->prepareSecurePacket(_keyId, msgKey, fullSize);
@@ -2546,9 +2653,8 @@ bool SessionPrivate::sendSecureRequest(
 	packet.resize(prefix + fullSize);
 
 	aesIgeEncrypt(
-		request->constData(),
+		parts,
 		&packet[prefix],
-		fullSize * sizeof(mtpPrime),
 		_encryptionKey,
 		msgKey);
 #endif // TDESKTOP_MTPROTO_OLD
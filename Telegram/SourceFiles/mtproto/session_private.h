@@ -30,6 +30,13 @@ class SessionData;
 class RSAPublicKey;
 struct SessionOptions;
 
+// A big message that is encrypted right from its own buffer
+// instead of being copied to the container buffer first.
+struct GatheredMessage {
+	uint32 position = 0; // In the container buffer, in mtpPrime-s.
+	SerializedRequest request;
+};
+
 class SessionPrivate final : public QObject {
 public:
 	SessionPrivate(
@@ -117,6 +124,7 @@ private:
 
 	bool sendSecureRequest(
 		SerializedRequest &&request,
+		std::vector<GatheredMessage> &&gathered,
 		bool needAnyResponse);
 	mtpRequestId wasSent(mtpMsgId msgId) const;
 
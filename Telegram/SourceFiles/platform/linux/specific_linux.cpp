@@ -405,6 +405,14 @@ std::optional<crl::time> LastUserInputTime() {
 	return std::nullopt;
 }
 
+int64 PhysicalMemorySize() {
+	const auto pages = sysconf(_SC_PHYS_PAGES);
+	const auto pageSize = sysconf(_SC_PAGE_SIZE);
+	return (pages > 0 && pageSize > 0)
+		? int64(pages) * int64(pageSize)
+		: 0;
+}
+
 } // namespace Platform
 
 namespace {
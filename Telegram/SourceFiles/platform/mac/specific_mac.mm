@@ -25,6 +25,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include <cstdlib>
 #include <execinfo.h>
 #include <sys/xattr.h>
+#include <sys/sysctl.h>
 
 #include <Cocoa/Cocoa.h>
 #include <CoreFoundation/CFURL.h>
@@ -262,6 +263,14 @@ void IgnoreApplicationActivationRightNow() {
 	objc_ignoreApplicationActivationRightNow();
 }
 
+int64 PhysicalMemorySize() {
+	auto result = uint64(0);
+	auto size = sizeof(result);
+	return (sysctlbyname("hw.memsize", &result, &size, nullptr, 0) == 0)
+		? int64(result)
+		: 0;
+}
+
 } // namespace Platform
 
 void psNewVersion() {
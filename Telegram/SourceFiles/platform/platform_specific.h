@@ -41,6 +41,9 @@ bool OpenSystemSettings(SystemSettingsType type);
 
 void IgnoreApplicationActivationRightNow();
 
+// Zero if the size is unknown.
+[[nodiscard]] int64 PhysicalMemorySize();
+
 namespace ThirdParty {
 
 void start();
@@ -341,6 +341,14 @@ std::optional<crl::time> LastUserInputTime() {
 		: std::nullopt;
 }
 
+int64 PhysicalMemorySize() {
+	auto status = MEMORYSTATUSEX{ 0 };
+	status.dwLength = sizeof(MEMORYSTATUSEX);
+	return GlobalMemoryStatusEx(&status)
+		? int64(status.ullTotalPhys)
+		: 0;
+}
+
 } // namespace Platform
 
 namespace {
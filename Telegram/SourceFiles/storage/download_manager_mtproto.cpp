@@ -19,7 +19,7 @@ namespace {
 
 constexpr auto kKillSessionTimeout = 15 * crl::time(1000);
 constexpr auto kStartWaitedInSession = 4 * kDownloadPartSize;
-constexpr auto kMaxWaitedInSession = 16 * kDownloadPartSize;
+constexpr auto kMaxWaitedInSession = 8 * kMaxDownloadPartSize;
 constexpr auto kStartSessionsCount = 1;
 constexpr auto kMaxSessionsCount = 8;
 constexpr auto kMaxTrackedSessionRemoves = 64;
@@ -174,28 +174,34 @@ void DownloadManagerMtproto::checkSendNext(MTP::DcId dcId, Queue &queue) {
 bool DownloadManagerMtproto::trySendNextPart(MTP::DcId dcId, Queue &queue) {
 	auto &balanceData = _balanceData[dcId];
 	const auto &sessions = balanceData.sessions;
-	const auto bestIndex = [&] {
-		const auto proj = [](const DcSessionBalanceData &data) {
-			return (data.requested < data.maxWaitedAmount)
-				? data.requested
-				: kMaxWaitedInSession;
-		};
-		const auto j = ranges::min_element(sessions, ranges::less(), proj);
-		return (j->requested + kDownloadPartSize <= j->maxWaitedAmount)
-			? (j - begin(sessions))
-			: -1;
-	}();
-	if (bestIndex < 0) {
+	const auto proj = [](const DcSessionBalanceData &data) {
+		return (data.requested < data.maxWaitedAmount)
+			? data.requested
+			: kMaxWaitedInSession;
+	};
+	const auto j = ranges::min_element(sessions, ranges::less(), proj);
+	const auto available = j->maxWaitedAmount - j->requested;
+	if (available < kDownloadPartSize) {
 		return false;
 	}
 	const auto onlyHighestPriority = (balanceData.totalRequested > 0);
 	if (const auto task = queue.nextTask(onlyHighestPriority)) {
-		task->loadPart(bestIndex);
+		task->loadPart(
+			(j - begin(sessions)),
+			std::min(_rates.partSize(dcId), available));
 		return true;
 	}
 	return false;
 }
 
+int DownloadManagerMtproto::maxWaitedInSession(
+		MTP::DcId dcId,
+		const DcBalanceData &dc) const {
+	return std::min(
+		_rates.maxWaitedInSession(dcId, int(dc.sessions.size())),
+		kMaxWaitedInSession);
+}
+
 int DownloadManagerMtproto::changeRequestedAmount(
 		MTP::DcId dcId,
 		int index,
@@ -223,6 +229,8 @@ int DownloadManagerMtproto::changeRequestedAmount(
 void DownloadManagerMtproto::requestSucceeded(
 		MTP::DcId dcId,
 		int index,
+		int requested,
+		int received,
 		int amountAtRequestStart,
 		crl::time timeAtRequestStart) {
 	using namespace rpl::mappers;
@@ -238,17 +246,22 @@ void DownloadManagerMtproto::requestSucceeded(
 	auto &data = dc.sessions[index];
 	const auto overloaded = (timeAtRequestStart <= dc.lastSessionRemove)
 		|| (amountAtRequestStart > data.maxWaitedAmount);
-	const auto parts = amountAtRequestStart / kDownloadPartSize;
 	const auto duration = (crl::now() - timeAtRequestStart);
-	DEBUG_LOG(("Download (%1,%2) request done, duration: %3, parts: %4%5"
+	DEBUG_LOG(("Download (%1,%2) request done, duration: %3, "
+		"bytes: %4, waited: %5%6"
 		).arg(dcId
 		).arg(index
 		).arg(duration
-		).arg(parts
+		).arg(received
+		).arg(amountAtRequestStart
 		).arg(overloaded ? " (overloaded)" : ""));
 	if (overloaded) {
 		return;
 	}
+	if (received > 0) {
+		// Redirects carry no payload, there is nothing to measure.
+		_rates.requestFinished(dcId, received, duration);
+	}
 
 	if (duration >= kBadRequestDurationThreshold) {
 		DEBUG_LOG(("Duration too large, signaling time out."));
@@ -257,11 +270,14 @@ void DownloadManagerMtproto::requestSucceeded(
 		});
 		return;
 	}
-	if (amountAtRequestStart == data.maxWaitedAmount
-		&& data.maxWaitedAmount < kMaxWaitedInSession) {
+	const auto maxWaited = maxWaitedInSession(dcId, dc);
+	if (data.maxWaitedAmount > maxWaited) {
+		data.maxWaitedAmount = maxWaited;
+	} else if (amountAtRequestStart + kDownloadPartSize > data.maxWaitedAmount
+		&& data.maxWaitedAmount < maxWaited) {
 		data.maxWaitedAmount = std::min(
-			data.maxWaitedAmount + kDownloadPartSize,
-			kMaxWaitedInSession);
+			data.maxWaitedAmount + requested,
+			maxWaited);
 		DEBUG_LOG(("Download (%1,%2) increased max waited amount %3."
 			).arg(dcId
 			).arg(index
@@ -296,6 +312,10 @@ void DownloadManagerMtproto::requestSucceeded(
 		).arg(dc.sessions.size()));
 }
 
+int DownloadManagerMtproto::partSize(MTP::DcId dcId) const {
+	return _rates.partSize(dcId);
+}
+
 int DownloadManagerMtproto::chooseSessionIndex(MTP::DcId dcId) const {
 	const auto i = _balanceData.find(dcId);
 	Assert(i != end(_balanceData));
@@ -317,6 +337,7 @@ void DownloadManagerMtproto::sessionTimedOut(MTP::DcId dcId, int index) {
 		return;
 	}
 	DEBUG_LOG(("Download (%1,%2) session timed-out.").arg(dcId).arg(index));
+	_rates.requestTimedOut(dcId);
 	for (auto &session : dc.sessions) {
 		session.successes = 0;
 	}
@@ -393,11 +414,28 @@ void DownloadManagerMtproto::killSessions() {
 	}
 }
 
+void DownloadManagerMtproto::logStats(MTP::DcId dcId) const {
+	const auto stats = _rates.stats(dcId);
+	DEBUG_LOG(("Download (%1) stats: part size %2, max waited %3, "
+		"speed %4 KB/s, rtt %5 ms, loaded %6 KB in %7 requests, "
+		"timeouts %8."
+		).arg(dcId
+		).arg(stats.partSize
+		).arg(stats.maxWaitedInSession
+		).arg(stats.bytesPerSecond / 1024
+		).arg(stats.rtt
+		).arg(stats.loadedBytes / 1024
+		).arg(stats.requests
+		).arg(stats.timeouts));
+}
+
 void DownloadManagerMtproto::killSessions(MTP::DcId dcId) {
 	const auto i = _balanceData.find(dcId);
 	if (i != end(_balanceData)) {
 		auto &dc = i->second;
 		Assert(dc.totalRequested == 0);
+		logStats(dcId);
+		_rates.reset(dcId);
 		auto sessions = base::take(dc.sessions);
 		dc = DcBalanceData();
 		for (auto j = 0; j != int(sessions.size()); ++j) {
@@ -473,20 +511,33 @@ void DownloadMtprotoTask::refreshFileReferenceFrom(
 	}
 }
 
-void DownloadMtprotoTask::loadPart(int sessionIndex) {
-	makeRequest({ takeNextRequestOffset(), sessionIndex });
+void DownloadMtprotoTask::loadPart(int sessionIndex, int maxPartSize) {
+	// Only upload.getFile and upload.getCdnFile support larger parts.
+	const auto limit = base::get_if<StorageFileLocation>(&_location.data)
+		? maxPartSize
+		: kDownloadPartSize;
+	const auto part = takeNextRequest(limit);
+
+	Assert(part.limit >= kDownloadPartSize && part.limit <= limit);
+	Assert(!(part.offset % part.limit));
+	makeRequest({ part.offset, sessionIndex, part.limit });
 }
 
 void DownloadMtprotoTask::removeSession(int sessionIndex) {
 	struct Redirect {
 		mtpRequestId requestId = 0;
 		int offset = 0;
+		int limit = 0;
 	};
 	auto redirect = std::vector<Redirect>();
 	for (const auto &[requestId, requestData] : _sentRequests) {
 		if (requestData.sessionIndex == sessionIndex) {
 			redirect.reserve(_sentRequests.size());
-			redirect.push_back({ requestId, requestData.offset });
+			redirect.push_back({
+				requestId,
+				requestData.offset,
+				requestData.limit,
+			});
 		}
 	}
 	for (auto &[requestData, bytes] : _cdnUncheckedParts) {
@@ -496,13 +547,13 @@ void DownloadMtprotoTask::removeSession(int sessionIndex) {
 			requestData.sessionIndex = newIndex;
 		}
 	}
-	for (const auto &[requestId, offset] : redirect) {
+	for (const auto &[requestId, offset, limit] : redirect) {
 		const auto needMakeRequest = (requestId != _cdnHashesRequestId);
 		cancelRequest(requestId);
 		if (needMakeRequest) {
 			const auto newIndex = _owner->chooseSessionIndex(dcId());
 			Assert(newIndex < sessionIndex);
-			makeRequest({ offset, newIndex });
+			makeRequest({ offset, newIndex, limit });
 		}
 	}
 }
@@ -510,7 +561,7 @@ void DownloadMtprotoTask::removeSession(int sessionIndex) {
 mtpRequestId DownloadMtprotoTask::sendRequest(
 		const RequestData &requestData) {
 	const auto offset = requestData.offset;
-	const auto limit = Storage::kDownloadPartSize;
+	const auto limit = requestData.limit;
 	const auto shiftedDcId = MTP::downloadDcId(
 		_cdnDcId ? _cdnDcId : dcId(),
 		requestData.sessionIndex);
@@ -583,13 +634,16 @@ void DownloadMtprotoTask::requestMoreCdnFileHashes() {
 		return;
 	}
 
-	const auto requestData = _cdnUncheckedParts.cbegin()->first;
+	const auto &[requestData, bytes] = *_cdnUncheckedParts.cbegin();
+	const auto offset = firstMissingCdnHashOffset(
+		requestData.offset,
+		bytes.size());
 	const auto shiftedDcId = MTP::downloadDcId(
 		dcId(),
 		requestData.sessionIndex);
 	_cdnHashesRequestId = api().request(MTPupload_GetCdnFileHashes(
 		MTP_bytes(_cdnToken),
-		MTP_int(requestData.offset)
+		MTP_int(offset)
 	)).done([=](const MTPVector<MTPFileHash> &result, mtpRequestId id) {
 		getCdnFileHashesDone(result, id);
 	}).fail([=](const RPCError &error, mtpRequestId id) {
@@ -601,9 +655,15 @@ void DownloadMtprotoTask::requestMoreCdnFileHashes() {
 void DownloadMtprotoTask::normalPartLoaded(
 		const MTPupload_File &result,
 		mtpRequestId requestId) {
+	const auto received = result.match([](const MTPDupload_file &data) {
+		return data.vbytes().v.size();
+	}, [](const MTPDupload_fileCdnRedirect &data) {
+		return 0;
+	});
 	const auto requestData = finishSentRequest(
 		requestId,
-		FinishRequestReason::Success);
+		FinishRequestReason::Success,
+		received);
 	result.match([&](const MTPDupload_fileCdnRedirect &data) {
 		switchToCDN(requestData, data);
 	}, [&](const MTPDupload_file &data) {
@@ -617,7 +677,8 @@ void DownloadMtprotoTask::webPartLoaded(
 	result.match([&](const MTPDupload_webFile &data) {
 		const auto requestData = finishSentRequest(
 			requestId,
-			FinishRequestReason::Success);
+			FinishRequestReason::Success,
+			data.vbytes().v.size());
 		if (setWebFileSizeHook(data.vsize().v)) {
 			partLoaded(requestData.offset, data.vbytes().v);
 		}
@@ -644,7 +705,8 @@ void DownloadMtprotoTask::cdnPartLoaded(const MTPupload_CdnFile &result, mtpRequ
 	}, [&](const MTPDupload_cdnFile &data) {
 		const auto requestData = finishSentRequest(
 			requestId,
-			FinishRequestReason::Success);
+			FinishRequestReason::Success,
+			data.vbytes().v.size());
 		auto key = bytes::make_span(_cdnEncryptionKey);
 		auto iv = bytes::make_span(_cdnEncryptionIV);
 		Expects(key.size() == MTP::CTRState::KeySize);
@@ -684,17 +746,40 @@ void DownloadMtprotoTask::cdnPartLoaded(const MTPupload_CdnFile &result, mtpRequ
 	});
 }
 
+int DownloadMtprotoTask::firstMissingCdnHashOffset(
+		int offset,
+		int size) const {
+	const auto till = offset + size;
+	while (offset < till) {
+		const auto i = _cdnFileHashes.find(offset);
+		if (i == _cdnFileHashes.cend() || i->second.limit <= 0) {
+			return offset;
+		}
+		offset += i->second.limit;
+	}
+	return offset;
+}
+
 DownloadMtprotoTask::CheckCdnHashResult DownloadMtprotoTask::checkCdnFileHash(
 		int offset,
 		bytes::const_span buffer) {
-	const auto cdnFileHashIt = _cdnFileHashes.find(offset);
-	if (cdnFileHashIt == _cdnFileHashes.cend()) {
+	// Parts larger than kDownloadPartSize span several hashed blocks.
+	const auto size = int(buffer.size());
+	if (firstMissingCdnHashOffset(offset, size) < offset + size) {
 		return CheckCdnHashResult::NoHash;
 	}
-	const auto realHash = openssl::Sha256(buffer);
-	const auto receivedHash = bytes::make_span(cdnFileHashIt->second.hash);
-	if (bytes::compare(realHash, receivedHash)) {
-		return CheckCdnHashResult::Invalid;
+	while (!buffer.empty()) {
+		const auto &hash = _cdnFileHashes.find(offset)->second;
+		const auto block = buffer.subspan(
+			0,
+			std::min(std::size_t(hash.limit), buffer.size()));
+		const auto realHash = openssl::Sha256(block);
+		const auto receivedHash = bytes::make_span(hash.hash);
+		if (bytes::compare(realHash, receivedHash)) {
+			return CheckCdnHashResult::Invalid;
+		}
+		offset += block.size();
+		buffer = buffer.subspan(block.size());
 	}
 	return CheckCdnHashResult::Good;
 }
@@ -717,8 +802,9 @@ void DownloadMtprotoTask::getCdnFileHashesDone(
 	const auto requestData = finishSentRequest(
 		requestId,
 		FinishRequestReason::Redirect);
+	const auto hashesWere = _cdnFileHashes.size();
 	addCdnHashes(result.v);
-	auto someMoreChecked = false;
+	auto madeProgress = (_cdnFileHashes.size() > hashesWere);
 	for (auto i = _cdnUncheckedParts.begin(); i != _cdnUncheckedParts.cend();) {
 		const auto uncheckedData = i->first;
 		const auto uncheckedBytes = bytes::make_span(i->second);
@@ -736,7 +822,7 @@ void DownloadMtprotoTask::getCdnFileHashesDone(
 		} break;
 
 		case CheckCdnHashResult::Good: {
-			someMoreChecked = true;
+			madeProgress = true;
 			const auto goodOffset = uncheckedData.offset;
 			const auto goodBytes = std::move(i->second);
 			const auto weak = base::make_weak(this);
@@ -749,7 +835,7 @@ void DownloadMtprotoTask::getCdnFileHashesDone(
 		default: Unexpected("Result of checkCdnFileHash()");
 		}
 	}
-	if (!someMoreChecked) {
+	if (!madeProgress) {
 		LOG(("API Error: "
 			"Could not find cdnFileHash for offset %1 "
 			"after getCdnFileHashes request."
@@ -766,7 +852,7 @@ void DownloadMtprotoTask::placeSentRequest(
 	const auto amount = _owner->changeRequestedAmount(
 		dcId(),
 		requestData.sessionIndex,
-		Storage::kDownloadPartSize);
+		requestData.limit);
 	const auto [i, ok1] = _sentRequests.emplace(requestId, requestData);
 	const auto [j, ok2] = _requestByOffset.emplace(
 		requestData.offset,
@@ -780,7 +866,8 @@ void DownloadMtprotoTask::placeSentRequest(
 
 auto DownloadMtprotoTask::finishSentRequest(
 	mtpRequestId requestId,
-	FinishRequestReason reason)
+	FinishRequestReason reason,
+	int received)
 -> RequestData {
 	auto it = _sentRequests.find(requestId);
 	Assert(it != _sentRequests.cend());
@@ -792,7 +879,7 @@ auto DownloadMtprotoTask::finishSentRequest(
 	_owner->changeRequestedAmount(
 		dcId(),
 		result.sessionIndex,
-		-Storage::kDownloadPartSize);
+		-result.limit);
 	_sentRequests.erase(it);
 	const auto ok = _requestByOffset.remove(result.offset);
 
@@ -800,6 +887,8 @@ auto DownloadMtprotoTask::finishSentRequest(
 		_owner->requestSucceeded(
 			dcId(),
 			result.sessionIndex,
+			result.limit,
+			received,
 			result.requestedInSession,
 			result.sent);
 	}
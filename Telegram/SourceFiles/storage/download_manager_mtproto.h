@@ -8,6 +8,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #pragma once
 
 #include "data/data_file_origin.h"
+#include "storage/download_rate_controller.h"
 #include "base/timer.h"
 #include "base/weak_ptr.h"
 
@@ -16,12 +17,6 @@ class RPCError;
 
 namespace Storage {
 
-// Different part sizes are not supported for now :(
-// Because we start downloading with some part size
-// and then we get a CDN-redirect where we support only
-// fixed part size download for hash checking.
-constexpr auto kDownloadPartSize = 128 * 1024;
-
 class DownloadMtprotoTask;
 
 class DownloadManagerMtproto final : public base::has_weak_ptr {
@@ -46,9 +41,12 @@ public:
 	void requestSucceeded(
 		MTP::DcId dcId,
 		int index,
+		int requested,
+		int received,
 		int amountAtRequestStart,
 		crl::time timeAtRequestStart);
 	[[nodiscard]] int chooseSessionIndex(MTP::DcId dcId) const;
+	[[nodiscard]] int partSize(MTP::DcId dcId) const;
 
 private:
 	class Queue final {
@@ -89,11 +87,15 @@ private:
 	void checkSendNext();
 	void checkSendNext(MTP::DcId dcId, Queue &queue);
 	bool trySendNextPart(MTP::DcId dcId, Queue &queue);
+	[[nodiscard]] int maxWaitedInSession(
+		MTP::DcId dcId,
+		const DcBalanceData &dc) const;
 
 	void killSessionsSchedule(MTP::DcId dcId);
 	void killSessionsCancel(MTP::DcId dcId);
 	void killSessions();
 	void killSessions(MTP::DcId dcId);
+	void logStats(MTP::DcId dcId) const;
 
 	void resetGeneration();
 	void sessionTimedOut(MTP::DcId dcId, int index);
@@ -104,6 +106,7 @@ private:
 	base::Observable<void> _taskFinishedObservable;
 
 	base::flat_map<MTP::DcId, DcBalanceData> _balanceData;
+	DownloadRateController _rates;
 	base::Timer _resetGenerationTimer;
 
 	base::flat_map<MTP::DcId, crl::time> _killSessionsWhen;
@@ -139,7 +142,7 @@ public:
 	[[nodiscard]] const Location &location() const;
 
 	[[nodiscard]] virtual bool readyToRequest() const = 0;
-	void loadPart(int sessionIndex);
+	void loadPart(int sessionIndex, int maxPartSize);
 	void removeSession(int sessionIndex);
 
 	void refreshFileReferenceFrom(
@@ -148,6 +151,11 @@ public:
 		const QByteArray &current);
 
 protected:
+	struct PartRequest {
+		int offset = 0;
+		int limit = kDownloadPartSize;
+	};
+
 	[[nodiscard]] bool haveSentRequests() const;
 	[[nodiscard]] bool haveSentRequestForOffset(int offset) const;
 	void cancelAllRequests();
@@ -164,6 +172,7 @@ private:
 	struct RequestData {
 		int offset = 0;
 		mutable int sessionIndex = 0;
+		int limit = kDownloadPartSize;
 		int requestedInSession = 0;
 		crl::time sent = 0;
 
@@ -189,7 +198,8 @@ private:
 	};
 
 	// Called only if readyToRequest() == true.
-	[[nodiscard]] virtual int takeNextRequestOffset() = 0;
+	// Returned limit must not exceed maxPartSize, offset must be aligned to it.
+	[[nodiscard]] virtual PartRequest takeNextRequest(int maxPartSize) = 0;
 	virtual bool feedPart(int offset, const QByteArray &bytes) = 0;
 	virtual bool setWebFileSizeHook(int size);
 	virtual void cancelOnFail() = 0;
@@ -209,6 +219,9 @@ private:
 		const MTPVector<MTPFileHash> &result,
 		mtpRequestId requestId);
 	void requestMoreCdnFileHashes();
+	[[nodiscard]] int firstMissingCdnHashOffset(
+		int offset,
+		int size) const;
 	void getCdnFileHashesDone(
 		const MTPVector<MTPFileHash> &result,
 		mtpRequestId requestId);
@@ -228,7 +241,8 @@ private:
 		const RequestData &requestData);
 	[[nodiscard]] RequestData finishSentRequest(
 		mtpRequestId requestId,
-		FinishRequestReason reason);
+		FinishRequestReason reason,
+		int received = 0);
 	void switchToCDN(
 		const RequestData &requestData,
 		const MTPDupload_fileCdnRedirect &redirect);
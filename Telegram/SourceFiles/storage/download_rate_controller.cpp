@@ -0,0 +1,159 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "storage/download_rate_controller.h"
+
+namespace Storage {
+namespace {
+
+constexpr auto kThroughputWindow = crl::time(1000);
+constexpr auto kMinMaxWaitedInSession = 16 * kDownloadPartSize;
+constexpr auto kMaxMaxWaitedInSession = 8 * kMaxDownloadPartSize;
+constexpr auto kMinPartsInSession = 4;
+
+// We want at least that many parts to fit in one bandwidth-delay product,
+// so that a single slow part doesn't leave the link idle.
+constexpr auto kPartsInBandwidthDelay = 4;
+
+// Keep twice the bandwidth-delay product requested to never run dry.
+constexpr auto kBandwidthDelayMultiplier = 2;
+
+} // namespace
+
+int DownloadRateController::partSize(MTP::DcId dcId) const {
+	const auto i = _dcs.find(dcId);
+	return (i != end(_dcs)) ? i->second.partSize : kDownloadPartSize;
+}
+
+int DownloadRateController::maxWaitedInSession(
+		MTP::DcId dcId,
+		int sessionsCount) const {
+	Expects(sessionsCount > 0);
+
+	const auto i = _dcs.find(dcId);
+	if (i == end(_dcs)) {
+		return kMinMaxWaitedInSession;
+	}
+	const auto &data = i->second;
+	const auto total = kBandwidthDelayMultiplier * BandwidthDelayProduct(data);
+	const auto perSession = int(std::min(
+		(total + sessionsCount - 1) / sessionsCount,
+		int64(kMaxMaxWaitedInSession)));
+	return std::clamp(
+		perSession,
+		std::max(kMinMaxWaitedInSession, kMinPartsInSession * data.partSize),
+		kMaxMaxWaitedInSession);
+}
+
+void DownloadRateController::requestFinished(
+		MTP::DcId dcId,
+		int bytes,
+		crl::time duration) {
+	auto &data = _dcs[dcId];
+	const auto now = crl::now();
+
+	++data.requests;
+	data.loadedBytes += bytes;
+	if (!data.rtt || duration < data.rtt) {
+		data.rtt = std::max(duration, crl::time(1));
+	} else {
+		// Let the estimate slowly follow if the link became slower.
+		data.rtt += (duration - data.rtt) / 16;
+	}
+
+	if (!data.windowStart) {
+		data.windowStart = now;
+	}
+	data.windowBytes += bytes;
+	const auto elapsed = now - data.windowStart;
+	if (elapsed < kThroughputWindow) {
+		return;
+	}
+	const auto measured = data.windowBytes * 1000 / elapsed;
+	data.bytesPerSecond = data.bytesPerSecond
+		? ((data.bytesPerSecond * 3 + measured) / 4)
+		: measured;
+	data.windowStart = now;
+	data.windowBytes = 0;
+	updatePartSize(dcId, data);
+}
+
+void DownloadRateController::requestTimedOut(MTP::DcId dcId) {
+	auto &data = _dcs[dcId];
+	++data.timeouts;
+	data.windowStart = 0;
+	data.windowBytes = 0;
+	data.bytesPerSecond /= 2;
+	if (data.partSize > kDownloadPartSize) {
+		data.partSize /= 2;
+		DEBUG_LOG(("Download (%1) timed out, part size decreased to %2."
+			).arg(dcId
+			).arg(data.partSize));
+	}
+}
+
+void DownloadRateController::reset(MTP::DcId dcId) {
+	const auto i = _dcs.find(dcId);
+	if (i == end(_dcs)) {
+		return;
+	}
+	auto &data = i->second;
+	data.windowStart = 0;
+	data.windowBytes = 0;
+}
+
+DownloadDcStats DownloadRateController::stats(MTP::DcId dcId) const {
+	const auto i = _dcs.find(dcId);
+	if (i == end(_dcs)) {
+		return { dcId, kDownloadPartSize, kMinMaxWaitedInSession };
+	}
+	const auto &data = i->second;
+	auto result = DownloadDcStats();
+	result.dcId = dcId;
+	result.partSize = data.partSize;
+	result.maxWaitedInSession = maxWaitedInSession(dcId, 1);
+	result.bytesPerSecond = data.bytesPerSecond;
+	result.rtt = data.rtt;
+	result.loadedBytes = data.loadedBytes;
+	result.requests = data.requests;
+	result.timeouts = data.timeouts;
+	return result;
+}
+
+int DownloadRateController::AlignedPartSize(int offset, int limit) {
+	Expects(!(offset % kDownloadPartSize));
+
+	auto result = kDownloadPartSize;
+	while (result * 2 <= std::min(limit, kMaxDownloadPartSize)
+		&& !(offset % (result * 2))) {
+		result *= 2;
+	}
+	return result;
+}
+
+int64 DownloadRateController::BandwidthDelayProduct(const DcData &data) {
+	return data.bytesPerSecond * data.rtt / 1000;
+}
+
+void DownloadRateController::updatePartSize(MTP::DcId dcId, DcData &data) {
+	const auto wanted = BandwidthDelayProduct(data) / kPartsInBandwidthDelay;
+	const auto was = data.partSize;
+	if (wanted >= was * 2 && was < kMaxDownloadPartSize) {
+		data.partSize = was * 2;
+	} else if (wanted < was / 2 && was > kDownloadPartSize) {
+		data.partSize = was / 2;
+	}
+	if (data.partSize != was) {
+		DEBUG_LOG(("Download (%1) part size %2, speed: %3 KB/s, rtt: %4"
+			).arg(dcId
+			).arg(data.partSize
+			).arg(data.bytesPerSecond / 1024
+			).arg(data.rtt));
+	}
+}
+
+} // namespace Storage
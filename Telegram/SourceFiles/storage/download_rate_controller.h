@@ -0,0 +1,66 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+namespace Storage {
+
+// CDN file hashes are provided for blocks of this size,
+// so every part size must be a multiple of it.
+constexpr auto kDownloadPartSize = 128 * 1024;
+constexpr auto kMaxDownloadPartSize = 1024 * 1024;
+
+struct DownloadDcStats {
+	MTP::DcId dcId = 0;
+	int partSize = 0;
+	int maxWaitedInSession = 0;
+	int64 bytesPerSecond = 0;
+	crl::time rtt = 0;
+	int64 loadedBytes = 0;
+	int requests = 0;
+	int timeouts = 0;
+};
+
+// Chooses the download part size and the amount of bytes we allow
+// to wait for in a single session from the measured round trip time
+// and throughput of each datacenter.
+class DownloadRateController final {
+public:
+	[[nodiscard]] int partSize(MTP::DcId dcId) const;
+	[[nodiscard]] int maxWaitedInSession(
+		MTP::DcId dcId,
+		int sessionsCount) const;
+
+	void requestFinished(MTP::DcId dcId, int bytes, crl::time duration);
+	void requestTimedOut(MTP::DcId dcId);
+	void reset(MTP::DcId dcId);
+
+	[[nodiscard]] DownloadDcStats stats(MTP::DcId dcId) const;
+
+	// Largest part size not greater than limit with offset aligned to it.
+	[[nodiscard]] static int AlignedPartSize(int offset, int limit);
+
+private:
+	struct DcData {
+		int partSize = kDownloadPartSize;
+		int64 bytesPerSecond = 0;
+		crl::time rtt = 0;
+		crl::time windowStart = 0;
+		int64 windowBytes = 0;
+		int64 loadedBytes = 0;
+		int requests = 0;
+		int timeouts = 0;
+	};
+
+	void updatePartSize(MTP::DcId dcId, DcData &data);
+	[[nodiscard]] static int64 BandwidthDelayProduct(const DcData &data);
+
+	base::flat_map<MTP::DcId, DcData> _dcs;
+
+};
+
+} // namespace Storage
@@ -14,6 +14,8 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "mainwindow.h"
 #include "core/application.h"
 #include "storage/localstorage.h"
+#include "storage/file_download_writer.h"
+#include "ui/image/image_decode.h"
 #include "platform/platform_file_utilities.h"
 #include "main/main_session.h"
 #include "apiwrap.h"
@@ -35,7 +37,6 @@ FileLoader::FileLoader(
 , _autoLoading(autoLoading)
 , _cacheTag(cacheTag)
 , _filename(toFile)
-, _file(_filename)
 , _toCache(toCache)
 , _fromCloud(fromCloud)
 , _size(size)
@@ -43,7 +44,14 @@ FileLoader::FileLoader(
 	Expects(!_filename.isEmpty() || (_size <= Storage::kMaxFileInMemory));
 }
 
-FileLoader::~FileLoader() = default;
+FileLoader::~FileLoader() {
+	if (_fileId) {
+		session().fileWriter().finish(
+			_fileId,
+			Storage::FileWriter::Sync::None,
+			nullptr);
+	}
+}
 
 Main::Session &FileLoader::session() const {
 	return *_session;
@@ -53,26 +61,12 @@ void FileLoader::finishWithBytes(const QByteArray &data) {
 	_data = data;
 	_localStatus = LocalStatus::Loaded;
 	if (!_filename.isEmpty() && _toCache == LoadToCacheAsWell) {
-		if (!_fileIsOpen) _fileIsOpen = _file.open(QIODevice::WriteOnly);
-		if (!_fileIsOpen) {
-			cancel(true);
-			return;
-		}
-		_file.seek(0);
-		if (_file.write(_data) != qint64(_data.size())) {
-			cancel(true);
-			return;
-		}
+		writeWholeFile();
 	}
-
-	_finished = true;
-	if (_fileIsOpen) {
-		_file.close();
-		_fileIsOpen = false;
-		Platform::File::PostprocessDownloaded(
-			QFileInfo(_file).absoluteFilePath());
-	}
-	Auth().downloaderTaskFinished().notify();
+	finishFile([=] {
+		_finished = true;
+		Auth().downloaderTaskFinished().notify();
+	});
 }
 
 QByteArray FileLoader::imageFormat(const QSize &shrinkBox) const {
@@ -90,18 +84,35 @@ QImage FileLoader::imageData(const QSize &shrinkBox) const {
 }
 
 void FileLoader::readImage(const QSize &shrinkBox) const {
-	auto format = QByteArray();
-	auto image = App::readImage(_data, &format, false);
-	if (!image.isNull()) {
-		if (!shrinkBox.isEmpty() && (image.width() > shrinkBox.width() || image.height() > shrinkBox.height())) {
-			_imageData = image.scaled(shrinkBox, Qt::KeepAspectRatio, Qt::SmoothTransformation);
-		} else {
-			_imageData = std::move(image);
-		}
-		_imageFormat = format;
+	auto decoded = Images::Decode(_data, shrinkBox);
+	if (!decoded.image.isNull()) {
+		_imageData = std::move(decoded.image);
+		_imageFormat = std::move(decoded.format);
 	}
 }
 
+void FileLoader::setImageShrinkBox(QSize box) {
+	_imageShrinkBox = box;
+}
+
+void FileLoader::decodeImage(Fn<void()> done) {
+	if (_locationType != UnknownFileLocation
+		|| _data.isEmpty()
+		|| !_imageData.isNull()) {
+		done();
+		return;
+	}
+	_finishing = true;
+	_imageDecoding = Images::DecodeAsync(_data, _imageShrinkBox, [=](
+			Images::DecodedImage &&result) {
+		_finishing = false;
+		_imageData = std::move(result.image);
+		_imageFormat = std::move(result.format);
+		done();
+		notifyAboutProgress();
+	});
+}
+
 Data::FileOrigin FileLoader::fileOrigin() const {
 	return Data::FileOrigin();
 }
@@ -121,7 +132,6 @@ bool FileLoader::setFileName(const QString &fileName) {
 		return fileName.isEmpty() || (fileName == _filename);
 	}
 	_filename = fileName;
-	_file.setFileName(_filename);
 	return true;
 }
 
@@ -152,24 +162,22 @@ void FileLoader::localLoaded(
 }
 
 void FileLoader::start() {
-	if (_finished || tryLoadLocal()) {
+	if (_finished || _finishing || tryLoadLocal()) {
 		return;
 	} else if (_fromCloud == LoadFromLocalOnly) {
 		cancel();
 		return;
 	}
 
-	if (!_filename.isEmpty() && _toCache == LoadToFileOnly && !_fileIsOpen) {
-		_fileIsOpen = _file.open(QIODevice::WriteOnly);
-		if (!_fileIsOpen) {
-			return cancel(true);
-		}
+	if (!_filename.isEmpty() && _toCache == LoadToFileOnly && !_fileId) {
+		openFile();
 	}
 	startLoading();
 }
 
 void FileLoader::loadLocal(const Storage::Cache::Key &key) {
 	const auto readImage = (_locationType != AudioFileLocation);
+	const auto box = _imageShrinkBox;
 	auto done = [=, guard = _localLoading.make_guard()](
 			QByteArray &&value,
 			QImage &&image,
@@ -193,13 +201,12 @@ void FileLoader::loadLocal(const Storage::Cache::Key &key) {
 				value = std::move(value),
 				done = std::move(callback)
 			]() mutable {
-				auto format = QByteArray();
-				auto image = App::readImage(value, &format, false);
-				if (!image.isNull()) {
+				auto decoded = Images::Decode(value, box);
+				if (!decoded.image.isNull()) {
 					done(
 						std::move(value),
-						std::move(image),
-						std::move(format));
+						std::move(decoded.image),
+						std::move(decoded.format));
 				} else {
 					done(std::move(value), {}, {});
 				}
@@ -246,10 +253,11 @@ void FileLoader::cancel(bool fail) {
 
 	_cancelled = true;
 	_finished = true;
-	if (_fileIsOpen) {
-		_file.close();
-		_fileIsOpen = false;
-		_file.remove();
+	_finishing = false;
+	_imageDecoding = nullptr;
+	if (_fileId) {
+		session().fileWriter().cancel(base::take(_fileId), _filename);
+		_fileSize = 0;
 	}
 	_data = QByteArray();
 
@@ -261,12 +269,59 @@ void FileLoader::cancel(bool fail) {
 	}
 	if (weak) {
 		_filename = QString();
-		_file.setFileName(_filename);
 	}
 }
 
 int FileLoader::currentOffset() const {
-	return (_fileIsOpen ? _file.size() : _data.size()) - _skippedBytes;
+	return (_fileId ? _fileSize : _data.size()) - _skippedBytes;
+}
+
+void FileLoader::openFile() {
+	Expects(!_fileId);
+
+	_fileId = session().fileWriter().open(_filename, crl::guard(this, [=] {
+		if (!_cancelled) {
+			cancel(true);
+		}
+	}));
+	_fileSize = 0;
+}
+
+void FileLoader::writeWholeFile() {
+	if (!_fileId) {
+		openFile();
+	}
+	session().fileWriter().write(_fileId, 0, _data);
+	_fileSize = _data.size();
+}
+
+void FileLoader::finishFile(Fn<void()> done) {
+	if (!_fileId) {
+		done();
+		return;
+	}
+
+	// Files that are saved only to the disk are flushed before
+	// we report them ready, cached ones may be written again.
+	const auto sync = (_toCache == LoadToFileOnly)
+		? Storage::FileWriter::Sync::OnFinish
+		: Storage::FileWriter::Sync::None;
+	_finishing = true;
+	session().fileWriter().finish(_fileId, sync, crl::guard(this, [=](
+			bool success) {
+		_finishing = false;
+		if (_cancelled) {
+			return;
+		} else if (!success) {
+			cancel(true);
+			return;
+		}
+		_fileId = 0;
+		Platform::File::PostprocessDownloaded(
+			QFileInfo(_filename).absoluteFilePath());
+		done();
+		notifyAboutProgress();
+	}));
 }
 
 bool FileLoader::writeResultPart(int offset, bytes::const_span buffer) {
@@ -275,18 +330,19 @@ bool FileLoader::writeResultPart(int offset, bytes::const_span buffer) {
 	if (buffer.empty()) {
 		return true;
 	}
-	if (_fileIsOpen) {
-		auto fsize = _file.size();
-		if (offset < fsize) {
+	if (_fileId) {
+		if (offset < _fileSize) {
 			_skippedBytes -= buffer.size();
-		} else if (offset > fsize) {
-			_skippedBytes += offset - fsize;
-		}
-		_file.seek(offset);
-		if (_file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size()) != qint64(buffer.size())) {
-			cancel(true);
-			return false;
+		} else if (offset > _fileSize) {
+			_skippedBytes += offset - _fileSize;
 		}
+		session().fileWriter().write(
+			_fileId,
+			offset,
+			QByteArray(
+				reinterpret_cast<const char*>(buffer.data()),
+				buffer.size()));
+		accumulate_max(_fileSize, int(offset + buffer.size()));
 		return true;
 	}
 	_data.reserve(offset + buffer.size());
@@ -312,20 +368,10 @@ bool FileLoader::writeResultPart(int offset, bytes::const_span buffer) {
 QByteArray FileLoader::readLoadedPartBack(int offset, int size) {
 	Expects(offset >= 0 && size > 0);
 
-	if (_fileIsOpen) {
-		if (_file.openMode() == QIODevice::WriteOnly) {
-			_file.close();
-			_fileIsOpen = _file.open(QIODevice::ReadWrite);
-			if (!_fileIsOpen) {
-				cancel(true);
-				return QByteArray();
-			}
-		}
-		if (!_file.seek(offset)) {
-			return QByteArray();
-		}
-		auto result = _file.read(size);
-		return (result.size() == size) ? result : QByteArray();
+	if (_fileId) {
+		return (offset + size <= _fileSize)
+			? session().fileWriter().readBack(_fileId, offset, size)
+			: QByteArray();
 	}
 	return (offset + size <= _data.size())
 		? _data.mid(offset, size)
@@ -336,29 +382,9 @@ bool FileLoader::finalizeResult() {
 	Expects(!_finished);
 
 	if (!_filename.isEmpty() && (_toCache == LoadToCacheAsWell)) {
-		if (!_fileIsOpen) {
-			_fileIsOpen = _file.open(QIODevice::WriteOnly);
-		}
-		_file.seek(0);
-		if (!_fileIsOpen || _file.write(_data) != qint64(_data.size())) {
-			cancel(true);
-			return false;
-		}
-	}
-
-	_finished = true;
-	if (_fileIsOpen) {
-		_file.close();
-		_fileIsOpen = false;
-		Platform::File::PostprocessDownloaded(
-			QFileInfo(_file).absoluteFilePath());
+		writeWholeFile();
 	}
 	if (_localStatus == LocalStatus::NotFound) {
-		if (const auto key = fileLocationKey()) {
-			if (!_filename.isEmpty()) {
-				Local::writeFileLocation(*key, FileLocation(_filename));
-			}
-		}
 		if ((_toCache == LoadToCacheAsWell)
 			&& (_data.size() <= Storage::kMaxFileInMemory)) {
 			session().data().cache().put(
@@ -368,6 +394,18 @@ bool FileLoader::finalizeResult() {
 					_cacheTag));
 		}
 	}
-	Auth().downloaderTaskFinished().notify();
+	finishFile([=] {
+		if (_localStatus == LocalStatus::NotFound) {
+			if (const auto key = fileLocationKey()) {
+				if (!_filename.isEmpty()) {
+					Local::writeFileLocation(*key, FileLocation(_filename));
+				}
+			}
+		}
+		decodeImage([=] {
+			_finished = true;
+			Auth().downloaderTaskFinished().notify();
+		});
+	});
 	return true;
 }
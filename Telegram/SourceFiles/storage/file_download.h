@@ -95,6 +95,7 @@ public:
 	int fullSize() const;
 
 	bool setFileName(const QString &filename); // set filename for loaders to cache
+	void setImageShrinkBox(QSize box);
 	void permitLoadFromCloud();
 
 	void start();
@@ -141,17 +142,28 @@ protected:
 	bool finalizeResult();
 	[[nodiscard]] QByteArray readLoadedPartBack(int offset, int size);
 
+	void openFile();
+	void writeWholeFile();
+
+	// Calls done right away if there is no file, otherwise after
+	// the file is written and closed in the session file writer.
+	void finishFile(Fn<void()> done);
+
+	// Images are decoded in the background before the loader is finished.
+	void decodeImage(Fn<void()> done);
+
 	const not_null<Main::Session*> _session;
 
 	bool _autoLoading = false;
 	uint8 _cacheTag = 0;
 	bool _finished = false;
+	bool _finishing = false;
 	bool _cancelled = false;
 	mutable LocalStatus _localStatus = LocalStatus::NotTried;
 
 	QString _filename;
-	QFile _file;
-	bool _fileIsOpen = false;
+	uint64 _fileId = 0;
+	int _fileSize = 0;
 
 	LoadToCacheSetting _toCache;
 	LoadFromCloudSetting _fromCloud;
@@ -163,6 +175,8 @@ protected:
 	LocationType _locationType = LocationType();
 
 	base::binary_guard _localLoading;
+	base::binary_guard _imageDecoding;
+	QSize _imageShrinkBox;
 	mutable QByteArray _imageFormat;
 	mutable QImage _imageData;
 
@@ -93,12 +93,15 @@ bool mtpFileLoader::readyToRequest() const {
 		&& (!_size || _nextRequestOffset < _size);
 }
 
-int mtpFileLoader::takeNextRequestOffset() {
+auto mtpFileLoader::takeNextRequest(int maxPartSize) -> PartRequest {
 	Expects(readyToRequest());
 
-	const auto result = _nextRequestOffset;
-	_nextRequestOffset += Storage::kDownloadPartSize;
-	return result;
+	const auto offset = _nextRequestOffset;
+	const auto limit = Storage::DownloadRateController::AlignedPartSize(
+		offset,
+		maxPartSize);
+	_nextRequestOffset += limit;
+	return { offset, limit };
 }
 
 bool mtpFileLoader::feedPart(int offset, const QByteArray &bytes) {
@@ -47,7 +47,7 @@ private:
 	void cancelHook() override;
 
 	bool readyToRequest() const override;
-	int takeNextRequestOffset() override;
+	PartRequest takeNextRequest(int maxPartSize) override;
 	bool feedPart(int offset, const QByteArray &bytes) override;
 	void cancelOnFail() override;
 	bool setWebFileSizeHook(int size) override;
@@ -0,0 +1,279 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "storage/file_download_writer.h"
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <io.h>
+#else // Q_OS_WIN
+#include <unistd.h>
+#endif // Q_OS_WIN
+
+namespace Storage {
+namespace {
+
+// Adjacent parts are joined until they reach this size.
+constexpr auto kMaxPendingSize = 1024 * 1024;
+
+bool SyncToDisk(QFile &file) {
+	if (!file.flush()) {
+		return false;
+	}
+#ifdef Q_OS_WIN
+	const auto handle = HANDLE(_get_osfhandle(file.handle()));
+	return (handle != INVALID_HANDLE_VALUE) && FlushFileBuffers(handle);
+#else // Q_OS_WIN
+	return !fsync(file.handle());
+#endif // Q_OS_WIN
+}
+
+} // namespace
+
+namespace details {
+
+class FileWriterObject final {
+public:
+	explicit FileWriterObject(crl::weak_on_queue<FileWriterObject> weak);
+
+	void open(uint64 id, const QString &path, Fn<void()> failed);
+	void write(uint64 id, int64 offset, const QByteArray &bytes);
+	[[nodiscard]] bool finish(uint64 id, FileWriter::Sync sync);
+	void cancel(uint64 id, const QString &path);
+
+private:
+	struct File {
+		explicit File(const QString &path) : file(path) {
+		}
+
+		QFile file;
+		Fn<void()> failed;
+	};
+
+	[[nodiscard]] File *find(uint64 id);
+	void fail(uint64 id);
+
+	crl::weak_on_queue<FileWriterObject> _weak;
+	base::flat_map<uint64, std::unique_ptr<File>> _files;
+
+};
+
+FileWriterObject::FileWriterObject(crl::weak_on_queue<FileWriterObject> weak)
+: _weak(std::move(weak)) {
+}
+
+void FileWriterObject::open(
+		uint64 id,
+		const QString &path,
+		Fn<void()> failed) {
+	auto file = std::make_unique<File>(path);
+	file->failed = std::move(failed);
+	const auto i = _files.emplace(id, std::move(file)).first;
+	if (!i->second->file.open(QIODevice::WriteOnly)) {
+		LOG(("Download Error: Could not open '%1' for writing."
+			).arg(path));
+		fail(id);
+	}
+}
+
+void FileWriterObject::write(
+		uint64 id,
+		int64 offset,
+		const QByteArray &bytes) {
+	const auto file = find(id);
+	if (!file) {
+		return;
+	} else if (!file->file.seek(offset)
+		|| file->file.write(bytes) != qint64(bytes.size())
+		|| !file->file.flush()) {
+		LOG(("Download Error: Could not write %1 bytes at %2 to '%3'."
+			).arg(bytes.size()
+			).arg(offset
+			).arg(file->file.fileName()));
+		fail(id);
+	}
+}
+
+bool FileWriterObject::finish(uint64 id, FileWriter::Sync sync) {
+	const auto file = find(id);
+	if (!file) {
+		return false;
+	} else if (sync == FileWriter::Sync::OnFinish
+		&& !SyncToDisk(file->file)) {
+		LOG(("Download Error: Could not sync '%1' to disk."
+			).arg(file->file.fileName()));
+	}
+	file->file.close();
+	_files.remove(id);
+	return true;
+}
+
+void FileWriterObject::cancel(uint64 id, const QString &path) {
+	if (const auto file = find(id)) {
+		file->file.close();
+		_files.remove(id);
+	}
+	if (!path.isEmpty()) {
+		QFile(path).remove();
+	}
+}
+
+auto FileWriterObject::find(uint64 id) -> File* {
+	const auto i = _files.find(id);
+	return (i != end(_files)) ? i->second.get() : nullptr;
+}
+
+void FileWriterObject::fail(uint64 id) {
+	const auto i = _files.find(id);
+	Assert(i != end(_files));
+
+	auto &file = i->second->file;
+	file.close();
+	file.remove();
+	crl::on_main(std::move(i->second->failed));
+	_files.erase(i);
+}
+
+} // namespace details
+
+FileWriter::FileWriter() = default;
+
+FileWriter::~FileWriter() = default;
+
+uint64 FileWriter::open(const QString &path, Fn<void()> failed) {
+	const auto id = ++_autoincrement;
+	_paths.emplace(id, path);
+	_wrapped.with([=](details::FileWriterObject &object) mutable {
+		object.open(id, path, std::move(failed));
+	});
+	return id;
+}
+
+void FileWriter::write(uint64 id, int64 offset, const QByteArray &bytes) {
+	const auto i = _pending.find(id);
+	if (i != end(_pending)) {
+		auto &pending = i->second;
+		if (pending.offset + pending.bytes.size() == offset
+			&& pending.bytes.size() + bytes.size() <= kMaxPendingSize) {
+			pending.bytes.append(bytes);
+			return;
+		}
+		flush(id);
+	}
+	_pending.emplace(id, Pending{ offset, bytes });
+	if (bytes.size() >= kMaxPendingSize) {
+		flush(id);
+	}
+}
+
+void FileWriter::flush(uint64 id) {
+	const auto i = _pending.find(id);
+	if (i == end(_pending)) {
+		return;
+	}
+	const auto weak = base::make_weak(this);
+	_writing[id].push_back(i->second);
+	_wrapped.with([=, pending = std::move(i->second)](
+			details::FileWriterObject &object) {
+		object.write(id, pending.offset, pending.bytes);
+		crl::on_main(weak, [=] {
+			partWritten(id);
+		});
+	});
+	_pending.erase(i);
+}
+
+void FileWriter::partWritten(uint64 id) {
+	const auto i = _writing.find(id);
+	if (i == end(_writing)) {
+		return;
+	}
+	i->second.erase(begin(i->second));
+	if (i->second.empty()) {
+		_writing.erase(i);
+	}
+}
+
+void FileWriter::forget(uint64 id) {
+	_paths.remove(id);
+	_pending.remove(id);
+	_writing.remove(id);
+}
+
+void FileWriter::finish(uint64 id, Sync sync, Fn<void(bool)> done) {
+	flush(id);
+	const auto weak = base::make_weak(this);
+	_wrapped.with([=](details::FileWriterObject &object) mutable {
+		const auto result = object.finish(id, sync);
+		if (done) {
+			crl::on_main([=, done = std::move(done)] {
+				done(result);
+			});
+		}
+		crl::on_main(weak, [=] {
+			forget(id);
+		});
+	});
+}
+
+void FileWriter::cancel(uint64 id, const QString &path) {
+	forget(id);
+	_wrapped.with([=](details::FileWriterObject &object) {
+		object.cancel(id, path);
+	});
+}
+
+QByteArray FileWriter::readBack(uint64 id, int64 offset, int size) {
+	Expects(size > 0);
+
+	const auto path = _paths.find(id);
+	if (path == end(_paths)) {
+		return QByteArray();
+	}
+
+	// Parts that may be not written yet, the later ones are more recent.
+	auto parts = std::vector<const Pending*>();
+	if (const auto i = _writing.find(id); i != end(_writing)) {
+		for (const auto &part : i->second) {
+			parts.push_back(&part);
+		}
+	}
+	if (const auto i = _pending.find(id); i != end(_pending)) {
+		parts.push_back(&i->second);
+	}
+	const auto till = offset + size;
+	for (const auto part : ranges::view::reverse(parts)) {
+		if (part->offset <= offset
+			&& part->offset + part->bytes.size() >= till) {
+			return part->bytes.mid(offset - part->offset, size);
+		}
+	}
+
+	// Everything passed to the queue before the not written parts is
+	// already flushed, so a separate read-only handle doesn't wait for it.
+	QFile file(path->second);
+	if (!file.open(QIODevice::ReadOnly) || !file.seek(offset)) {
+		return QByteArray();
+	}
+	auto result = file.read(size);
+	if (result.size() != size) {
+		return QByteArray();
+	}
+	for (const auto part : parts) {
+		const auto from = std::max(offset, part->offset);
+		const auto to = std::min(till, part->offset + part->bytes.size());
+		if (from < to) {
+			memcpy(
+				result.data() + (from - offset),
+				part->bytes.constData() + (from - part->offset),
+				to - from);
+		}
+	}
+	return result;
+}
+
+} // namespace Storage
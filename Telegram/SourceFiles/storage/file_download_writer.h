@@ -0,0 +1,64 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+#include "base/weak_ptr.h"
+
+#include <crl/crl_object_on_queue.h>
+
+namespace Storage {
+namespace details {
+class FileWriterObject;
+} // namespace details
+
+// Writes downloaded files in a single background queue, so that saving
+// large files doesn't block the main thread. Adjacent parts are joined
+// before being enqueued. All callbacks are called in the main thread.
+class FileWriter final : public base::has_weak_ptr {
+public:
+	enum class Sync {
+		None,
+		OnFinish, // Flush the file to the disk before reporting done.
+	};
+
+	FileWriter();
+	FileWriter(const FileWriter &other) = delete;
+	FileWriter &operator=(const FileWriter &other) = delete;
+	~FileWriter();
+
+	// The file is truncated, failed is called if it can't be written.
+	[[nodiscard]] uint64 open(const QString &path, Fn<void()> failed);
+	void write(uint64 id, int64 offset, const QByteArray &bytes);
+	void finish(uint64 id, Sync sync, Fn<void(bool)> done);
+	void cancel(uint64 id, const QString &path);
+
+	// Sees all previous writes, reads not written parts from memory.
+	[[nodiscard]] QByteArray readBack(uint64 id, int64 offset, int size);
+
+private:
+	struct Pending {
+		int64 offset = 0;
+		QByteArray bytes;
+	};
+
+	void flush(uint64 id);
+	void partWritten(uint64 id);
+	void forget(uint64 id);
+
+	uint64 _autoincrement = 0;
+	base::flat_map<uint64, QString> _paths;
+	base::flat_map<uint64, Pending> _pending;
+
+	// Parts passed to the queue, but not yet written, in the write order.
+	base::flat_map<uint64, std::vector<Pending>> _writing;
+
+	crl::object_on_queue<details::FileWriterObject> _wrapped;
+
+};
+
+} // namespace Storage
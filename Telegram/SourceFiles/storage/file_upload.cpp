@@ -17,8 +17,21 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 namespace Storage {
 namespace {
 
-// max 512kb uploaded at the same time in each session
-constexpr auto kMaxUploadFileParallelSize = MTP::kUploadSessionsCount * 512 * 1024;
+// Start with 512kb uploaded at the same time in each session.
+constexpr auto kStartUploadWindow = MTP::kUploadSessionsCount * 512 * 1024;
+constexpr auto kMinUploadWindow = 512 * 1024;
+constexpr auto kMaxUploadWindow = MTP::kUploadSessionsCount * 4 * 1024 * 1024;
+constexpr auto kMinUploadWindowIncrease = 16 * 1024;
+
+// If a part is acknowledged that many times slower than the fastest one
+// we consider the connection congested and halve the window.
+constexpr auto kCongestionLatencyMultiplier = 3;
+
+// Parts of that many files from the beginning of the queue are interleaved.
+constexpr auto kMaxUploadingFiles = 8;
+
+// Parts of each file read from disk and kept in memory before sending.
+constexpr auto kReadAheadParts = 4;
 
 constexpr auto kDocumentMaxPartsCount = 3000;
 
@@ -37,14 +50,112 @@ constexpr auto kDocumentUploadPartSize3 = 256 * 1024;
 // 512kb for large document ( <= 1500mb )
 constexpr auto kDocumentUploadPartSize4 = 512 * 1024;
 
-// One part each half second, if not uploaded faster.
-constexpr auto kUploadRequestInterval = crl::time(500);
-
 // How much time without upload causes additional session kill.
 constexpr auto kKillSessionTimeout = 15 * crl::time(000);
 
 } // namespace
 
+namespace details {
+
+class UploadPartsReader final {
+public:
+	explicit UploadPartsReader(crl::weak_on_queue<UploadPartsReader> weak);
+
+	struct Result {
+		QByteArray bytes;
+		QByteArray md5; // Hex, filled after the last part is read.
+	};
+	[[nodiscard]] Result read(
+		uint64 fileId,
+		const QString &path,
+		int32 index,
+		int32 partSize,
+		int32 partsCount,
+		bool computeMd5);
+	void close(uint64 fileId);
+	void clear();
+
+private:
+	struct File {
+		explicit File(const QString &path) : file(path) {
+		}
+
+		QFile file;
+		HashMd5 md5;
+		int32 nextIndex = 0;
+	};
+
+	crl::weak_on_queue<UploadPartsReader> _weak;
+	base::flat_map<uint64, std::unique_ptr<File>> _files;
+
+	// Files that could not be opened, later reads of them return nothing.
+	base::flat_set<uint64> _failed;
+
+};
+
+UploadPartsReader::UploadPartsReader(
+	crl::weak_on_queue<UploadPartsReader> weak)
+: _weak(std::move(weak)) {
+}
+
+auto UploadPartsReader::read(
+	uint64 fileId,
+	const QString &path,
+	int32 index,
+	int32 partSize,
+	int32 partsCount,
+	bool computeMd5)
+-> Result {
+	if (_failed.contains(fileId)) {
+		if (index + 1 == partsCount) {
+			_failed.remove(fileId);
+		}
+		return {};
+	}
+	auto i = _files.find(fileId);
+	if (i == end(_files)) {
+		auto file = std::make_unique<File>(path);
+		if (!file->file.open(QIODevice::ReadOnly)) {
+			if (index + 1 < partsCount) {
+				_failed.emplace(fileId);
+			}
+			return {};
+		}
+		i = _files.emplace(fileId, std::move(file)).first;
+	}
+	auto &file = *i->second;
+
+	// Reads for a single file are enqueued in order.
+	Assert(file.nextIndex == index);
+	++file.nextIndex;
+
+	auto result = Result();
+	result.bytes = file.file.read(partSize);
+	if (computeMd5) {
+		file.md5.feed(result.bytes.constData(), result.bytes.size());
+	}
+	if (index + 1 == partsCount) {
+		if (computeMd5) {
+			result.md5 = QByteArray(32, Qt::Uninitialized);
+			hashMd5Hex(file.md5.result(), result.md5.data());
+		}
+		_files.erase(i);
+	}
+	return result;
+}
+
+void UploadPartsReader::close(uint64 fileId) {
+	_files.remove(fileId);
+	_failed.remove(fileId);
+}
+
+void UploadPartsReader::clear() {
+	_files.clear();
+	_failed.clear();
+}
+
+} // namespace details
+
 struct Uploader::File {
 	File(const SendMediaReady &media);
 	File(const std::shared_ptr<FileLoadResult> &file);
@@ -61,22 +172,34 @@ struct Uploader::File {
 	SendMediaType type() const;
 	uint64 thumbId() const;
 	const QString &filename() const;
+	bool document() const;
+
+	UploadFileParts &parts();
+	uint64 partsOfId() const;
+	const QByteArray &content() const;
+	const QString &filepath() const;
+	bool finished() const;
 
 	HashMd5 md5Hash;
+	QByteArray docMd5;
 
-	std::unique_ptr<QFile> docFile;
+	// Parts read from disk on the reader queue, but not sent yet.
+	base::flat_map<int32, QByteArray> docReadParts;
+	int32 docReadRequested = 0;
 	int32 docSentParts = 0;
+	int32 docDoneParts = 0;
 	int32 docSize = 0;
 	int32 docPartSize = 0;
 	int32 docPartsCount = 0;
 
+	int32 requestsInFlight = 0;
+	bool started = false;
+
 };
 
 Uploader::File::File(const SendMediaReady &media) : media(media) {
 	partsCount = media.parts.size();
-	if (type() == SendMediaType::File
-		|| type() == SendMediaType::ThemeFile
-		|| type() == SendMediaType::Audio) {
+	if (document()) {
 		setDocSize(media.file.isEmpty()
 			? media.data.size()
 			: media.filesize);
@@ -90,9 +213,7 @@ Uploader::File::File(const std::shared_ptr<FileLoadResult> &file)
 		|| type() == SendMediaType::Secure)
 		? file->fileparts.size()
 		: file->thumbparts.size();
-	if (type() == SendMediaType::File
-		|| type() == SendMediaType::ThemeFile
-		|| type() == SendMediaType::Audio) {
+	if (document()) {
 		setDocSize(file->filesize);
 	} else {
 		docSize = docPartSize = docPartsCount = 0;
@@ -139,10 +260,52 @@ const QString &Uploader::File::filename() const {
 	return file ? file->filename : media.filename;
 }
 
+bool Uploader::File::document() const {
+	return (type() == SendMediaType::File)
+		|| (type() == SendMediaType::ThemeFile)
+		|| (type() == SendMediaType::Audio);
+}
+
+UploadFileParts &Uploader::File::parts() {
+	return file
+		? ((type() == SendMediaType::Photo
+			|| type() == SendMediaType::Secure)
+			? file->fileparts
+			: file->thumbparts)
+		: media.parts;
+}
+
+uint64 Uploader::File::partsOfId() const {
+	return file
+		? ((type() == SendMediaType::Photo
+			|| type() == SendMediaType::Secure)
+			? file->id
+			: file->thumbId)
+		: media.thumbId;
+}
+
+const QByteArray &Uploader::File::content() const {
+	return file ? file->content : media.data;
+}
+
+const QString &Uploader::File::filepath() const {
+	return file ? file->filepath : media.file;
+}
+
+bool Uploader::File::finished() const {
+	return !requestsInFlight
+		&& (docSentParts >= docPartsCount)
+		&& (file
+			? ((type() == SendMediaType::Photo
+				|| type() == SendMediaType::Secure)
+				? file->fileparts.isEmpty()
+				: file->thumbparts.isEmpty())
+			: media.parts.isEmpty());
+}
+
 Uploader::Uploader(not_null<ApiWrap*> api)
-: _api(api) {
-	nextTimer.setSingleShot(true);
-	connect(&nextTimer, SIGNAL(timeout()), this, SLOT(sendNext()));
+: _api(api)
+, _window(kStartUploadWindow) {
 	stopSessionsTimer.setSingleShot(true);
 	connect(&stopSessionsTimer, SIGNAL(timeout()), this, SLOT(stopSessions()));
 }
@@ -210,257 +373,363 @@ void Uploader::upload(
 	sendNext();
 }
 
-void Uploader::currentFailed() {
-	auto j = queue.find(uploadingId);
-	if (j != queue.end()) {
-		if (j->second.type() == SendMediaType::Photo) {
-			_photoFailed.fire_copy(j->first);
-		} else if (j->second.type() == SendMediaType::File
-			|| j->second.type() == SendMediaType::ThemeFile
-			|| j->second.type() == SendMediaType::Audio) {
-			const auto document = Auth().data().document(j->second.id());
-			if (document->uploading()) {
-				document->status = FileUploadFailed;
-			}
-			_documentFailed.fire_copy(j->first);
-		} else if (j->second.type() == SendMediaType::Secure) {
-			_secureFailed.fire_copy(j->first);
-		} else {
-			Unexpected("Type in Uploader::currentFailed.");
+void Uploader::failed(const FullMsgId &fullId) {
+	const auto i = queue.find(fullId);
+	if (i == queue.end()) {
+		return;
+	}
+	cancelRequests(fullId);
+
+	const auto type = i->second.type();
+	const auto id = i->second.id();
+	queue.erase(i);
+	_reader.with([=](details::UploadPartsReader &reader) {
+		reader.close(id);
+	});
+
+	if (type == SendMediaType::Photo) {
+		_photoFailed.fire_copy(fullId);
+	} else if (type == SendMediaType::File
+		|| type == SendMediaType::ThemeFile
+		|| type == SendMediaType::Audio) {
+		const auto document = Auth().data().document(id);
+		if (document->uploading()) {
+			document->status = FileUploadFailed;
 		}
-		queue.erase(j);
+		_documentFailed.fire_copy(fullId);
+	} else if (type == SendMediaType::Secure) {
+		_secureFailed.fire_copy(fullId);
+	} else {
+		Unexpected("Type in Uploader::failed.");
 	}
+}
 
-	requestsSent.clear();
-	docRequestsSent.clear();
-	dcMap.clear();
-	uploadingId = FullMsgId();
-	sentSize = 0;
-	for (int i = 0; i < MTP::kUploadSessionsCount; ++i) {
-		sentSizes[i] = 0;
+void Uploader::cancelRequests(const FullMsgId &fullId) {
+	for (auto i = begin(_requests); i != end(_requests);) {
+		if (i->second.fullId == fullId) {
+			MTP::cancel(i->first);
+			_sentSize -= i->second.size;
+			_sentSizes[i->second.dcIndex] -= i->second.size;
+			i = _requests.erase(i);
+		} else {
+			++i;
+		}
 	}
-
-	sendNext();
 }
 
 void Uploader::stopSessions() {
 	for (int i = 0; i < MTP::kUploadSessionsCount; ++i) {
 		MTP::stopSession(MTP::uploadDcId(i));
 	}
+	_window = kStartUploadWindow;
+	_minLatencies.clear();
 }
 
 void Uploader::sendNext() {
-	if (sentSize >= kMaxUploadFileParallelSize || _pausedId.msg) return;
+	if (_pausedId.msg) {
+		return;
+	}
+	finishReady();
 
-	bool stopping = stopSessionsTimer.isActive();
+	const auto stopping = stopSessionsTimer.isActive();
 	if (queue.empty()) {
 		if (!stopping) {
 			stopSessionsTimer.start(kKillSessionTimeout);
 		}
 		return;
-	}
-
-	if (stopping) {
+	} else if (stopping) {
 		stopSessionsTimer.stop();
 	}
-	auto i = uploadingId.msg ? queue.find(uploadingId) : queue.begin();
-	if (!uploadingId.msg) {
-		uploadingId = i->first;
-	} else if (i == queue.end()) {
-		i = queue.begin();
-		uploadingId = i->first;
-	}
-	auto &uploadingData = i->second;
-
-	auto todc = 0;
-	for (auto dc = 1; dc != MTP::kUploadSessionsCount; ++dc) {
-		if (sentSizes[dc] < sentSizes[todc]) {
-			todc = dc;
-		}
-	}
-
-	auto &parts = uploadingData.file
-		? ((uploadingData.type() == SendMediaType::Photo
-			|| uploadingData.type() == SendMediaType::Secure)
-			? uploadingData.file->fileparts
-			: uploadingData.file->thumbparts)
-		: uploadingData.media.parts;
-	const auto partsOfId = uploadingData.file
-		? ((uploadingData.type() == SendMediaType::Photo
-			|| uploadingData.type() == SendMediaType::Secure)
-			? uploadingData.file->id
-			: uploadingData.file->thumbId)
-		: uploadingData.media.thumbId;
-	if (parts.isEmpty()) {
-		if (uploadingData.docSentParts >= uploadingData.docPartsCount) {
-			if (requestsSent.empty() && docRequestsSent.empty()) {
-				const auto options = uploadingData.file
-					? uploadingData.file->to.options
-					: Api::SendOptions();
-				const auto edit = uploadingData.file &&
-					uploadingData.file->edit;
-				if (uploadingData.type() == SendMediaType::Photo) {
-					auto photoFilename = uploadingData.filename();
-					if (!photoFilename.endsWith(qstr(".jpg"), Qt::CaseInsensitive)) {
-						// Server has some extensions checking for inputMediaUploadedPhoto,
-						// so force the extension to be .jpg anyway. It doesn't matter,
-						// because the filename from inputFile is not used anywhere.
-						photoFilename += qstr(".jpg");
-					}
-					const auto md5 = uploadingData.file
-						? uploadingData.file->filemd5
-						: uploadingData.media.jpeg_md5;
-					const auto file = MTP_inputFile(
-						MTP_long(uploadingData.id()),
-						MTP_int(uploadingData.partsCount),
-						MTP_string(photoFilename),
-						MTP_bytes(md5));
-					_photoReady.fire({ uploadingId, options, file, edit });
-				} else if (uploadingData.type() == SendMediaType::File
-					|| uploadingData.type() == SendMediaType::ThemeFile
-					|| uploadingData.type() == SendMediaType::Audio) {
-					QByteArray docMd5(32, Qt::Uninitialized);
-					hashMd5Hex(uploadingData.md5Hash.result(), docMd5.data());
-
-					const auto file = (uploadingData.docSize > kUseBigFilesFrom)
-						? MTP_inputFileBig(
-							MTP_long(uploadingData.id()),
-							MTP_int(uploadingData.docPartsCount),
-							MTP_string(uploadingData.filename()))
-						: MTP_inputFile(
-							MTP_long(uploadingData.id()),
-							MTP_int(uploadingData.docPartsCount),
-							MTP_string(uploadingData.filename()),
-							MTP_bytes(docMd5));
-					if (uploadingData.partsCount) {
-						const auto thumbFilename = uploadingData.file
-							? uploadingData.file->thumbname
-							: (qsl("thumb.") + uploadingData.media.thumbExt);
-						const auto thumbMd5 = uploadingData.file
-							? uploadingData.file->thumbmd5
-							: uploadingData.media.jpeg_md5;
-						const auto thumb = MTP_inputFile(
-							MTP_long(uploadingData.thumbId()),
-							MTP_int(uploadingData.partsCount),
-							MTP_string(thumbFilename),
-							MTP_bytes(thumbMd5));
-						_thumbDocumentReady.fire({
-							uploadingId,
-							options,
-							file,
-							thumb,
-							edit });
-					} else {
-						_documentReady.fire({
-							uploadingId,
-							options,
-							file,
-							edit });
-					}
-				} else if (uploadingData.type() == SendMediaType::Secure) {
-					_secureReady.fire({
-						uploadingId,
-						uploadingData.id(),
-						uploadingData.partsCount });
-				}
-				queue.erase(uploadingId);
-				uploadingId = FullMsgId();
-				sendNext();
-			}
-			return;
-		}
 
-		auto &content = uploadingData.file
-			? uploadingData.file->content
-			: uploadingData.media.data;
-		QByteArray toSend;
-		if (content.isEmpty()) {
-			if (!uploadingData.docFile) {
-				const auto filepath = uploadingData.file
-					? uploadingData.file->filepath
-					: uploadingData.media.file;
-				uploadingData.docFile = std::make_unique<QFile>(filepath);
-				if (!uploadingData.docFile->open(QIODevice::ReadOnly)) {
-					currentFailed();
-					return;
-				}
-			}
-			toSend = uploadingData.docFile->read(uploadingData.docPartSize);
-			if (uploadingData.docSize <= kUseBigFilesFrom) {
-				uploadingData.md5Hash.feed(toSend.constData(), toSend.size());
-			}
-		} else {
-			const auto offset = uploadingData.docSentParts
-				* uploadingData.docPartSize;
-			toSend = content.mid(offset, uploadingData.docPartSize);
-			if ((uploadingData.type() == SendMediaType::File
-				|| uploadingData.type() == SendMediaType::ThemeFile
-				|| uploadingData.type() == SendMediaType::Audio)
-				&& uploadingData.docSentParts <= kUseBigFilesFrom) {
-				uploadingData.md5Hash.feed(toSend.constData(), toSend.size());
+	// Send parts of several files in round-robin order
+	// while we have space in the window.
+	auto ids = std::vector<FullMsgId>();
+	ids.reserve(kMaxUploadingFiles);
+	while (_sentSize < _window) {
+		ids.clear();
+		for (const auto &[fullId, file] : queue) {
+			ids.push_back(fullId);
+			if (ids.size() == kMaxUploadingFiles) {
+				break;
 			}
 		}
-		if ((toSend.size() > uploadingData.docPartSize)
-			|| ((toSend.size() < uploadingData.docPartSize
-				&& uploadingData.docSentParts + 1 != uploadingData.docPartsCount))) {
-			currentFailed();
-			return;
+		const auto after = ranges::upper_bound(ids, _lastSentId);
+		std::rotate(begin(ids), after, end(ids));
+
+		const auto sent = ranges::find_if(ids, [&](const FullMsgId &id) {
+			const auto i = queue.find(id);
+			return (i != queue.end()) && sendPart(id, i->second);
+		});
+		if (sent == end(ids)) {
+			break;
 		}
-		mtpRequestId requestId;
-		if (uploadingData.docSize > kUseBigFilesFrom) {
-			requestId = MTP::send(
-				MTPupload_SaveBigFilePart(
-					MTP_long(uploadingData.id()),
-					MTP_int(uploadingData.docSentParts),
-					MTP_int(uploadingData.docPartsCount),
-					MTP_bytes(toSend)),
-				rpcDone(&Uploader::partLoaded),
-				rpcFail(&Uploader::partFailed),
-				MTP::uploadDcId(todc));
-		} else {
-			requestId = MTP::send(
-				MTPupload_SaveFilePart(
-					MTP_long(uploadingData.id()),
-					MTP_int(uploadingData.docSentParts),
-					MTP_bytes(toSend)),
-				rpcDone(&Uploader::partLoaded),
-				rpcFail(&Uploader::partFailed),
-				MTP::uploadDcId(todc));
-		}
-		docRequestsSent.emplace(requestId, uploadingData.docSentParts);
-		dcMap.emplace(requestId, todc);
-		sentSize += uploadingData.docPartSize;
-		sentSizes[todc] += uploadingData.docPartSize;
+		_lastSentId = *sent;
+	}
+}
 
-		uploadingData.docSentParts++;
-	} else {
-		auto part = parts.begin();
+int32 Uploader::chooseSession() const {
+	return int32(ranges::min_element(_sentSizes) - begin(_sentSizes));
+}
 
+bool Uploader::sendPart(const FullMsgId &fullId, File &file) {
+	auto &parts = file.parts();
+	if (!parts.isEmpty()) {
+		const auto part = parts.begin();
+		const auto dcIndex = chooseSession();
 		const auto requestId = MTP::send(
 			MTPupload_SaveFilePart(
-				MTP_long(partsOfId),
+				MTP_long(file.partsOfId()),
 				MTP_int(part.key()),
 				MTP_bytes(part.value())),
 			rpcDone(&Uploader::partLoaded),
 			rpcFail(&Uploader::partFailed),
-			MTP::uploadDcId(todc));
-		requestsSent.emplace(requestId, part.value());
-		dcMap.emplace(requestId, todc);
-		sentSize += part.value().size();
-		sentSizes[todc] += part.value().size();
-
+			MTP::uploadDcId(dcIndex));
+		registerRequest(requestId, {
+			fullId,
+			dcIndex,
+			int32(part.value().size()),
+			crl::now(),
+			false });
 		parts.erase(part);
+		return true;
+	} else if (file.docSentParts >= file.docPartsCount) {
+		return false;
+	}
+
+	const auto &content = file.content();
+	if (!content.isEmpty()) {
+		// The content is held by the file until the upload is finished
+		// and the request serializes the part right away, so don't copy.
+		const auto offset = file.docSentParts * file.docPartSize;
+		const auto bytes = QByteArray::fromRawData(
+			content.constData() + offset,
+			std::min(file.docPartSize, content.size() - offset));
+		if (file.document() && file.docSize <= kUseBigFilesFrom) {
+			file.md5Hash.feed(bytes.constData(), bytes.size());
+		}
+		sendDocPart(fullId, file, bytes);
+		return true;
+	}
+
+	requestReadAhead(fullId, file);
+	const auto i = file.docReadParts.find(file.docSentParts);
+	if (i == end(file.docReadParts)) {
+		return false;
+	}
+	const auto bytes = std::move(i->second);
+	file.docReadParts.erase(i);
+	requestReadAhead(fullId, file);
+	sendDocPart(fullId, file, bytes);
+	return true;
+}
+
+void Uploader::sendDocPart(
+		const FullMsgId &fullId,
+		File &file,
+		const QByteArray &bytes) {
+	if (bytes.isEmpty()
+		|| (bytes.size() > file.docPartSize)
+		|| ((bytes.size() < file.docPartSize
+			&& file.docSentParts + 1 != file.docPartsCount))) {
+		failed(fullId);
+		return;
+	}
+	const auto dcIndex = chooseSession();
+	const auto requestId = (file.docSize > kUseBigFilesFrom)
+		? MTP::send(
+			MTPupload_SaveBigFilePart(
+				MTP_long(file.id()),
+				MTP_int(file.docSentParts),
+				MTP_int(file.docPartsCount),
+				MTP_bytes(bytes)),
+			rpcDone(&Uploader::partLoaded),
+			rpcFail(&Uploader::partFailed),
+			MTP::uploadDcId(dcIndex))
+		: MTP::send(
+			MTPupload_SaveFilePart(
+				MTP_long(file.id()),
+				MTP_int(file.docSentParts),
+				MTP_bytes(bytes)),
+			rpcDone(&Uploader::partLoaded),
+			rpcFail(&Uploader::partFailed),
+			MTP::uploadDcId(dcIndex));
+	registerRequest(requestId, {
+		fullId,
+		dcIndex,
+		file.docPartSize,
+		crl::now(),
+		true });
+	++file.docSentParts;
+}
+
+void Uploader::registerRequest(mtpRequestId requestId, Request &&request) {
+	const auto i = queue.find(request.fullId);
+	Assert(i != queue.end());
+
+	auto &file = i->second;
+	file.started = true;
+	++file.requestsInFlight;
+	_sentSize += request.size;
+	_sentSizes[request.dcIndex] += request.size;
+	_requests.emplace(requestId, std::move(request));
+}
+
+void Uploader::requestReadAhead(const FullMsgId &fullId, File &file) {
+	const auto fileId = file.id();
+	const auto path = file.filepath();
+	const auto partSize = file.docPartSize;
+	const auto partsCount = file.docPartsCount;
+	const auto computeMd5 = (file.docSize <= kUseBigFilesFrom);
+	while (file.docReadRequested < file.docPartsCount
+		&& (file.docReadRequested - file.docSentParts) < kReadAheadParts) {
+		const auto index = file.docReadRequested++;
+		_reader.with([=, weak = base::make_weak(this)](
+				details::UploadPartsReader &reader) {
+			auto result = reader.read(
+				fileId,
+				path,
+				index,
+				partSize,
+				partsCount,
+				computeMd5);
+			crl::on_main(weak, [
+				=,
+				bytes = std::move(result.bytes),
+				md5 = std::move(result.md5)
+			]() mutable {
+				const auto i = queue.find(fullId);
+				if (i != queue.end() && i->second.id() == fileId) {
+					partRead(fullId, index, std::move(bytes), std::move(md5));
+				}
+			});
+		});
+	}
+}
+
+void Uploader::partRead(
+		const FullMsgId &fullId,
+		int32 index,
+		QByteArray &&bytes,
+		QByteArray &&md5) {
+	const auto i = queue.find(fullId);
+	Assert(i != queue.end());
+
+	auto &file = i->second;
+	if (!md5.isEmpty()) {
+		file.docMd5 = std::move(md5);
+	}
+	file.docReadParts.emplace(index, std::move(bytes));
+	sendNext();
+}
+
+void Uploader::finishReady() {
+	for (auto i = queue.begin(); i != queue.end();) {
+		if (i->second.finished()) {
+			uploaded.emplace(i->first, std::move(i->second));
+			i = queue.erase(i);
+		} else {
+			++i;
+		}
+	}
+
+	// Files are reported in the order they were added to the queue,
+	// so that messages are sent in the same order.
+	while (!uploaded.empty()
+		&& (queue.empty() || uploaded.begin()->first < queue.begin()->first)) {
+		const auto i = uploaded.begin();
+		const auto fullId = i->first;
+		auto file = std::move(i->second);
+		uploaded.erase(i);
+		fileReady(fullId, file);
+	}
+}
+
+void Uploader::fileReady(const FullMsgId &fullId, File &file) {
+	const auto options = file.file
+		? file.file->to.options
+		: Api::SendOptions();
+	const auto edit = file.file && file.file->edit;
+	if (file.type() == SendMediaType::Photo) {
+		auto photoFilename = file.filename();
+		if (!photoFilename.endsWith(qstr(".jpg"), Qt::CaseInsensitive)) {
+			// Server has some extensions checking for inputMediaUploadedPhoto,
+			// so force the extension to be .jpg anyway. It doesn't matter,
+			// because the filename from inputFile is not used anywhere.
+			photoFilename += qstr(".jpg");
+		}
+		const auto md5 = file.file
+			? file.file->filemd5
+			: file.media.jpeg_md5;
+		const auto photo = MTP_inputFile(
+			MTP_long(file.id()),
+			MTP_int(file.partsCount),
+			MTP_string(photoFilename),
+			MTP_bytes(md5));
+		_photoReady.fire({ fullId, options, photo, edit });
+	} else if (file.document()) {
+		auto docMd5 = file.docMd5;
+		if (!file.content().isEmpty()) {
+			docMd5 = QByteArray(32, Qt::Uninitialized);
+			hashMd5Hex(file.md5Hash.result(), docMd5.data());
+		}
+		const auto document = (file.docSize > kUseBigFilesFrom)
+			? MTP_inputFileBig(
+				MTP_long(file.id()),
+				MTP_int(file.docPartsCount),
+				MTP_string(file.filename()))
+			: MTP_inputFile(
+				MTP_long(file.id()),
+				MTP_int(file.docPartsCount),
+				MTP_string(file.filename()),
+				MTP_bytes(docMd5));
+		if (file.partsCount) {
+			const auto thumbFilename = file.file
+				? file.file->thumbname
+				: (qsl("thumb.") + file.media.thumbExt);
+			const auto thumbMd5 = file.file
+				? file.file->thumbmd5
+				: file.media.jpeg_md5;
+			const auto thumb = MTP_inputFile(
+				MTP_long(file.thumbId()),
+				MTP_int(file.partsCount),
+				MTP_string(thumbFilename),
+				MTP_bytes(thumbMd5));
+			_thumbDocumentReady.fire({
+				fullId,
+				options,
+				document,
+				thumb,
+				edit });
+		} else {
+			_documentReady.fire({
+				fullId,
+				options,
+				document,
+				edit });
+		}
+	} else if (file.type() == SendMediaType::Secure) {
+		_secureReady.fire({
+			fullId,
+			file.id(),
+			file.partsCount });
 	}
-	nextTimer.start(kUploadRequestInterval);
 }
 
 void Uploader::cancel(const FullMsgId &msgId) {
 	uploaded.erase(msgId);
-	if (uploadingId == msgId) {
-		currentFailed();
+	const auto i = queue.find(msgId);
+	if (i == queue.end()) {
+		return;
+	} else if (i->second.started) {
+		failed(msgId);
 	} else {
-		queue.erase(msgId);
+		const auto id = i->second.id();
+		queue.erase(i);
+		_reader.with([=](details::UploadPartsReader &reader) {
+			reader.close(id);
+		});
 	}
+	sendNext();
 }
 
 void Uploader::pause(const FullMsgId &msgId) {
@@ -478,83 +747,104 @@ void Uploader::confirm(const FullMsgId &msgId) {
 void Uploader::clear() {
 	uploaded.clear();
 	queue.clear();
-	for (const auto &requestData : requestsSent) {
-		MTP::cancel(requestData.first);
-	}
-	requestsSent.clear();
-	for (const auto &requestData : docRequestsSent) {
-		MTP::cancel(requestData.first);
+	for (const auto &[requestId, request] : _requests) {
+		MTP::cancel(requestId);
 	}
-	docRequestsSent.clear();
-	dcMap.clear();
-	sentSize = 0;
+	_requests.clear();
+	_reader.with([](details::UploadPartsReader &reader) {
+		reader.clear();
+	});
+	_sentSize = 0;
 	for (int i = 0; i < MTP::kUploadSessionsCount; ++i) {
 		MTP::stopSession(MTP::uploadDcId(i));
-		sentSizes[i] = 0;
+		_sentSizes[i] = 0;
 	}
+	_window = kStartUploadWindow;
+	_minLatencies.clear();
 	stopSessionsTimer.stop();
 }
 
+void Uploader::updateWindow(int32 size, crl::time latency) {
+	// Parts of different sizes are sent together, so the latency of each
+	// part is compared only with the latency of parts of the same size.
+	auto &minLatency = _minLatencies[size];
+	if (!minLatency || latency < minLatency) {
+		minLatency = std::max(latency, crl::time(1));
+	} else {
+		// Let the base latency slowly follow the connection changes.
+		minLatency += (latency - minLatency) / 64;
+	}
+	if (latency > minLatency * kCongestionLatencyMultiplier) {
+		decreaseWindow(minLatency);
+		return;
+	}
+	// Additive increase: about one part for each window acknowledged.
+	const auto increase = std::max(
+		int64(size) * size / _window,
+		int64(kMinUploadWindowIncrease));
+	_window = int32(std::min(_window + increase, int64(kMaxUploadWindow)));
+}
+
+void Uploader::decreaseWindow(crl::time minLatency) {
+	const auto now = crl::now();
+	if (_lastWindowDecrease && now - _lastWindowDecrease < minLatency) {
+		return;
+	}
+	_lastWindowDecrease = now;
+	_window = std::max(_window / 2, kMinUploadWindow);
+	DEBUG_LOG(("Upload window decreased to %1, latency: %2"
+		).arg(_window
+		).arg(minLatency));
+}
+
 void Uploader::partLoaded(const MTPBool &result, mtpRequestId requestId) {
-	auto j = docRequestsSent.end();
-	auto i = requestsSent.find(requestId);
-	if (i == requestsSent.cend()) {
-		j = docRequestsSent.find(requestId);
-	}
-	if (i != requestsSent.cend() || j != docRequestsSent.cend()) {
-		if (mtpIsFalse(result)) { // failed to upload current file
-			currentFailed();
-			return;
-		} else {
-			auto dcIt = dcMap.find(requestId);
-			if (dcIt == dcMap.cend()) { // must not happen
-				currentFailed();
-				return;
-			}
-			auto dc = dcIt->second;
-			dcMap.erase(dcIt);
-
-			int32 sentPartSize = 0;
-			auto k = queue.find(uploadingId);
-			Assert(k != queue.cend());
-			auto &[fullId, file] = *k;
-			if (i != requestsSent.cend()) {
-				sentPartSize = i->second.size();
-				requestsSent.erase(i);
-			} else {
-				sentPartSize = file.docPartSize;
-				docRequestsSent.erase(j);
-			}
-			sentSize -= sentPartSize;
-			sentSizes[dc] -= sentPartSize;
-			if (file.type() == SendMediaType::Photo) {
-				file.fileSentSize += sentPartSize;
-				const auto photo = Auth().data().photo(file.id());
-				if (photo->uploading() && file.file) {
-					photo->uploadingData->size = file.file->partssize;
-					photo->uploadingData->offset = file.fileSentSize;
-				}
-				_photoProgress.fire_copy(fullId);
-			} else if (file.type() == SendMediaType::File
-				|| file.type() == SendMediaType::ThemeFile
-				|| file.type() == SendMediaType::Audio) {
-				const auto document = Auth().data().document(file.id());
-				if (document->uploading()) {
-					const auto doneParts = file.docSentParts
-						- int(docRequestsSent.size());
-					document->uploadingData->offset = std::min(
-						document->uploadingData->size,
-						doneParts * file.docPartSize);
-				}
-				_documentProgress.fire_copy(fullId);
-			} else if (file.type() == SendMediaType::Secure) {
-				file.fileSentSize += sentPartSize;
-				_secureProgress.fire_copy({
-					fullId,
-					file.fileSentSize,
-					file.file->partssize });
-			}
+	const auto i = _requests.find(requestId);
+	if (i == end(_requests)) {
+		sendNext();
+		return;
+	}
+	const auto request = i->second;
+	_requests.erase(i);
+	_sentSize -= request.size;
+	_sentSizes[request.dcIndex] -= request.size;
+
+	const auto fullId = request.fullId;
+	const auto k = queue.find(fullId);
+	Assert(k != queue.end());
+	auto &file = k->second;
+	--file.requestsInFlight;
+	if (mtpIsFalse(result)) { // failed to upload current file
+		failed(fullId);
+		sendNext();
+		return;
+	}
+	updateWindow(request.size, crl::now() - request.sent);
+
+	if (file.type() == SendMediaType::Photo) {
+		file.fileSentSize += request.size;
+		const auto photo = Auth().data().photo(file.id());
+		if (photo->uploading() && file.file) {
+			photo->uploadingData->size = file.file->partssize;
+			photo->uploadingData->offset = file.fileSentSize;
+		}
+		_photoProgress.fire_copy(fullId);
+	} else if (file.document()) {
+		const auto document = Auth().data().document(file.id());
+		if (request.docPart) {
+			++file.docDoneParts;
+		}
+		if (document->uploading()) {
+			document->uploadingData->offset = std::min(
+				document->uploadingData->size,
+				file.docDoneParts * file.docPartSize);
 		}
+		_documentProgress.fire_copy(fullId);
+	} else if (file.type() == SendMediaType::Secure) {
+		file.fileSentSize += request.size;
+		_secureProgress.fire_copy({
+			fullId,
+			file.fileSentSize,
+			file.file->partssize });
 	}
 
 	sendNext();
@@ -564,9 +854,12 @@ bool Uploader::partFailed(const RPCError &error, mtpRequestId requestId) {
 	if (MTP::isDefaultHandledError(error)) return false;
 
 	// failed to upload current file
-	if ((requestsSent.find(requestId) != requestsSent.cend())
-		|| (docRequestsSent.find(requestId) != docRequestsSent.cend())) {
-		currentFailed();
+	const auto i = _requests.find(requestId);
+	if (i != end(_requests)) {
+		const auto fullId = i->second.fullId;
+		const auto j = _minLatencies.find(i->second.size);
+		decreaseWindow((j != end(_minLatencies)) ? j->second : 0);
+		failed(fullId);
 	}
 	sendNext();
 	return true;
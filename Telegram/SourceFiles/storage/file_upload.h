@@ -9,14 +9,19 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 
 #include "api/api_common.h"
 #include "mtproto/facade.h"
+#include "base/weak_ptr.h"
 
 #include <QtCore/QTimer>
+#include <crl/crl_object_on_queue.h>
 
 class ApiWrap;
 struct FileLoadResult;
 struct SendMediaReady;
 
 namespace Storage {
+namespace details {
+class UploadPartsReader;
+} // namespace details
 
 // MTP big files methods used for files greater than 10mb.
 constexpr auto kUseBigFilesFrom = 10 * 1024 * 1024;
@@ -55,7 +60,10 @@ struct UploadSecureDone {
 	int partsCount = 0;
 };
 
-class Uploader : public QObject, public RPCSender {
+class Uploader
+	: public QObject
+	, public RPCSender
+	, public base::has_weak_ptr {
 	Q_OBJECT
 
 public:
@@ -111,24 +119,57 @@ public slots:
 
 private:
 	struct File;
+	struct Request {
+		FullMsgId fullId;
+		int32 dcIndex = 0;
+		int32 size = 0;
+		crl::time sent = 0;
+		bool docPart = false;
+	};
+
+	bool sendPart(const FullMsgId &fullId, File &file);
+	void sendDocPart(
+		const FullMsgId &fullId,
+		File &file,
+		const QByteArray &bytes);
+	void registerRequest(mtpRequestId requestId, Request &&request);
+	void requestReadAhead(const FullMsgId &fullId, File &file);
+	void partRead(
+		const FullMsgId &fullId,
+		int32 index,
+		QByteArray &&bytes,
+		QByteArray &&md5);
+	void finishReady();
+	void fileReady(const FullMsgId &fullId, File &file);
+	[[nodiscard]] int32 chooseSession() const;
 
 	void partLoaded(const MTPBool &result, mtpRequestId requestId);
 	bool partFailed(const RPCError &err, mtpRequestId requestId);
 
-	void currentFailed();
+	void updateWindow(int32 size, crl::time latency);
+	void decreaseWindow(crl::time minLatency);
+	void cancelRequests(const FullMsgId &fullId);
+	void failed(const FullMsgId &fullId);
 
 	not_null<ApiWrap*> _api;
-	base::flat_map<mtpRequestId, QByteArray> requestsSent;
-	base::flat_map<mtpRequestId, int32> docRequestsSent;
-	base::flat_map<mtpRequestId, int32> dcMap;
-	uint32 sentSize = 0;
-	uint32 sentSizes[MTP::kUploadSessionsCount] = { 0 };
+	base::flat_map<mtpRequestId, Request> _requests;
+	int32 _sentSize = 0;
+	std::array<int32, MTP::kUploadSessionsCount> _sentSizes = { { 0 } };
 
-	FullMsgId uploadingId;
+	// Amount of bytes allowed in flight, adjusted by ack latency.
+	int32 _window = 0;
+	base::flat_map<int32, crl::time> _minLatencies;
+	crl::time _lastWindowDecrease = 0;
+
+	FullMsgId _lastSentId;
 	FullMsgId _pausedId;
 	std::map<FullMsgId, File> queue;
+
+	// Finished files waiting for the files before them to be reported.
 	std::map<FullMsgId, File> uploaded;
-	QTimer nextTimer, stopSessionsTimer;
+	QTimer stopSessionsTimer;
+
+	crl::object_on_queue<details::UploadPartsReader> _reader;
 
 	rpl::event_stream<UploadedPhoto> _photoReady;
 	rpl::event_stream<UploadedDocument> _documentReady;
@@ -32,6 +32,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 
 namespace {
 
+constexpr auto kMaxTaskQueueThreads = 8;
 constexpr auto kThumbnailQuality = 87;
 constexpr auto kThumbnailSize = 320;
 constexpr auto kPhotoUploadPartSize = 32 * 1024;
@@ -241,7 +242,10 @@ SendMediaReady PreparePeerPhoto(PeerId peerId, QImage &&image) {
 		0);
 }
 
-TaskQueue::TaskQueue(crl::time stopTimeoutMs) {
+TaskQueue::TaskQueue(crl::time stopTimeoutMs, int maxThreads)
+: _maxThreads((maxThreads > 0)
+	? maxThreads
+	: std::clamp(QThread::idealThreadCount(), 1, kMaxTaskQueueThreads)) {
 	if (stopTimeoutMs > 0) {
 		_stopTimer = new QTimer(this);
 		connect(_stopTimer, SIGNAL(timeout()), this, SLOT(stop()));
@@ -250,11 +254,15 @@ TaskQueue::TaskQueue(crl::time stopTimeoutMs) {
 	}
 }
 
-TaskId TaskQueue::addTask(std::unique_ptr<Task> &&task) {
+TaskId TaskQueue::addTask(std::unique_ptr<Task> &&task, int priority) {
 	const auto result = task->id();
 	{
 		QMutexLocker lock(&_tasksToProcessMutex);
-		_tasksToProcess.push_back(std::move(task));
+		_tasksToProcess.push_back({
+			std::move(task),
+			priority,
+			++_ordersCounter
+		});
 	}
 
 	wakeThread();
@@ -262,11 +270,17 @@ TaskId TaskQueue::addTask(std::unique_ptr<Task> &&task) {
 	return result;
 }
 
-void TaskQueue::addTasks(std::vector<std::unique_ptr<Task>> &&tasks) {
+void TaskQueue::addTasks(
+		std::vector<std::unique_ptr<Task>> &&tasks,
+		int priority) {
 	{
 		QMutexLocker lock(&_tasksToProcessMutex);
 		for (auto &task : tasks) {
-			_tasksToProcess.push_back(std::move(task));
+			_tasksToProcess.push_back({
+				std::move(task),
+				priority,
+				++_ordersCounter
+			});
 		}
 	}
 
@@ -274,74 +288,161 @@ void TaskQueue::addTasks(std::vector<std::unique_ptr<Task>> &&tasks) {
 }
 
 void TaskQueue::wakeThread() {
-	if (!_thread) {
-		_thread = new QThread();
-
-		_worker = new TaskQueueWorker(this);
-		_worker->moveToThread(_thread);
+	const auto wanted = [&] {
+		QMutexLocker lock(&_tasksToProcessMutex);
+		return std::min(
+			int(_tasksToProcess.size() + _tasksInProcess.size()),
+			_maxThreads);
+	}();
+	while (int(_threads.size()) < wanted) {
+		const auto thread = new QThread();
+		const auto worker = new TaskQueueWorker(this);
+		worker->moveToThread(thread);
 
-		connect(this, SIGNAL(taskAdded()), _worker, SLOT(onTaskAdded()));
-		connect(_worker, SIGNAL(taskProcessed()), this, SLOT(onTaskProcessed()));
+		connect(this, SIGNAL(taskAdded()), worker, SLOT(onTaskAdded()));
+		connect(worker, SIGNAL(taskProcessed()), this, SLOT(onTaskProcessed()));
 
-		_thread->start();
+		thread->start();
+		_threads.push_back(thread);
+		_workers.push_back(worker);
 	}
 	if (_stopTimer) _stopTimer->stop();
 	emit taskAdded();
 }
 
 void TaskQueue::cancelTask(TaskId id) {
-	const auto removeFrom = [&](std::deque<std::unique_ptr<Task>> &queue) {
-		const auto proj = [](const std::unique_ptr<Task> &task) {
-			return task->id();
-		};
-		auto i = ranges::find(queue, id, proj);
-		if (i != queue.end()) {
-			queue.erase(i);
-		}
+	const auto proj = [](const auto &entry) {
+		return entry.task->id();
 	};
 	{
 		QMutexLocker lock(&_tasksToProcessMutex);
-		removeFrom(_tasksToProcess);
-		if (_taskInProcessId == id) {
-			_taskInProcessId = TaskId();
+		const auto i = ranges::find(_tasksToProcess, id, proj);
+		if (i != _tasksToProcess.end()) {
+			_tasksToProcess.erase(i);
+		}
+		const auto j = ranges::find(_tasksInProcess, id, proj);
+		if (j != _tasksInProcess.end()) {
+			// The worker owns the task until it takes this mutex again.
+			j->task->_cancelled.store(true, std::memory_order_release);
+			_tasksInProcess.erase(j);
 		}
 	}
-	QMutexLocker lock(&_tasksToFinishMutex);
-	removeFrom(_tasksToFinish);
+	{
+		QMutexLocker lock(&_tasksToFinishMutex);
+		const auto i = ranges::find(_tasksToFinish, id, proj);
+		if (i != _tasksToFinish.end()) {
+			_tasksToFinish.erase(i);
+		}
+	}
+
+	// Processed tasks could wait for the cancelled one to be finished.
+	QMetaObject::invokeMethod(this, "onTaskProcessed", Qt::QueuedConnection);
 }
 
-void TaskQueue::onTaskProcessed() {
-	do {
-		auto task = std::unique_ptr<Task>();
-		{
-			QMutexLocker lock(&_tasksToFinishMutex);
-			if (_tasksToFinish.empty()) break;
-			task = std::move(_tasksToFinish.front());
-			_tasksToFinish.pop_front();
+TaskQueue::Enqueued TaskQueue::takeTaskToProcess() {
+	QMutexLocker lock(&_tasksToProcessMutex);
+	if (_tasksToProcess.empty()) {
+		return Enqueued();
+	}
+	const auto i = ranges::min_element(
+		_tasksToProcess,
+		ranges::less(),
+		[](const Enqueued &entry) {
+			return std::make_pair(-entry.priority, entry.order);
+		});
+	auto result = std::move(*i);
+	_tasksToProcess.erase(i);
+	_tasksInProcess.push_back({
+		result.task.get(),
+		result.priority,
+		result.order
+	});
+	return result;
+}
+
+bool TaskQueue::taskProcessed(Enqueued &&processed) {
+	const auto id = processed.task->id();
+	QMutexLocker lockToProcess(&_tasksToProcessMutex);
+	const auto i = ranges::find(
+		_tasksInProcess,
+		id,
+		[](const InProcess &entry) { return entry.task->id(); });
+	if (i == _tasksInProcess.end()) {
+		// Cancelled while processing.
+		return false;
+	}
+	_tasksInProcess.erase(i);
+
+	QMutexLocker lockToFinish(&_tasksToFinishMutex);
+	const auto j = ranges::upper_bound(
+		_tasksToFinish,
+		processed.order,
+		ranges::less(),
+		&Enqueued::order);
+	_tasksToFinish.insert(j, std::move(processed));
+	return true;
+}
+
+bool TaskQueue::hasEarlierUnfinished(int priority, uint64 order) const {
+	const auto earlier = [&](const auto &entry) {
+		return (entry.priority == priority) && (entry.order < order);
+	};
+	return ranges::any_of(_tasksToProcess, earlier)
+		|| ranges::any_of(_tasksInProcess, earlier);
+}
+
+std::unique_ptr<Task> TaskQueue::takeTaskToFinish() {
+	QMutexLocker lockToProcess(&_tasksToProcessMutex);
+	QMutexLocker lockToFinish(&_tasksToFinishMutex);
+
+	// _tasksToFinish is sorted by order, so for each priority only
+	// the first processed task of that priority may be finished.
+	auto checked = base::flat_set<int>();
+	for (auto i = begin(_tasksToFinish); i != end(_tasksToFinish); ++i) {
+		if (!checked.emplace(i->priority).second) {
+			continue;
+		} else if (!hasEarlierUnfinished(i->priority, i->order)) {
+			auto result = std::move(i->task);
+			_tasksToFinish.erase(i);
+			return result;
 		}
+	}
+	return nullptr;
+}
+
+void TaskQueue::onTaskProcessed() {
+	while (const auto task = takeTaskToFinish()) {
 		task->finish();
-	} while (true);
+	}
 
 	if (_stopTimer) {
 		QMutexLocker lock(&_tasksToProcessMutex);
-		if (_tasksToProcess.empty() && !_taskInProcessId) {
+		if (_tasksToProcess.empty() && _tasksInProcess.empty()) {
 			_stopTimer->start();
 		}
 	}
 }
 
 void TaskQueue::stop() {
-	if (_thread) {
-		_thread->requestInterruption();
-		_thread->quit();
+	for (const auto thread : _threads) {
+		thread->requestInterruption();
+		thread->quit();
+	}
+	if (!_threads.empty()) {
 		DEBUG_LOG(("Waiting for taskThread to finish"));
-		_thread->wait();
-		delete base::take(_worker);
-		delete base::take(_thread);
+	}
+	for (const auto thread : _threads) {
+		thread->wait();
+	}
+	for (const auto worker : base::take(_workers)) {
+		delete worker;
+	}
+	for (const auto thread : base::take(_threads)) {
+		delete thread;
 	}
 	_tasksToProcess.clear();
+	_tasksInProcess.clear();
 	_tasksToFinish.clear();
-	_taskInProcessId = TaskId();
 }
 
 TaskQueue::~TaskQueue() {
@@ -353,38 +454,17 @@ void TaskQueueWorker::onTaskAdded() {
 	if (_inTaskAdded) return;
 	_inTaskAdded = true;
 
-	bool someTasksLeft = false;
 	do {
-		auto task = std::unique_ptr<Task>();
-		{
-			QMutexLocker lock(&_queue->_tasksToProcessMutex);
-			if (!_queue->_tasksToProcess.empty()) {
-				task = std::move(_queue->_tasksToProcess.front());
-				_queue->_tasksToProcess.pop_front();
-				_queue->_taskInProcessId = task->id();
-			}
+		auto entry = _queue->takeTaskToProcess();
+		if (!entry.task) {
+			break;
 		}
-
-		if (task) {
-			task->process();
-			bool emitTaskProcessed = false;
-			{
-				QMutexLocker lockToProcess(&_queue->_tasksToProcessMutex);
-				if (_queue->_taskInProcessId == task->id()) {
-					_queue->_taskInProcessId = TaskId();
-					someTasksLeft = !_queue->_tasksToProcess.empty();
-
-					QMutexLocker lockToFinish(&_queue->_tasksToFinishMutex);
-					emitTaskProcessed = _queue->_tasksToFinish.empty();
-					_queue->_tasksToFinish.push_back(std::move(task));
-				}
-			}
-			if (emitTaskProcessed) {
-				emit taskProcessed();
-			}
+		entry.task->process();
+		if (_queue->taskProcessed(std::move(entry))) {
+			emit taskProcessed();
 		}
 		QCoreApplication::processEvents();
-	} while (someTasksLeft && !thread()->isInterruptionRequested());
+	} while (!thread()->isInterruptionRequested());
 
 	_inTaskAdded = false;
 }
@@ -765,6 +845,8 @@ void FileLoadTask::process() {
 
 	if (!filesize || filesize > App::kFileSizeLimit) {
 		return;
+	} else if (cancelled()) {
+		return;
 	}
 
 	PreparedPhotoThumbs photoThumbs;
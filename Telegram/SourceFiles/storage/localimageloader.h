@@ -88,6 +88,8 @@ SendMediaReady PreparePeerPhoto(PeerId peerId, QImage &&image);
 
 using TaskId = void*; // no interface, just id
 
+class TaskQueue;
+
 class Task {
 public:
 	virtual void process() = 0; // is executed in a separate thread
@@ -98,17 +100,36 @@ public:
 		return static_cast<TaskId>(const_cast<Task*>(this));
 	}
 
+protected:
+	// process() may return early if the task was cancelled meanwhile.
+	[[nodiscard]] bool cancelled() const {
+		return _cancelled.load(std::memory_order_acquire);
+	}
+
+private:
+	friend class TaskQueue;
+
+	std::atomic<bool> _cancelled = false;
+
 };
 
 class TaskQueueWorker;
+
+// Tasks are processed by up to maxThreads workers, the ones with higher
+// priority first. Tasks of the same priority are finished in the order
+// they were added, so that albums and sent files keep their order.
 class TaskQueue : public QObject {
 	Q_OBJECT
 
 public:
-	explicit TaskQueue(crl::time stopTimeoutMs = 0); // <= 0 - never stop worker
-
-	TaskId addTask(std::unique_ptr<Task> &&task);
-	void addTasks(std::vector<std::unique_ptr<Task>> &&tasks);
+	// stopTimeoutMs <= 0 - never stop workers,
+	// maxThreads <= 0 - as many workers as there are cores.
+	explicit TaskQueue(crl::time stopTimeoutMs = 0, int maxThreads = 0);
+
+	TaskId addTask(std::unique_ptr<Task> &&task, int priority = 0);
+	void addTasks(
+		std::vector<std::unique_ptr<Task>> &&tasks,
+		int priority = 0);
 	void cancelTask(TaskId id); // this task finish() won't be called
 
 	~TaskQueue();
@@ -123,14 +144,34 @@ public slots:
 private:
 	friend class TaskQueueWorker;
 
+	struct Enqueued {
+		std::unique_ptr<Task> task;
+		int priority = 0;
+		uint64 order = 0;
+	};
+	struct InProcess {
+		not_null<Task*> task;
+		int priority = 0;
+		uint64 order = 0;
+	};
+
 	void wakeThread();
 
-	std::deque<std::unique_ptr<Task>> _tasksToProcess;
-	std::deque<std::unique_ptr<Task>> _tasksToFinish;
-	TaskId _taskInProcessId = TaskId();
+	// Called from the worker threads.
+	[[nodiscard]] Enqueued takeTaskToProcess();
+	[[nodiscard]] bool taskProcessed(Enqueued &&processed);
+
+	[[nodiscard]] std::unique_ptr<Task> takeTaskToFinish();
+	[[nodiscard]] bool hasEarlierUnfinished(int priority, uint64 order) const;
+
+	std::deque<Enqueued> _tasksToProcess;
+	std::vector<InProcess> _tasksInProcess;
+	std::deque<Enqueued> _tasksToFinish;
+	uint64 _ordersCounter = 0;
 	QMutex _tasksToProcessMutex, _tasksToFinishMutex;
-	QThread *_thread = nullptr;
-	TaskQueueWorker *_worker = nullptr;
+	std::vector<QThread*> _threads;
+	std::vector<TaskQueueWorker*> _workers;
+	int _maxThreads = 1;
 	QTimer *_stopTimer = nullptr;
 
 };
@@ -61,6 +61,7 @@ constexpr auto kFileLoaderQueueStopTimeout = crl::time(5000);
 constexpr auto kDefaultStickerInstallDate = TimeId(1);
 constexpr auto kProxyTypeShift = 1024;
 constexpr auto kWriteMapTimeout = crl::time(1000);
+constexpr auto kMaxJournalRecords = 1024;
 constexpr auto kSavedBackgroundFormat = QImage::Format_ARGB32_Premultiplied;
 
 constexpr auto kWallPaperLegacySerializeTagId = int32(-111);
@@ -531,6 +532,76 @@ bool readEncryptedFile(FileReadDescriptor &result, const FileKey &fkey, FileOpti
 	return readEncryptedFile(result, toFilePart(fkey), options, key);
 }
 
+// Journal is an append-only file of encrypted records, each of them
+// describes a single change of the file that owns the journal.
+// The owner file gets a new journal each time it is rewritten.
+bool appendJournal(const FileKey &key, EncryptedDescriptor &data) {
+	if (!_userWorking()) return false;
+
+	const auto name = toFilePart(key);
+	QFile f(_userBasePath + name + '0');
+	if (!f.open(QIODevice::WriteOnly | QIODevice::Append)) {
+		DEBUG_LOG(("App Info: failed to open journal '%1' for writing").arg(name));
+		return false;
+	}
+	if (!f.size()) {
+		f.write(tdfMagic, tdfMagicLen);
+		qint32 version = AppVersion;
+		f.write((const char*)&version, sizeof(version));
+	}
+	QDataStream stream(&f);
+	stream.setVersion(QDataStream::Qt_5_1);
+	stream << FileWriteDescriptor::prepareEncrypted(data);
+	return (stream.status() == QDataStream::Ok);
+}
+
+// Calls bool method(QDataStream&) for each record, returns records count.
+// A broken tail, like the one left by a crash during append, is cut off.
+template <typename Method>
+int readJournal(const FileKey &key, Method &&method) {
+	if (!_userWorking()) return 0;
+
+	const auto name = toFilePart(key);
+	QFile f(_userBasePath + name + '0');
+	if (!f.exists() || !f.open(QIODevice::ReadWrite)) {
+		return 0;
+	}
+
+	char magic[tdfMagicLen];
+	qint32 version = 0;
+	if (f.read(magic, tdfMagicLen) != tdfMagicLen
+		|| memcmp(magic, tdfMagic, tdfMagicLen)
+		|| f.read((char*)&version, sizeof(version)) != sizeof(version)
+		|| version > AppVersion) {
+		DEBUG_LOG(("App Info: bad journal header in '%1'").arg(name));
+		f.remove();
+		return 0;
+	}
+
+	QDataStream stream(&f);
+	stream.setVersion(QDataStream::Qt_5_1);
+	auto result = 0;
+	auto good = f.pos();
+	while (!stream.atEnd()) {
+		QByteArray encrypted;
+		stream >> encrypted;
+
+		EncryptedDescriptor data;
+		if (stream.status() != QDataStream::Ok
+			|| !decryptLocal(data, encrypted)
+			|| !method(data.stream)) {
+			LOG(("App Info: journal '%1' broken after %2 records, truncating."
+				).arg(name
+				).arg(result));
+			f.resize(good);
+			break;
+		}
+		good = f.pos();
+		++result;
+	}
+	return result;
+}
+
 FileKey _dataNameKey = 0;
 
 enum { // Local Storage Keys
@@ -556,6 +627,12 @@ enum { // Local Storage Keys
 	lskExportSettings = 0x13, // no data
 	lskBackground = 0x14, // no data
 	lskSelfSerialized = 0x15, // serialized self
+	lskMapJournal = 0x16, // no data
+};
+
+enum { // Locations Journal Records
+	ljrLocations = 0x00, // data: MediaKey key, all its locations
+	ljrLocationAlias = 0x01, // data: MediaKey key, MediaKey value
 };
 
 enum {
@@ -677,6 +754,8 @@ FileLocationPairs _fileLocationPairs;
 typedef QMap<MediaKey, MediaKey> FileLocationAliases;
 FileLocationAliases _fileLocationAliases;
 FileKey _locationsKey = 0, _trustedBotsKey = 0;
+FileKey _locationsJournalKey = 0;
+int _locationsJournalRecords = 0;
 
 using TrustedBots = OrderedSet<uint64>;
 TrustedBots _trustedBots;
@@ -721,6 +800,8 @@ FileKey _langPackKey = 0;
 FileKey _languagesKey = 0;
 
 bool _mapChanged = false;
+FileKey _mapJournalKey = 0;
+int _mapJournalRecords = 0;
 int32 _oldMapVersion = 0, _oldSettingsVersion = 0;
 
 enum class WriteMapWhen {
@@ -739,7 +820,114 @@ Main::Settings &GetStoredSessionSettings() {
 
 void _writeMap(WriteMapWhen when = WriteMapWhen::Soon);
 
-void _writeLocations(WriteMapWhen when = WriteMapWhen::Soon) {
+// Writes a change of _draftsMap or _draftCursorsMap to the map journal.
+void _writeMapChange(
+		quint32 keyType,
+		const PeerId &peer,
+		FileKey key,
+		WriteMapWhen when) {
+	if (!_mapJournalKey) {
+		_mapChanged = true;
+		_writeMap(when);
+		return;
+	}
+	EncryptedDescriptor data(sizeof(quint32) + 2 * sizeof(quint64));
+	data.stream << quint32(keyType) << quint64(peer) << quint64(key);
+	if (!appendJournal(_mapJournalKey, data)
+		|| ++_mapJournalRecords >= kMaxJournalRecords) {
+		_mapChanged = true;
+		_writeMap();
+	}
+}
+
+void _writeLocations(WriteMapWhen when = WriteMapWhen::Soon);
+
+void _writeLocationsChange(EncryptedDescriptor &data) {
+	if (!_locationsKey || !_locationsJournalKey) {
+		_writeLocations(WriteMapWhen::Fast);
+	} else if (!appendJournal(_locationsJournalKey, data)
+		|| ++_locationsJournalRecords >= kMaxJournalRecords) {
+		_writeLocations();
+	}
+}
+
+void _writeLocationChange(MediaKey location) {
+	quint32 size = sizeof(quint32) + sizeof(quint64) * 2 + sizeof(quint32);
+	auto count = quint32(0);
+	for (auto i = _fileLocations.constFind(location); (i != _fileLocations.cend()) && (i.key() == location); ++i) {
+		// name + bookmark + date + size
+		size += Serialize::stringSize(i.value().name());
+		size += Serialize::bytearraySize(i.value().bookmark());
+		size += Serialize::dateTimeSize() + sizeof(quint32);
+		++count;
+	}
+
+	EncryptedDescriptor data(size);
+	data.stream << quint32(ljrLocations) << quint64(location.first) << quint64(location.second) << count;
+	for (auto i = _fileLocations.constFind(location); (i != _fileLocations.cend()) && (i.key() == location); ++i) {
+		data.stream << i.value().name() << i.value().bookmark();
+		data.stream << i.value().modified << quint32(i.value().size);
+	}
+	_writeLocationsChange(data);
+}
+
+void _writeLocationAliasChange(MediaKey location, MediaKey value) {
+	EncryptedDescriptor data(sizeof(quint32) + sizeof(quint64) * 4);
+	data.stream << quint32(ljrLocationAlias) << quint64(location.first) << quint64(location.second) << quint64(value.first) << quint64(value.second);
+	_writeLocationsChange(data);
+}
+
+bool _applyLocationsJournalRecord(QDataStream &stream) {
+	quint32 recordType = 0;
+	quint64 first = 0, second = 0;
+	stream >> recordType >> first >> second;
+	const auto location = MediaKey(first, second);
+	switch (recordType) {
+	case ljrLocations: {
+		quint32 count = 0;
+		stream >> count;
+		auto list = std::vector<FileLocation>();
+		for (quint32 i = 0; i < count; ++i) {
+			QByteArray bookmark;
+			FileLocation loc;
+			stream >> loc.fname >> bookmark >> loc.modified >> loc.size;
+			loc.setBookmark(bookmark);
+			list.push_back(loc);
+		}
+		if (!_checkStreamStatus(stream)) {
+			return false;
+		}
+		for (auto i = _fileLocations.find(location); (i != _fileLocations.end()) && (i.key() == location);) {
+			const auto j = _fileLocationPairs.find(i.value().fname);
+			if (j != _fileLocationPairs.end() && j.value().first == location) {
+				_fileLocationPairs.erase(j);
+			}
+			i = _fileLocations.erase(i);
+		}
+		// QMultiMap::insert() puts the value before the ones with same key.
+		for (const auto &loc : ranges::view::reverse(list)) {
+			_fileLocations.insert(location, loc);
+			if (!loc.inMediaCache()) {
+				_fileLocationPairs.insert(loc.fname, FileLocationPair(location, loc));
+			}
+		}
+	} break;
+	case ljrLocationAlias: {
+		quint64 vfirst = 0, vsecond = 0;
+		stream >> vfirst >> vsecond;
+		if (!_checkStreamStatus(stream)) {
+			return false;
+		}
+		_fileLocationAliases.insert(location, MediaKey(vfirst, vsecond));
+	} break;
+	default:
+		LOG(("App Error: unknown record type in locations journal: %1").arg(recordType));
+		return false;
+	}
+	return true;
+}
+
+void _writeLocations(WriteMapWhen when) {
 	Expects(_manager != nullptr);
 
 	if (when != WriteMapWhen::Now) {
@@ -756,6 +944,11 @@ void _writeLocations(WriteMapWhen when = WriteMapWhen::Soon) {
 			_mapChanged = true;
 			_writeMap();
 		}
+		if (_locationsJournalKey) {
+			clearKey(_locationsJournalKey);
+			_locationsJournalKey = 0;
+			_locationsJournalRecords = 0;
+		}
 	} else {
 		if (!_locationsKey) {
 			_locationsKey = genKey();
@@ -787,6 +980,10 @@ void _writeLocations(WriteMapWhen when = WriteMapWhen::Soon) {
 			size += sizeof(quint64) * 2 + sizeof(quint64) * 2;
 		}
 
+		// web locations count + journal key
+		size += sizeof(quint32) + sizeof(quint64);
+		const auto journalKey = genKey();
+
 		EncryptedDescriptor data(size);
 		auto legacyTypeField = 0;
 		for (FileLocations::const_iterator i = _fileLocations.cbegin(); i != _fileLocations.cend(); ++i) {
@@ -808,8 +1005,17 @@ void _writeLocations(WriteMapWhen when = WriteMapWhen::Soon) {
 			data.stream << quint64(i.key().first) << quint64(i.key().second) << quint64(i.value().first) << quint64(i.value().second);
 		}
 
+		data.stream << quint32(0) << quint64(journalKey);
+
 		FileWriteDescriptor file(_locationsKey);
-		file.writeEncrypted(data);
+		if (file.writeEncrypted(data)) {
+			file.finish();
+			if (_locationsJournalKey) {
+				clearKey(_locationsJournalKey);
+			}
+			_locationsJournalKey = journalKey;
+			_locationsJournalRecords = 0;
+		}
 	}
 }
 
@@ -868,6 +1074,20 @@ void _readLocations() {
 				clearKey(key, FileOption::User);
 			}
 		}
+		if (!locations.stream.atEnd()) {
+			quint64 journalKey = 0;
+			locations.stream >> journalKey;
+			_locationsJournalKey = journalKey;
+		}
+	}
+
+	if (_locationsJournalKey) {
+		_locationsJournalRecords = readJournal(
+			_locationsJournalKey,
+			_applyLocationsJournalRecord);
+		if (_locationsJournalRecords >= kMaxJournalRecords) {
+			_writeLocations();
+		}
 	}
 }
 
@@ -2309,6 +2529,7 @@ ReadMapState _readMap(const QByteArray &pass) {
 	quint64 savedGifsKey = 0;
 	quint64 backgroundKeyDay = 0, backgroundKeyNight = 0;
 	quint64 userSettingsKey = 0, recentHashtagsAndBotsKey = 0, exportSettingsKey = 0;
+	quint64 mapJournalKey = 0;
 	while (!map.stream.atEnd()) {
 		quint32 keyType;
 		map.stream >> keyType;
@@ -2400,6 +2621,9 @@ ReadMapState _readMap(const QByteArray &pass) {
 		case lskExportSettings: {
 			map.stream >> exportSettingsKey;
 		} break;
+		case lskMapJournal: {
+			map.stream >> mapJournalKey;
+		} break;
 		default:
 		LOG(("App Error: unknown key type in encrypted map: %1").arg(keyType));
 		return ReadMapFailed;
@@ -2409,9 +2633,46 @@ ReadMapState _readMap(const QByteArray &pass) {
 		}
 	}
 
+	auto mapJournalRecords = 0;
+	if (mapJournalKey) {
+		mapJournalRecords = readJournal(mapJournalKey, [&](QDataStream &stream) {
+			quint32 keyType = 0;
+			quint64 p = 0;
+			FileKey key = 0;
+			stream >> keyType >> p >> key;
+			if (!_checkStreamStatus(stream)) {
+				return false;
+			}
+			switch (keyType) {
+			case lskDraft: {
+				if (key) {
+					draftsMap.insert(p, key);
+					draftsNotReadMap.insert(p, true);
+				} else {
+					draftsMap.remove(p);
+					draftsNotReadMap.remove(p);
+				}
+			} break;
+			case lskDraftPosition: {
+				if (key) {
+					draftCursorsMap.insert(p, key);
+				} else {
+					draftCursorsMap.remove(p);
+				}
+			} break;
+			default:
+				LOG(("App Error: unknown key type in map journal: %1").arg(keyType));
+				return false;
+			}
+			return true;
+		});
+	}
+
 	_draftsMap = draftsMap;
 	_draftCursorsMap = draftCursorsMap;
 	_draftsNotReadMap = draftsNotReadMap;
+	_mapJournalKey = mapJournalKey;
+	_mapJournalRecords = mapJournalRecords;
 
 	_locationsKey = locationsKey;
 	_trustedBotsKey = trustedBotsKey;
@@ -2428,7 +2689,8 @@ ReadMapState _readMap(const QByteArray &pass) {
 	_recentHashtagsAndBotsKey = recentHashtagsAndBotsKey;
 	_exportSettingsKey = exportSettingsKey;
 	_oldMapVersion = mapData.version;
-	if (_oldMapVersion < AppVersion) {
+	if (_oldMapVersion < AppVersion
+		|| _mapJournalRecords >= kMaxJournalRecords) {
 		_mapChanged = true;
 		_writeMap();
 	} else {
@@ -2528,6 +2790,9 @@ void _writeMap(WriteMapWhen when) {
 	if (_recentHashtagsAndBotsKey) mapSize += sizeof(quint32) + sizeof(quint64);
 	if (_exportSettingsKey) mapSize += sizeof(quint32) + sizeof(quint64);
 
+	const auto journalKey = genKey();
+	if (journalKey) mapSize += sizeof(quint32) + sizeof(quint64);
+
 	EncryptedDescriptor mapData(mapSize);
 	if (!self.isEmpty()) {
 		mapData.stream << quint32(lskSelfSerialized) << self;
@@ -2578,7 +2843,17 @@ void _writeMap(WriteMapWhen when) {
 	if (_exportSettingsKey) {
 		mapData.stream << quint32(lskExportSettings) << quint64(_exportSettingsKey);
 	}
-	map.writeEncrypted(mapData);
+	if (journalKey) {
+		mapData.stream << quint32(lskMapJournal) << quint64(journalKey);
+	}
+	if (map.writeEncrypted(mapData)) {
+		map.finish();
+		if (_mapJournalKey) {
+			clearKey(_mapJournalKey);
+		}
+		_mapJournalKey = journalKey;
+		_mapJournalRecords = 0;
+	}
 
 	_mapChanged = false;
 }
@@ -2841,6 +3116,8 @@ void reset() {
 	_fileLocationAliases.clear();
 	_draftsNotReadMap.clear();
 	_locationsKey = _trustedBotsKey = 0;
+	_locationsJournalKey = 0;
+	_locationsJournalRecords = 0;
 	_recentStickersKeyOld = 0;
 	_installedStickersKey = _featuredStickersKey = _recentStickersKey = _favedStickersKey = _archivedStickersKey = 0;
 	_savedGifsKey = 0;
@@ -2882,6 +3159,8 @@ void setPasscode(const QByteArray &passcode) {
 base::flat_set<QString> CollectGoodNames() {
 	const auto keys = {
 		_locationsKey,
+		_locationsJournalKey,
+		_mapJournalKey,
 		_userSettingsKey,
 		_installedStickersKey,
 		_featuredStickersKey,
@@ -2954,8 +3233,7 @@ void writeDrafts(const PeerId &peer, const MessageDraft &localDraft, const Messa
 		if (i != _draftsMap.cend()) {
 			clearKey(i.value());
 			_draftsMap.erase(i);
-			_mapChanged = true;
-			_writeMap();
+			_writeMapChange(lskDraft, peer, 0, WriteMapWhen::Soon);
 		}
 
 		_draftsNotReadMap.remove(peer);
@@ -2963,8 +3241,7 @@ void writeDrafts(const PeerId &peer, const MessageDraft &localDraft, const Messa
 		auto i = _draftsMap.constFind(peer);
 		if (i == _draftsMap.cend()) {
 			i = _draftsMap.insert(peer, genKey());
-			_mapChanged = true;
-			_writeMap(WriteMapWhen::Fast);
+			_writeMapChange(lskDraft, peer, i.value(), WriteMapWhen::Fast);
 		}
 
 		auto msgTags = TextUtilities::SerializeTags(
@@ -2995,8 +3272,7 @@ void clearDraftCursors(const PeerId &peer) {
 	if (i != _draftCursorsMap.cend()) {
 		clearKey(i.value());
 		_draftCursorsMap.erase(i);
-		_mapChanged = true;
-		_writeMap();
+		_writeMapChange(lskDraftPosition, peer, 0, WriteMapWhen::Soon);
 	}
 }
 
@@ -3117,8 +3393,7 @@ void writeDraftCursors(const PeerId &peer, const MessageCursor &msgCursor, const
 		DraftsMap::const_iterator i = _draftCursorsMap.constFind(peer);
 		if (i == _draftCursorsMap.cend()) {
 			i = _draftCursorsMap.insert(peer, genKey());
-			_mapChanged = true;
-			_writeMap(WriteMapWhen::Fast);
+			_writeMapChange(lskDraftPosition, peer, i.value(), WriteMapWhen::Fast);
 		}
 
 		EncryptedDescriptor data(sizeof(quint64) + sizeof(qint32) * 3);
@@ -3153,18 +3428,20 @@ void writeFileLocation(MediaKey location, const FileLocation &local) {
 			if (i.value().second == local) {
 				if (i.value().first != location) {
 					_fileLocationAliases.insert(location, i.value().first);
-					_writeLocations(WriteMapWhen::Fast);
+					_writeLocationAliasChange(location, i.value().first);
 				}
 				return;
 			}
 			if (i.value().first != location) {
-				for (FileLocations::iterator j = _fileLocations.find(i.value().first), e = _fileLocations.end(); (j != e) && (j.key() == i.value().first); ++j) {
+				const auto was = i.value().first;
+				for (FileLocations::iterator j = _fileLocations.find(was), e = _fileLocations.end(); (j != e) && (j.key() == was); ++j) {
 					if (j.value() == i.value().second) {
 						_fileLocations.erase(j);
 						break;
 					}
 				}
 				_fileLocationPairs.erase(i);
+				_writeLocationChange(was);
 			}
 		}
 		_fileLocationPairs.insert(local.fname, FileLocationPair(location, local));
@@ -3177,7 +3454,7 @@ void writeFileLocation(MediaKey location, const FileLocation &local) {
 		}
 	}
 	_fileLocations.insert(location, local);
-	_writeLocations(WriteMapWhen::Fast);
+	_writeLocationChange(location);
 }
 
 void removeFileLocation(MediaKey location) {
@@ -3188,7 +3465,7 @@ void removeFileLocation(MediaKey location) {
 	while (i != _fileLocations.end() && (i.key() == location)) {
 		i = _fileLocations.erase(i);
 	}
-	_writeLocations(WriteMapWhen::Fast);
+	_writeLocationChange(location);
 }
 
 FileLocation readFileLocation(MediaKey location) {
@@ -3201,7 +3478,7 @@ FileLocation readFileLocation(MediaKey location) {
 		if (!i.value().inMediaCache() && !i.value().check()) {
 			_fileLocationPairs.remove(i.value().fname);
 			i = _fileLocations.erase(i);
-			_writeLocations();
+			_writeLocationChange(location);
 			continue;
 		}
 		return i.value();
@@ -3270,13 +3547,32 @@ Storage::Cache::Database::Settings cacheBigFileSettings() {
 	return result;
 }
 
+void applyCountedWaveform(
+		not_null<DocumentData*> document,
+		const VoiceWaveform &waveform) {
+	if (const auto voice = document->voice()) {
+		if (!waveform.isEmpty()) {
+			voice->waveform = waveform;
+			voice->wavemax = *ranges::max_element(waveform);
+		}
+		if (voice->waveform.isEmpty()) {
+			voice->waveform.resize(1);
+			voice->waveform[0] = -2;
+			voice->wavemax = 0;
+		} else if (voice->waveform[0] < 0) {
+			voice->waveform[0] = -2;
+			voice->wavemax = 0;
+		}
+		document->owner().requestDocumentViewRepaint(document);
+	}
+}
+
 class CountWaveformTask : public Task {
 public:
 	CountWaveformTask(DocumentData *doc)
 		: _doc(doc)
 		, _loc(doc->location(true))
-		, _data(doc->data())
-		, _wavemax(0) {
+		, _data(doc->data()) {
 		if (_data.isEmpty() && !_loc.accessEnable()) {
 			_doc = nullptr;
 		}
@@ -3285,26 +3581,18 @@ public:
 		if (!_doc) return;
 
 		_waveform = audioCountWaveform(_loc, _data);
-		_wavemax = _waveform.empty()
-			? char(0)
-			: *ranges::max_element(_waveform);
 	}
 	void finish() override {
-		if (const auto voice = _doc ? _doc->voice() : nullptr) {
-			if (!_waveform.isEmpty()) {
-				voice->waveform = _waveform;
-				voice->wavemax = _wavemax;
-			}
-			if (voice->waveform.isEmpty()) {
-				voice->waveform.resize(1);
-				voice->waveform[0] = -2;
-				voice->wavemax = 0;
-			} else if (voice->waveform[0] < 0) {
-				voice->waveform[0] = -2;
-				voice->wavemax = 0;
-			}
-			Auth().data().requestDocumentViewRepaint(_doc);
+		if (!_doc) {
+			return;
+		} else if (!_waveform.isEmpty()) {
+			_doc->owner().cache().put(
+				_doc->waveformCacheKey(),
+				Storage::Cache::Database::TaggedValue(
+					documentWaveformEncode5bit(_waveform),
+					Data::kVoiceMessageCacheTag));
 		}
+		applyCountedWaveform(_doc, _waveform);
 	}
 	~CountWaveformTask() {
 		if (_data.isEmpty() && _doc) {
@@ -3317,15 +3605,12 @@ protected:
 	FileLocation _loc;
 	QByteArray _data;
 	VoiceWaveform _waveform;
-	char _wavemax;
 
 };
 
-void countVoiceWaveform(DocumentData *document) {
+void startCountingWaveform(not_null<DocumentData*> document) {
 	if (const auto voice = document->voice()) {
 		if (_localLoader) {
-			voice->waveform.resize(1 + sizeof(TaskId));
-			voice->waveform[0] = -1; // counting
 			TaskId taskId = _localLoader->addTask(
 				std::make_unique<CountWaveformTask>(document));
 			memcpy(voice->waveform.data() + 1, &taskId, sizeof(taskId));
@@ -3333,6 +3618,42 @@ void countVoiceWaveform(DocumentData *document) {
 	}
 }
 
+void countVoiceWaveform(DocumentData *document) {
+	if (const auto voice = document->voice()) {
+		if (_localLoader) {
+			voice->waveform.resize(1 + sizeof(TaskId));
+			voice->waveform[0] = -1; // counting
+
+			// Until the cache is checked there is no task to cancel.
+			const auto noTaskId = TaskId();
+			memcpy(voice->waveform.data() + 1, &noTaskId, sizeof(noTaskId));
+
+			const auto session = &document->session();
+			auto done = [=](QByteArray &&value) {
+				crl::on_main(session, [=, value = std::move(value)] {
+					const auto voice = document->voice();
+					if (!voice
+						|| voice->waveform.isEmpty()
+						|| voice->waveform[0] != -1) {
+						return;
+					}
+					auto waveform = value.isEmpty()
+						? VoiceWaveform()
+						: documentWaveformDecode(value);
+					if (!waveform.isEmpty()) {
+						applyCountedWaveform(document, waveform);
+					} else {
+						startCountingWaveform(document);
+					}
+				});
+			};
+			document->owner().cache().get(
+				document->waveformCacheKey(),
+				std::move(done));
+		}
+	}
+}
+
 void cancelTask(TaskId id) {
 	if (_localLoader) {
 		_localLoader->cancelTask(id);
@@ -4790,6 +5111,7 @@ void WriteExportSettings(const Export::Settings &settings) {
 		&& settings.fullChats == check.fullChats
 		&& settings.media.types == check.media.types
 		&& settings.media.sizeLimit == check.media.sizeLimit
+		&& settings.media.downloadsCount == check.media.downloadsCount
 		&& settings.path == check.path
 		&& settings.format == check.format
 		&& settings.availableAt == check.availableAt
@@ -4808,7 +5130,7 @@ void WriteExportSettings(const Export::Settings &settings) {
 		}
 		quint32 size = sizeof(quint32) * 6
 			+ Serialize::stringSize(settings.path)
-			+ sizeof(qint32) * 2 + sizeof(quint64);
+			+ sizeof(qint32) * 3 + sizeof(quint64);
 		EncryptedDescriptor data(size);
 		data.stream
 			<< quint32(settings.types)
@@ -4841,6 +5163,7 @@ void WriteExportSettings(const Export::Settings &settings) {
 		});
 		data.stream << qint32(settings.singlePeerFrom);
 		data.stream << qint32(settings.singlePeerTill);
+		data.stream << qint32(settings.media.downloadsCount);
 
 		FileWriteDescriptor file(_exportSettingsKey);
 		file.writeEncrypted(data);
@@ -4863,6 +5186,7 @@ Export::Settings ReadExportSettings() {
 	qint32 singlePeerType = 0, singlePeerBareId = 0;
 	quint64 singlePeerAccessHash = 0;
 	qint32 singlePeerFrom = 0, singlePeerTill = 0;
+	qint32 downloadsCount = Export::MediaSettings().downloadsCount;
 	file.stream
 		>> types
 		>> fullChats
@@ -4887,11 +5211,15 @@ Export::Settings ReadExportSettings() {
 	if (!file.stream.atEnd()) {
 		file.stream >> singlePeerFrom >> singlePeerTill;
 	}
+	if (!file.stream.atEnd()) {
+		file.stream >> downloadsCount;
+	}
 	auto result = Export::Settings();
 	result.types = Export::Settings::Types::from_raw(types);
 	result.fullChats = Export::Settings::Types::from_raw(fullChats);
 	result.media.types = Export::MediaSettings::Types::from_raw(mediaTypes);
 	result.media.sizeLimit = mediaSizeLimit;
+	result.media.downloadsCount = downloadsCount;
 	result.format = Export::Output::Format(format);
 	result.path = path;
 	result.availableAt = availableAt;
@@ -5055,6 +5383,8 @@ bool ClearManager::addTask(int task) {
 			_locationsKey = 0;
 			_mapChanged = true;
 		}
+		_locationsJournalKey = 0;
+		_locationsJournalRecords = 0;
 		if (_trustedBotsKey) {
 			_trustedBotsKey = 0;
 			_mapChanged = true;
@@ -21,9 +21,6 @@ using namespace Images;
 namespace Images {
 namespace {
 
-// After 128 MB of unpacked images we try to clear some memory.
-constexpr auto kMemoryForCache = 128 * 1024 * 1024;
-
 std::map<QString, std::unique_ptr<Image>> LocalFileImages;
 std::map<QString, std::unique_ptr<Image>> WebUrlImages;
 std::unordered_map<InMemoryKey, std::unique_ptr<Image>> StorageImages;
@@ -42,13 +39,20 @@ int64 ComputeUsage(const QImage &image) {
 	return ComputeUsage(image.size());
 }
 
-[[nodiscard]] Core::MediaActiveCache<const Image> &ActiveCache() {
+[[nodiscard]] Core::MediaActiveCache<const Image> &DecodedCache() {
 	static auto Instance = Core::MediaActiveCache<const Image>(
-		kMemoryForCache,
+		Core::MediaCacheTier::Decoded,
 		[](const Image *image) { image->unload(); });
 	return Instance;
 }
 
+[[nodiscard]] Core::MediaActiveCache<const Image> &ScaledCache() {
+	static auto Instance = Core::MediaActiveCache<const Image>(
+		Core::MediaCacheTier::Scaled,
+		[](const Image *image) { image->invalidateSizeCache(); });
+	return Instance;
+}
+
 uint64 PixKey(int width, int height, Options options) {
 	return static_cast<uint64>(width)
 		| (static_cast<uint64>(height) << 24)
@@ -69,7 +73,9 @@ void ClearRemote() {
 }
 
 void ClearAll() {
-	ActiveCache().clear();
+	Core::LogMediaCacheStats();
+	DecodedCache().clear();
+	ScaledCache().clear();
 	base::take(LocalFileImages);
 	ClearRemote();
 }
@@ -561,8 +567,12 @@ const QPixmap &Image::pix(
 		auto p = pixNoCache(origin, w, h, options);
 		p.setDevicePixelRatio(cRetinaFactor());
 		i = _sizesCache.insert(k, p);
-		ActiveCache().increment(ComputeUsage(*i));
+		ScaledCache().increment(ComputeUsage(*i));
+		ScaledCache().miss();
+	} else {
+		ScaledCache().hit();
 	}
+	ScaledCache().up(this);
 	return i.value();
 }
 
@@ -600,8 +610,12 @@ const QPixmap &Image::pixRounded(
 		auto p = pixNoCache(origin, w, h, options);
 		p.setDevicePixelRatio(cRetinaFactor());
 		i = _sizesCache.insert(k, p);
-		ActiveCache().increment(ComputeUsage(*i));
+		ScaledCache().increment(ComputeUsage(*i));
+		ScaledCache().miss();
+	} else {
+		ScaledCache().hit();
 	}
+	ScaledCache().up(this);
 	return i.value();
 }
 
@@ -624,8 +638,12 @@ const QPixmap &Image::pixCircled(
 		auto p = pixNoCache(origin, w, h, options);
 		p.setDevicePixelRatio(cRetinaFactor());
 		i = _sizesCache.insert(k, p);
-		ActiveCache().increment(ComputeUsage(*i));
+		ScaledCache().increment(ComputeUsage(*i));
+		ScaledCache().miss();
+	} else {
+		ScaledCache().hit();
 	}
+	ScaledCache().up(this);
 	return i.value();
 }
 
@@ -648,8 +666,12 @@ const QPixmap &Image::pixBlurredCircled(
 		auto p = pixNoCache(origin, w, h, options);
 		p.setDevicePixelRatio(cRetinaFactor());
 		i = _sizesCache.insert(k, p);
-		ActiveCache().increment(ComputeUsage(*i));
+		ScaledCache().increment(ComputeUsage(*i));
+		ScaledCache().miss();
+	} else {
+		ScaledCache().hit();
 	}
+	ScaledCache().up(this);
 	return i.value();
 }
 
@@ -672,8 +694,12 @@ const QPixmap &Image::pixBlurred(
 		auto p = pixNoCache(origin, w, h, options);
 		p.setDevicePixelRatio(cRetinaFactor());
 		i = _sizesCache.insert(k, p);
-		ActiveCache().increment(ComputeUsage(*i));
+		ScaledCache().increment(ComputeUsage(*i));
+		ScaledCache().miss();
+	} else {
+		ScaledCache().hit();
 	}
+	ScaledCache().up(this);
 	return i.value();
 }
 
@@ -697,8 +723,12 @@ const QPixmap &Image::pixColored(
 		auto p = pixColoredNoCache(origin, add, w, h, true);
 		p.setDevicePixelRatio(cRetinaFactor());
 		i = _sizesCache.insert(k, p);
-		ActiveCache().increment(ComputeUsage(*i));
+		ScaledCache().increment(ComputeUsage(*i));
+		ScaledCache().miss();
+	} else {
+		ScaledCache().hit();
 	}
+	ScaledCache().up(this);
 	return i.value();
 }
 
@@ -722,8 +752,12 @@ const QPixmap &Image::pixBlurredColored(
 		auto p = pixBlurredColoredNoCache(origin, add, w, h);
 		p.setDevicePixelRatio(cRetinaFactor());
 		i = _sizesCache.insert(k, p);
-		ActiveCache().increment(ComputeUsage(*i));
+		ScaledCache().increment(ComputeUsage(*i));
+		ScaledCache().miss();
+	} else {
+		ScaledCache().hit();
 	}
+	ScaledCache().up(this);
 	return i.value();
 }
 
@@ -767,13 +801,17 @@ const QPixmap &Image::pixSingle(
 	auto i = _sizesCache.constFind(k);
 	if (i == _sizesCache.cend() || i->width() != (outerw * cIntRetinaFactor()) || i->height() != (outerh * cIntRetinaFactor())) {
 		if (i != _sizesCache.cend()) {
-			ActiveCache().decrement(ComputeUsage(*i));
+			ScaledCache().decrement(ComputeUsage(*i));
 		}
 		auto p = pixNoCache(origin, w, h, options, outerw, outerh, colored);
 		p.setDevicePixelRatio(cRetinaFactor());
 		i = _sizesCache.insert(k, p);
-		ActiveCache().increment(ComputeUsage(*i));
+		ScaledCache().increment(ComputeUsage(*i));
+		ScaledCache().miss();
+	} else {
+		ScaledCache().hit();
 	}
+	ScaledCache().up(this);
 	return i.value();
 }
 
@@ -813,13 +851,17 @@ const QPixmap &Image::pixBlurredSingle(
 	auto i = _sizesCache.constFind(k);
 	if (i == _sizesCache.cend() || i->width() != (outerw * cIntRetinaFactor()) || i->height() != (outerh * cIntRetinaFactor())) {
 		if (i != _sizesCache.cend()) {
-			ActiveCache().decrement(ComputeUsage(*i));
+			ScaledCache().decrement(ComputeUsage(*i));
 		}
 		auto p = pixNoCache(origin, w, h, options, outerw, outerh);
 		p.setDevicePixelRatio(cRetinaFactor());
 		i = _sizesCache.insert(k, p);
-		ActiveCache().increment(ComputeUsage(*i));
+		ScaledCache().increment(ComputeUsage(*i));
+		ScaledCache().miss();
+	} else {
+		ScaledCache().hit();
 	}
+	ScaledCache().up(this);
 	return i.value();
 }
 
@@ -831,6 +873,11 @@ QPixmap Image::pixNoCache(
 		int outerw,
 		int outerh,
 		const style::color *colored) const {
+	if (_data.isNull()) {
+		DecodedCache().miss();
+	} else {
+		DecodedCache().hit();
+	}
 	if (!loading()) {
 		const_cast<Image*>(this)->load(origin);
 	}
@@ -974,16 +1021,16 @@ void Image::checkSource() const {
 	if (_data.isNull() && !data.isNull()) {
 		invalidateSizeCache();
 		_data = std::move(data);
-		ActiveCache().increment(ComputeUsage(_data));
+		DecodedCache().increment(ComputeUsage(_data));
 	}
 
-	ActiveCache().up(this);
+	DecodedCache().up(this);
 }
 
 void Image::unload() const {
 	_source->unload();
 	invalidateSizeCache();
-	ActiveCache().decrement(ComputeUsage(_data));
+	DecodedCache().decrement(ComputeUsage(_data));
 	_data = QImage();
 }
 
@@ -1002,16 +1049,17 @@ void Image::setImageBytes(const QByteArray &bytes) {
 }
 
 void Image::invalidateSizeCache() const {
-	auto &cache = ActiveCache();
+	auto &cache = ScaledCache();
 	for (const auto &image : std::as_const(_sizesCache)) {
 		cache.decrement(ComputeUsage(image));
 	}
 	_sizesCache.clear();
+	cache.remove(this);
 }
 
 Image::~Image() {
 	if (this != Empty() && this != BlankMedia()) {
 		unload();
-		ActiveCache().remove(this);
+		DecodedCache().remove(this);
 	}
 }
@@ -225,6 +225,7 @@ public:
 	bool loaded() const;
 	bool isNull() const;
 	void unload() const;
+	void invalidateSizeCache() const;
 	void setDelayedStorageLocation(
 		Data::FileOrigin origin,
 		const StorageImageLocation &location);
@@ -234,7 +235,6 @@ public:
 
 private:
 	void checkSource() const;
-	void invalidateSizeCache() const;
 
 	std::unique_ptr<Images::Source> _source;
 	mutable QMap<uint64, QPixmap> _sizesCache;
@@ -0,0 +1,104 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "ui/image/image_decode.h"
+
+#include "app.h"
+
+#include <QtGui/QImageReader>
+
+namespace Images {
+namespace {
+
+[[nodiscard]] bool Fits(QSize size, QSize box) {
+	return (size.width() <= box.width()) && (size.height() <= box.height());
+}
+
+// Returns a null image if the decoder can't scale this one by itself.
+[[nodiscard]] QImage ReadScaled(
+		QByteArray bytes,
+		QSize box,
+		QByteArray *format) {
+#ifndef OS_MAC_OLD
+	QBuffer buffer(&bytes);
+	QImageReader reader(&buffer);
+	reader.setAutoTransform(true);
+	const auto type = reader.format().toLower();
+	if (type != "jpeg" && type != "jpg") {
+		return QImage();
+	}
+	const auto size = reader.size();
+	if (size.isEmpty()) {
+		return QImage();
+	} else if (reader.transformation()
+		& QImageIOHandler::TransformationRotate90) {
+		// The scaled size is applied before the rotation.
+		box.transpose();
+	}
+	if (Fits(size, box)) {
+		return QImage();
+	}
+	reader.setScaledSize(size.scaled(box, Qt::KeepAspectRatio));
+
+	auto result = QImage();
+	if (!reader.read(&result)) {
+		return QImage();
+	}
+	*format = type;
+	return result;
+#else // OS_MAC_OLD
+	return QImage();
+#endif // OS_MAC_OLD
+}
+
+} // namespace
+
+DecodedImage Decode(const QByteArray &bytes, QSize box) {
+	auto result = DecodedImage();
+	if (!box.isEmpty()) {
+		result.image = ReadScaled(bytes, box, &result.format);
+	}
+	if (result.image.isNull()) {
+		result.image = App::readImage(bytes, &result.format, false);
+	}
+	if (!box.isEmpty()
+		&& !result.image.isNull()
+		&& !Fits(result.image.size(), box)) {
+		result.image = result.image.scaled(
+			box,
+			Qt::KeepAspectRatio,
+			Qt::SmoothTransformation);
+	}
+	return result;
+}
+
+base::binary_guard DecodeAsync(
+		QByteArray bytes,
+		QSize box,
+		FnMut<void(DecodedImage&&)> done) {
+	auto result = base::binary_guard();
+	crl::async([
+		bytes = std::move(bytes),
+		box,
+		guard = result.make_guard(),
+		callback = std::move(done)
+	]() mutable {
+		if (!guard.alive()) {
+			return;
+		}
+		auto decoded = Decode(bytes, box);
+		crl::on_main(std::move(guard), [
+			decoded = std::move(decoded),
+			callback = std::move(callback)
+		]() mutable {
+			callback(std::move(decoded));
+		});
+	});
+	return result;
+}
+
+} // namespace Images
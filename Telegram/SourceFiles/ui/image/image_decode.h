@@ -0,0 +1,32 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+#include "base/binary_guard.h"
+
+namespace Images {
+
+struct DecodedImage {
+	QImage image;
+	QByteArray format;
+};
+
+// If box is not empty the image is shrunk to fit into it,
+// JPEG images are downscaled by the decoder itself in that case.
+[[nodiscard]] DecodedImage Decode(
+	const QByteArray &bytes,
+	QSize box = QSize());
+
+// Decodes in a background thread, done is called in the main thread.
+// Destroying the returned guard cancels the decoding.
+[[nodiscard]] base::binary_guard DecodeAsync(
+	QByteArray bytes,
+	QSize box,
+	FnMut<void(DecodedImage&&)> done);
+
+} // namespace Images
@@ -313,7 +313,7 @@ void RemoteSource::loadLocal() {
 		return;
 	}
 
-	_loader = createLoader(Data::FileOrigin(), LoadFromLocalOnly, true);
+	_loader = prepareLoader(Data::FileOrigin(), LoadFromLocalOnly, true);
 	if (_loader) {
 		_loader->start();
 	}
@@ -360,7 +360,7 @@ void RemoteSource::automaticLoad(
 			_loader->permitLoadFromCloud();
 		}
 	} else {
-		_loader = createLoader(
+		_loader = prepareLoader(
 			origin,
 			loadFromCloud ? LoadFromCloudOrLocal : LoadFromLocalOnly,
 			true);
@@ -376,13 +376,24 @@ void RemoteSource::automaticLoadSettingsChanged() {
 
 void RemoteSource::load(Data::FileOrigin origin) {
 	if (!_loader) {
-		_loader = createLoader(origin, LoadFromCloudOrLocal, false);
+		_loader = prepareLoader(origin, LoadFromCloudOrLocal, false);
 	}
 	if (_loader) {
 		_loader->start();
 	}
 }
 
+std::unique_ptr<FileLoader> RemoteSource::prepareLoader(
+		Data::FileOrigin origin,
+		LoadFromCloudSetting fromCloud,
+		bool autoLoading) {
+	auto result = createLoader(origin, fromCloud, autoLoading);
+	if (result) {
+		result->setImageShrinkBox(shrinkBox());
+	}
+	return result;
+}
+
 bool RemoteSource::cancelled() const {
 	return _cancelled;
 }
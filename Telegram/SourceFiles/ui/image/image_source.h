@@ -150,6 +150,11 @@ protected:
 	void loadLocal();
 
 private:
+	// Passes shrinkBox() to the loader, so it decodes images to that size.
+	std::unique_ptr<FileLoader> prepareLoader(
+		Data::FileOrigin origin,
+		LoadFromCloudSetting fromCloud,
+		bool autoLoading);
 	bool cancelled() const;
 	void destroyLoader();
 
@@ -13,6 +13,8 @@ nice_target_sources(lib_export ${src_loc}
 PRIVATE
     export/export_api_wrap.cpp
     export/export_api_wrap.h
+    export/export_checkpoint.cpp
+    export/export_checkpoint.h
     export/export_controller.cpp
     export/export_controller.h
     export/export_settings.cpp
@@ -21,6 +23,8 @@ PRIVATE
     export/data/export_data_types.h
     export/output/export_output_abstract.cpp
     export/output/export_output_abstract.h
+    export/output/export_output_binary.cpp
+    export/output/export_output_binary.h
     export/output/export_output_encryptionData.cpp
     export/output/export_output_encryptionData.h
     export/output/export_output_file.cpp